@@ -0,0 +1,201 @@
+#ifndef _MOURISL_BWTSEQUENCE_HEADER
+#define _MOURISL_BWTSEQUENCE_HEADER
+
+#include <stdio.h>
+#include <string.h>
+
+#include "compactds/Sequence.hpp"
+#include "compactds/Sequence_RunBlock.hpp"
+#include "compactds/Sequence_OccTable.hpp"
+
+using namespace compactds ;
+
+#define BWT_FORMAT_RUNBLOCK 0 // run-block compressed BWT, the smallest index
+#define BWT_FORMAT_OCC 1 // occurrence table, 2-3x larger index with faster rank
+
+// The BWT string of the index in one of the formats above, selected at build time.
+// The run-block format is saved exactly as Sequence_RunBlock to keep the existing indexes loadable,
+//   and other formats are saved after a tag that cannot be the first field (_space) of Sequence_RunBlock.
+class BWTSequence: public Sequence
+{
+private:
+  int _format ;
+  Sequence_RunBlock<> _runBlockSeq ;
+  Sequence_OccTable _occSeq ;
+
+  static const size_t OCC_FORMAT_TAG = 0xffffffffffff0cc1ull ;
+public:
+  BWTSequence()
+  {
+    _format = BWT_FORMAT_RUNBLOCK ;
+  }
+
+  ~BWTSequence() {}
+
+  // Return the format id for the name, -1 if the name is unknown
+  static int GetFormatFromName(const char *name)
+  {
+    if (!strcmp(name, "runblock"))
+      return BWT_FORMAT_RUNBLOCK ;
+    else if (!strcmp(name, "occ"))
+      return BWT_FORMAT_OCC ;
+    return -1 ;
+  }
+
+  static const char *GetFormatName(int format)
+  {
+    return format == BWT_FORMAT_OCC ? "occ" : "runblock" ;
+  }
+
+  void SetFormat(int format)
+  {
+    _format = format ;
+  }
+
+  int GetFormat() const
+  {
+    return _format ;
+  }
+
+  void SetAlphabet(const Alphabet &a)
+  {
+    _alphabets = a ;
+    _runBlockSeq.SetAlphabet(a) ;
+    _occSeq.SetAlphabet(a) ;
+  }
+
+  void SetThreadCnt(int threadCnt)
+  {
+    _threadCnt = threadCnt ;
+    _runBlockSeq.SetThreadCnt(threadCnt) ;
+    _occSeq.SetThreadCnt(threadCnt) ;
+  }
+
+  // The block size of the run-block format
+  void SetExtraParameter(void *p)
+  {
+    _runBlockSeq.SetExtraParameter(p) ;
+  }
+
+  void Init(const FixedSizeElemArray &S, size_t sequenceLength, const ALPHABET *alphabetMap)
+  {
+    _n = sequenceLength ;
+    if (_format == BWT_FORMAT_OCC)
+      _occSeq.Init(S, sequenceLength, alphabetMap) ;
+    else
+      _runBlockSeq.Init(S, sequenceLength, alphabetMap) ;
+  }
+
+  void Free()
+  {
+    _runBlockSeq.Free() ;
+    _occSeq.Free() ;
+    _n = 0 ;
+  }
+
+  size_t GetSpace()
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.GetSpace() ;
+    return _runBlockSeq.GetSpace() ;
+  }
+
+  ALPHABET Access(size_t i) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.Access(i) ;
+    return _runBlockSeq.Access(i) ;
+  }
+
+  size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.Rank(c, i, inclusive) ;
+    return _runBlockSeq.Rank(c, i, inclusive) ;
+  }
+
+  size_t Select(ALPHABET c, size_t i) const
+  {
+    return 0 ;
+  }
+
+  ALPHABET AccessAndRank(size_t i, size_t &rank) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.AccessAndRank(i, rank) ;
+    return _runBlockSeq.AccessAndRank(i, rank) ;
+  }
+
+  template <int L>
+  WORD AccessCode(size_t i) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.template AccessCode<L>(i) ;
+    return _runBlockSeq.template AccessCode<L>(i) ;
+  }
+
+  template <int L>
+  size_t RankCode(WORD code, size_t i, int inclusive = 1) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.template RankCode<L>(code, i, inclusive) ;
+    return _runBlockSeq.template RankCode<L>(code, i, inclusive) ;
+  }
+
+  template <int L>
+  void RankCodePair(WORD code, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      _occSeq.template RankCodePair<L>(code, i, j, ri, rj) ;
+    else
+      _runBlockSeq.template RankCodePair<L>(code, i, j, ri, rj) ;
+  }
+
+  template <int L>
+  WORD AccessCodeAndRank(size_t i, size_t &rank) const
+  {
+    if (_format == BWT_FORMAT_OCC)
+      return _occSeq.template AccessCodeAndRank<L>(i, rank) ;
+    return _runBlockSeq.template AccessCodeAndRank<L>(i, rank) ;
+  }
+
+  void PrintStats()
+  {
+    if (_format == BWT_FORMAT_OCC)
+      _occSeq.PrintStats() ;
+    else
+      _runBlockSeq.PrintStats() ;
+  }
+
+  void Save(FILE *fp)
+  {
+    if (_format == BWT_FORMAT_OCC)
+    {
+      size_t tag = OCC_FORMAT_TAG ;
+      SAVE_VAR(fp, tag) ;
+      _occSeq.Save(fp) ;
+    }
+    else
+      _runBlockSeq.Save(fp) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+    size_t tag = 0 ;
+    LOAD_VAR(fp, tag) ;
+    if (tag == OCC_FORMAT_TAG)
+    {
+      _format = BWT_FORMAT_OCC ;
+      _occSeq.Load(fp) ;
+    }
+    else
+    {
+      _format = BWT_FORMAT_RUNBLOCK ;
+      fseek(fp, -(long)sizeof(tag), SEEK_CUR) ;
+      _runBlockSeq.Load(fp) ;
+    }
+  }
+} ;
+
+#endif
@@ -1,109 +1,248 @@
 #ifndef _MOURISL_BUILDER_HEADER
 #define _MOURISL_BUILDER_HEADER
 
+#include <sys/resource.h>
+
 #include "ReadFiles.hpp"
 #include "compactds/Sequence_Hybrid.hpp"
-#include "compactds/Sequence_RunBlock.hpp"
+#include "BWTSequence.hpp"
 #include "compactds/FMBuilder.hpp"
 #include "compactds/FMIndex.hpp"
 #include "compactds/Alphabet.hpp"
 #include "compactds/SequenceCompactor.hpp"
 #include "Taxonomy.hpp"
+#include "GenomeSketch.hpp"
 
 // Holds various method regarding building index
 using namespace compactds ; 
 
+struct _builderTransformSAThreadArg
+{
+  int tid ;
+  int threadCnt ;
+  struct _FMBuilderParam *fmBuilderParam ;
+  const std::vector<size_t> *genomeSeqIds ;
+  const PartialSum *lenPsum ;
+  size_t n ;
+
+  size_t sampledFrom, sampledTo ; // [from, to) in sampledSA
+  std::map<size_t, size_t>::iterator selectedFrom, selectedTo ; // the range in selectedSA
+} ;
+
 class Builder
 {
 private:
-  FMIndex<Sequence_RunBlock> _fmIndex ;
+  FMIndex<BWTSequence, Alphabet_DNA> _fmIndex ;
   Taxonomy _taxonomy ;
   std::map<size_t, size_t> _seqLength ; // we use map here is for the case that a seq show up in the conversion table but not in the actual genome file.
+  int _shardCnt ; 
+  int _shardId ; // only include the genomes in this shard
+  uint8_t _shardRank ; // the genomes under the same taxonomy node of this rank are in the same shard
+  
+  int _bwtFormat ; // BWT_FORMAT_*, -1: run-block, or the format of the index to append to
+  double _dedupIdentity ; // >0: skip the sequence similar to an indexed one of the same species
+  std::map<size_t, GenomeSketch> _dedupSpeciesSketches ; // species to the sketch of the union of its indexed sequences
+  size_t _dedupSkipCnt ;
+  size_t _dedupSkipLength ;
 
-  // SampledSA need to be processed before FMIndex.Init() because the sampledSA is represented by FixedElemLengthArray, which requires the largest element size
-  void TransformSampledSAToSeqId(struct _FMBuilderParam &fmBuilderParam, std::vector<size_t> genomeSeqIds,
-      std::vector<size_t> genomeLens, size_t n)
+  // @return: the shard for the sequence, determined by its taxonomy subtree at _shardRank 
+  int GetSeqShard(size_t seqid, const char *seqName)
   {
+    uint64_t key = 0 ;
+    if (seqid < _taxonomy.GetSeqCount())
+    {
+      size_t ctid = _taxonomy.SeqIdToTaxId(seqid) ;
+      size_t rankTid = _taxonomy.GetTaxIdAtAncestorRank(ctid, _shardRank) ;
+      if (rankTid < _taxonomy.GetNodeCount())
+        ctid = rankTid ;
+      key = _taxonomy.GetOrigTaxId(ctid) ;
+    }
+    else // sequences without taxonomy information
+    {
+      int i ;
+      for (i = 0 ; seqName[i] ; ++i)
+        key = key * 31 + seqName[i] ;
+    }
+    return ((key * 0x9E3779B97F4A7C15ull) >> 32) % _shardCnt ;
+  }
+
+  static void *TransformSampledSAToSeqId_Thread(void *arg)
+  {
+    struct _builderTransformSAThreadArg *pArg = (struct _builderTransformSAThreadArg *)arg ;
+    struct _FMBuilderParam &fmBuilderParam = *(pArg->fmBuilderParam) ;
+    const std::vector<size_t> &genomeSeqIds = *(pArg->genomeSeqIds) ;
+    const PartialSum &lenPsum = *(pArg->lenPsum) ;
     size_t i ;
-    PartialSum lenPsum ;
-    lenPsum.Init(genomeLens.data(), genomeLens.size()) ;
-    for (i = 0 ; i < fmBuilderParam.sampleSize ; ++i)
+    for (i = pArg->sampledFrom ; i < pArg->sampledTo ; ++i)
     {
       // The precomputeWidth + 1 here to handle the fuzzy boundary
-      if (fmBuilderParam.sampledSA[i] + fmBuilderParam.precomputeWidth + 1 < n)
-        fmBuilderParam.sampledSA[i] = genomeSeqIds[lenPsum.Search(
-            fmBuilderParam.sampledSA[i] + fmBuilderParam.precomputeWidth + 1)] ;  
+      size_t sa = fmBuilderParam.sampledSA[i] ;
+      if (sa + fmBuilderParam.precomputeWidth + 1 < pArg->n)
+        fmBuilderParam.sampledSA.Write(i, genomeSeqIds[lenPsum.Search(
+            sa + fmBuilderParam.precomputeWidth + 1)]) ;  
       else
-        fmBuilderParam.sampledSA[i] = genomeSeqIds[lenPsum.Search(
-            fmBuilderParam.sampledSA[i])] ;
+        fmBuilderParam.sampledSA.Write(i, genomeSeqIds[lenPsum.Search(sa)]) ;
     }
-    fmBuilderParam.adjustedSA0 = genomeSeqIds[0] ;
 
-    for (std::map<size_t, size_t>::iterator iter = fmBuilderParam.selectedSA.begin() ;
-        iter != fmBuilderParam.selectedSA.end() ; ++iter)
+    for (std::map<size_t, size_t>::iterator iter = pArg->selectedFrom ;
+        iter != pArg->selectedTo ; ++iter)
     {
       iter->second = genomeSeqIds[lenPsum.Search(iter->second + fmBuilderParam.precomputeWidth + 1)] ; // the selected SA stores the fuzzy start position for the next genome, so we need to plus the adjusted boundary.
     }
+    pthread_exit(NULL) ;
   }
 
-public: 
-  Builder() {}
-  ~Builder() 
+  // SampledSA need to be processed before FMIndex.Init() because the sampledSA is represented by FixedElemLengthArray, which requires the largest element size
+  // Each thread maps a chunk of sampledSA and selectedSA.
+  void TransformSampledSAToSeqId(struct _FMBuilderParam &fmBuilderParam, const std::vector<size_t> &genomeSeqIds,
+      const std::vector<size_t> &genomeLens, size_t n)
   {
-    _fmIndex.Free() ;
-    _taxonomy.Free() ;
+    int i ;
+    PartialSum lenPsum ;
+    lenPsum.Init(genomeLens.data(), genomeLens.size()) ;
+    
+    int threadCnt = fmBuilderParam.threadCnt ;
+    if (threadCnt < 1)
+      threadCnt = 1 ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * threadCnt) ;
+    struct _builderTransformSAThreadArg *args = new struct _builderTransformSAThreadArg[threadCnt] ;
+    
+    size_t sampledSegLen = DIV_CEIL(fmBuilderParam.sampleSize, threadCnt) ;
+    size_t selectedSegLen = DIV_CEIL(fmBuilderParam.selectedSA.size(), threadCnt) ;
+    std::map<size_t, size_t>::iterator selectedIter = fmBuilderParam.selectedSA.begin() ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      args[i].tid = i ;
+      args[i].threadCnt = threadCnt ;
+      args[i].fmBuilderParam = &fmBuilderParam ;
+      args[i].genomeSeqIds = &genomeSeqIds ;
+      args[i].lenPsum = &lenPsum ;
+      args[i].n = n ;
+      args[i].sampledFrom = MIN(sampledSegLen * i, fmBuilderParam.sampleSize) ;
+      args[i].sampledTo = MIN(sampledSegLen * (i + 1), fmBuilderParam.sampleSize) ;
+      
+      size_t j ;
+      args[i].selectedFrom = selectedIter ;
+      for (j = 0 ; j < selectedSegLen && selectedIter != fmBuilderParam.selectedSA.end() ; ++j)
+        ++selectedIter ;
+      args[i].selectedTo = selectedIter ;
+    }
+    
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, TransformSampledSAToSeqId_Thread, (void *)(args + i)) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    fmBuilderParam.adjustedSA0 = genomeSeqIds[0] ;
+
+    free(threads) ;
+    delete[] args ;
   }
 
-  void SetRBBWTBlockSize(size_t b)
+  // Decide whether the current sequence in refGenomeFile goes into the index.
+  // fileNameBuffer: holds the file base name when conversionTableAtFileLevel
+  // @return: the seqid of the sequence, -1 if the sequence should be skipped
+  size_t GetIndexSeqId(ReadFiles &refGenomeFile, bool conversionTableAtFileLevel, uint64_t subsetTax,
+      const std::map<size_t, int> &selectedTaxIds, const std::map<size_t, size_t> &existSeqLength, 
+      char *fileNameBuffer)
   {
-    _fmIndex.SetSequenceExtraParameter((void *)b) ;
+    size_t seqid = 0 ;
+    if (conversionTableAtFileLevel)
+    {
+      Utils::GetFileBaseName(refGenomeFile.GetFileName( refGenomeFile.GetCurrentFileInd() ).c_str(), 
+          "fna|fa|fasta|faa", fileNameBuffer) ;
+      seqid = _taxonomy.SeqNameToId(fileNameBuffer) ;
+    }
+    else
+      seqid = _taxonomy.SeqNameToId(refGenomeFile.id) ;
+
+    if (subsetTax != 0)
+    {
+      size_t taxid = _taxonomy.SeqIdToTaxId(seqid) ;
+      if (selectedTaxIds.find(taxid) == selectedTaxIds.end())
+        return (size_t)-1 ;
+    }
+
+    if (_shardCnt > 1 
+        && GetSeqShard(seqid, conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) != _shardId)
+      return (size_t)-1 ;
+
+    if (existSeqLength.find(seqid) != existSeqLength.end())
+    {
+      fprintf(stderr, "WARNING: %s is already in the index and is skipped!\n", 
+          conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
+      return (size_t)-1 ;
+    }
+
+    if (seqid >= _taxonomy.GetSeqCount())
+    {
+      fprintf(stderr, "WARNING: taxonomy id doesn't exist for %s!\n", 
+          conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
+      seqid = _taxonomy.AddExtraSeqName(conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
+    }
+    return seqid ;
   }
 
-  void Build(ReadFiles &refGenomeFile, char *taxonomyFile, char *nameTable, char *conversionTable, bool conversionTableAtFileLevel, uint64_t subsetTax, size_t memoryConstraint, struct _FMBuilderParam &fmBuilderParam, const char *alphabetList)
+  // Test whether the sequence is within _dedupIdentity to the indexed sequences 
+  //   of the same species, by the containment in their union. So a contig of a draft 
+  //   assembly is skipped if a finished genome covers it, and its unique part is kept. 
+  //   If not, the sequence is added to the union.
+  bool IsNearDuplicate(size_t seqid, const char *seq)
   {
-    size_t i ;
-    const int alphabetSize = strlen(alphabetList) ;
-  
-    _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ; 
+    if (_dedupIdentity <= 0 || seqid >= _taxonomy.GetSeqCount())
+      return false ;
+    size_t taxid = _taxonomy.SeqIdToTaxId(seqid) ;
+    size_t speciesTaxid = _taxonomy.GetTaxIdAtAncestorRank(taxid, RANK_SPECIES) ;
+    if (speciesTaxid >= _taxonomy.GetNodeCount())
+      speciesTaxid = taxid ;
 
-    FixedSizeElemArray genomes ;
+    GenomeSketch sketch ;
+    sketch.Init(seq) ;
+    if (sketch.GetSize() == 0)
+      return false ;
+    
+    GenomeSketch &speciesSketch = _dedupSpeciesSketches[speciesTaxid] ;
+    if (speciesSketch.GetSize() > 0 && sketch.ContainmentIdentity(speciesSketch) >= _dedupIdentity)
+    {
+      ++_dedupSkipCnt ;
+      _dedupSkipLength += strlen(seq) ;
+      return true ;
+    }
+    speciesSketch.Merge(sketch) ;
+    return false ;
+  }
+
+  void ReportDedup()
+  {
+    if (_dedupIdentity > 0)
+      Utils::PrintLog("Skipped %lu near-duplicate sequences (%lu bp).", _dedupSkipCnt, _dedupSkipLength) ;
+    _dedupSpeciesSketches.clear() ;
+  }
+
+  // Read in and compact the genomes
+  // existSeqLength: the sequences already in the index, which will be skipped
+  void CompactGenomes(ReadFiles &refGenomeFile, bool conversionTableAtFileLevel, uint64_t subsetTax, 
+      int precomputeWidth, const std::map<size_t, size_t> &existSeqLength, const char *alphabetList, 
+      FixedSizeElemArray &genomes, std::vector<size_t> &genomeSeqIds, std::vector<size_t> &genomeLens)
+  {
     SequenceCompactor seqCompactor ;
     seqCompactor.Init(alphabetList, genomes, 1000000) ;
     
     std::map<size_t, int> selectedTaxIds ;
     if (subsetTax != 0)
       _taxonomy.GetChildrenTax(_taxonomy.CompactTaxId(subsetTax), selectedTaxIds) ; 
-    std::vector<size_t> genomeSeqIds ;
-    std::vector<size_t> genomeLens ; 
     while (refGenomeFile.Next())
     {
-      size_t seqid = 0 ;
       char fileNameBuffer[1024] ;
-      if (conversionTableAtFileLevel)
-      {
-        Utils::GetFileBaseName(refGenomeFile.GetFileName( refGenomeFile.GetCurrentFileInd() ).c_str(), 
-            "fna|fa|fasta|faa", fileNameBuffer) ;
-        seqid = _taxonomy.SeqNameToId(fileNameBuffer) ;
-      }
-      else
-        seqid = _taxonomy.SeqNameToId(refGenomeFile.id) ;
-      
-      if (subsetTax != 0)
-      {
-        size_t taxid = _taxonomy.SeqIdToTaxId(seqid) ;
-        if (selectedTaxIds.find(taxid) == selectedTaxIds.end())
-          continue ;
-      }
-      
-      if (seqid >= _taxonomy.GetSeqCount())
-      {
-        fprintf(stderr, "WARNING: taxonomy id doesn't exist for %s!\n", 
-            conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
-        seqid = _taxonomy.AddExtraSeqName(conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
-      }
+      size_t seqid = GetIndexSeqId(refGenomeFile, conversionTableAtFileLevel, subsetTax, 
+          selectedTaxIds, existSeqLength, fileNameBuffer) ;
+      if (seqid == (size_t)-1)
+        continue ;
+
+      if (IsNearDuplicate(seqid, refGenomeFile.seq))
+        continue ;
 
       size_t len = seqCompactor.Compact(refGenomeFile.seq, genomes) ;
-      if (len < fmBuilderParam.precomputeWidth + 1ull) // A genome too short
+      if (len < precomputeWidth + 1ull) // A genome too short
       {
         fprintf(stderr, "WARNING: %s is filtered due to its short length (could be from masker)!\n", refGenomeFile.id) ;
         size_t size = genomes.GetSize() ;
@@ -123,6 +262,156 @@ public:
         genomeLens[ genomeLens.size() - 1 ] += len ;
       }
     }
+    ReportDedup() ;
+  }
+
+  // Save the compacted genomes and the sequence information, so resuming 
+  //   the construction does not need to read the input again.
+  void SaveTextCheckpoint(const struct _FMBuilderParam &fmBuilderParam, FixedSizeElemArray &genomes, 
+      const std::vector<size_t> &genomeSeqIds, const std::vector<size_t> &genomeLens)
+  {
+    char fileName[1024] ;
+    char tmpFileName[1100] ;
+    FMBuilder::GetCheckpointFileName(fmBuilderParam, "text", fileName) ;
+    sprintf(tmpFileName, "%s.tmp", fileName) ;
+    FILE *fp = fopen(tmpFileName, "wb") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to open checkpoint file %s.\n", tmpFileName) ;
+      exit(EXIT_FAILURE) ;
+    }
+
+    _taxonomy.Save(fp) ;
+    genomes.Save(fp) ;
+    size_t size = genomeSeqIds.size() ;
+    SAVE_VAR(fp, size) ;
+    fwrite(genomeSeqIds.data(), sizeof(genomeSeqIds[0]), size, fp) ;
+    fwrite(genomeLens.data(), sizeof(genomeLens[0]), size, fp) ;
+    size = _seqLength.size() ;
+    SAVE_VAR(fp, size) ;
+    for (std::map<size_t, size_t>::iterator iter = _seqLength.begin() ; 
+        iter != _seqLength.end() ; ++iter)
+    {
+      SAVE_VAR(fp, iter->first) ;
+      SAVE_VAR(fp, iter->second) ;
+    }
+    fclose(fp) ;
+    rename(tmpFileName, fileName) ;
+  }
+
+  // @return: false if there is no checkpoint for the text
+  bool LoadTextCheckpoint(const struct _FMBuilderParam &fmBuilderParam, FixedSizeElemArray &genomes, 
+      std::vector<size_t> &genomeSeqIds, std::vector<size_t> &genomeLens)
+  {
+    size_t i ;
+    char fileName[1024] ;
+    FMBuilder::GetCheckpointFileName(fmBuilderParam, "text", fileName) ;
+    FILE *fp = fopen(fileName, "rb") ;
+    if (fp == NULL)
+      return false ;
+
+    _taxonomy.Load(fp) ;
+    genomes.Load(fp) ;
+    size_t size ;
+    LOAD_VAR(fp, size) ;
+    genomeSeqIds.resize(size) ;
+    genomeLens.resize(size) ;
+    fread(genomeSeqIds.data(), sizeof(genomeSeqIds[0]), size, fp) ;
+    fread(genomeLens.data(), sizeof(genomeLens[0]), size, fp) ;
+    LOAD_VAR(fp, size) ;
+    _seqLength.clear() ;
+    for (i = 0 ; i < size ; ++i)
+    {
+      size_t seqid, len ;
+      LOAD_VAR(fp, seqid) ;
+      LOAD_VAR(fp, len) ;
+      _seqLength[seqid] = len ;
+    }
+    fclose(fp) ;
+    return true ;
+  }
+
+public: 
+  Builder() 
+  {
+    _shardCnt = 1 ;
+    _shardId = 0 ;
+    _shardRank = RANK_GENUS ;
+    _bwtFormat = -1 ;
+    _dedupIdentity = 0 ;
+    _dedupSkipCnt = 0 ;
+    _dedupSkipLength = 0 ;
+  }
+  ~Builder() 
+  {
+    _fmIndex.Free() ;
+    _taxonomy.Free() ;
+  }
+
+  void SetRBBWTBlockSize(size_t b)
+  {
+    _fmIndex.SetSequenceExtraParameter((void *)b) ;
+  }
+
+  // Only build the index for the shardId-th (0-based) shard of the genomes
+  void SetShard(int shardCnt, int shardId, const char *shardRank)
+  {
+    _shardCnt = shardCnt ;
+    _shardId = shardId ;
+    _shardRank = _taxonomy.GetTaxRankId(shardRank) ;
+    if (_shardRank == RANK_UNKNOWN)
+    {
+      fprintf(stderr, "ERROR: unknown taxonomy rank %s for sharding.\n", shardRank) ;
+      exit(EXIT_FAILURE) ;
+    }
+  }
+
+  void SetBWTFormat(int format)
+  {
+    _bwtFormat = format ;
+  }
+
+  // Set the BWT format of fm before its Init
+  void InitBWTFormat(FMIndex<BWTSequence, Alphabet_DNA> &fm)
+  {
+    if (_bwtFormat < 0)
+      _bwtFormat = BWT_FORMAT_RUNBLOCK ;
+    fm.GetBWTSequence().SetFormat(_bwtFormat) ;
+    if (_bwtFormat == BWT_FORMAT_OCC)
+      Utils::PrintLog("Start to build the occurrence table for BWT.") ;
+    else
+      Utils::PrintLog("Start to compress BWT with RBBWT.") ;
+  }
+
+  // Skip the sequences whose MinHash identity to an indexed sequence of the same species is at least identity
+  void SetDedup(double identity)
+  {
+    _dedupIdentity = identity ;
+  }
+
+  void Build(ReadFiles &refGenomeFile, char *taxonomyFile, char *nameTable, char *conversionTable, bool conversionTableAtFileLevel, uint64_t subsetTax, size_t memoryConstraint, struct _FMBuilderParam &fmBuilderParam, const char *alphabetList)
+  {
+    size_t i ;
+    const int alphabetSize = strlen(alphabetList) ;
+  
+    FixedSizeElemArray genomes ;
+    std::vector<size_t> genomeSeqIds ;
+    std::vector<size_t> genomeLens ; 
+    if (fmBuilderParam.resume && fmBuilderParam.checkpointPrefix != NULL
+        && LoadTextCheckpoint(fmBuilderParam, genomes, genomeSeqIds, genomeLens))
+    {
+      Utils::PrintLog("Load the genomes from the checkpoint.") ;
+    }
+    else
+    {
+      _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ; 
+      
+      std::map<size_t, size_t> existSeqLength ;
+      CompactGenomes(refGenomeFile, conversionTableAtFileLevel, subsetTax, fmBuilderParam.precomputeWidth,
+          existSeqLength, alphabetList, genomes, genomeSeqIds, genomeLens) ;
+      if (fmBuilderParam.checkpointPrefix != NULL && genomeLens.size() > 0)
+        SaveTextCheckpoint(fmBuilderParam, genomes, genomeSeqIds, genomeLens) ;
+    }
 
     FixedSizeElemArray BWT ;
     size_t firstISA ;
@@ -131,7 +420,11 @@ public:
     size_t genomeCnt = genomeLens.size() ;
     if (genomeCnt == 0)
     {
-      fprintf(stderr, "ERROR: found 0 genomes in the input or after filtering.\n") ;
+      if (_shardCnt > 1)
+        fprintf(stderr, "ERROR: found 0 genomes for shard %d. The genomes are from too few taxonomy nodes at --shard-rank for --shard-count %d.\n", 
+            _shardId, _shardCnt) ;
+      else
+        fprintf(stderr, "ERROR: found 0 genomes in the input or after filtering.\n") ;
       exit(EXIT_FAILURE) ;
     }
     size_t psum = 0 ; // genome length partial sum
@@ -147,8 +440,13 @@ public:
     Utils::PrintLog("Found %lu sequences with total length %lu bp.", 
         genomeCnt, totalGenomeSize) ;
     
-    if (memoryConstraint != 0)
-      FMBuilder::InferParametersGivenMemory(genomes.GetSize(), alphabetSize, memoryConstraint,fmBuilderParam) ;
+    if (memoryConstraint != 0 
+        && !FMBuilder::InferParametersGivenMemory(genomes.GetSize(), alphabetSize, memoryConstraint,fmBuilderParam))
+    {
+      fprintf(stderr, "ERROR: --build-mem is too small for the %lu bp genomes. Please check the peak memory with --dry-run.\n",
+          totalGenomeSize) ;
+      exit(EXIT_FAILURE) ;
+    }
     /*{
       size_t memoryCost = totalGenomeSize / 4 / WORDBYTES + DIV_CEIL(totalGenomeSize, fmBuilderParam.sampleRate) * Utils::Log2Ceil(genomeCnt) ; // We need to substract other portion out, like the space for the rank structure and the reduced sampled SA. ;
       if (memoryConstraint > adjustMemoryCost) 
@@ -165,18 +463,275 @@ public:
 
     FMBuilder::Build(genomes, totalGenomeSize, alphabetSize, BWT, firstISA, fmBuilderParam) ;
     genomes.Free() ;
+    if (fmBuilderParam.tmpPrefix != NULL)
+    {
+      Utils::PrintLog("Load the BWT and sampled SA from temporary files.") ;
+      FMBuilder::LoadSpilledData(BWT, alphabetSize, fmBuilderParam) ;
+    }
     Utils::PrintLog("Start to transform sampled SA to sequence ID.") ;
     TransformSampledSAToSeqId(fmBuilderParam, genomeSeqIds, genomeLens, totalGenomeSize) ;
-    Utils::PrintLog("Start to compress BWT with RBBWT.") ;
+    InitBWTFormat(_fmIndex) ;
     _fmIndex.Init(BWT, totalGenomeSize, 
         firstISA, fmBuilderParam, alphabetList, alphabetSize) ;
+    FMBuilder::RemoveCheckpoint(fmBuilderParam) ;
+    Utils::PrintLog("centrifuger-build finishes.") ;
+  }
+
+  // Add the genomes to the existing index with prefix indexPrefix.
+  // The new genomes are placed before the indexed text, so the suffixes of the
+  //   indexed text keep their order and only the suffixes of the new genomes are sorted.
+  // The taxonomy files should cover both the indexed and new sequences.
+  void Append(const char *indexPrefix, ReadFiles &refGenomeFile, char *taxonomyFile, char *nameTable, char *conversionTable, bool conversionTableAtFileLevel, uint64_t subsetTax, struct _FMBuilderParam &fmBuilderParam, const char *alphabetList)
+  {
+    size_t i, k ;
+    const int alphabetSize = strlen(alphabetList) ;
+    const int alphabetBits = Utils::Log2Ceil(alphabetSize) ;
+    char fileName[1024] ;
+    FILE *fp ;
+
+    // Load the existing index
+    FMIndex<BWTSequence, Alphabet_DNA> oldFmIndex ;
+    sprintf(fileName, "%s.1.cfr", indexPrefix) ;
+    fp = fopen(fileName, "r") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to open index file %s.\n", fileName) ;
+      exit(EXIT_FAILURE) ;
+    }
+    oldFmIndex.Load(fp) ;
+    fclose(fp) ;
+    // The merge does not have the text of the existing index to compare the suffixes
+    if (oldFmIndex.GetMaxLcp() > 0)
+    {
+      fprintf(stderr, "ERROR: --append does not support the index built with --max-lcp. Please rebuild the index with all the genomes.\n") ;
+      exit(EXIT_FAILURE) ;
+    }
+    if (_bwtFormat < 0)
+      _bwtFormat = oldFmIndex.GetBWTSequence().GetFormat() ;
+
+    Taxonomy oldTaxonomy ;
+    sprintf(fileName, "%s.2.cfr", indexPrefix) ;
+    fp = fopen(fileName, "r") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to open index file %s.\n", fileName) ;
+      exit(EXIT_FAILURE) ;
+    }
+    oldTaxonomy.Load(fp) ;
+    fclose(fp) ;
+
+    _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ;
+
+    // Map the seq ids in the existing index to the new taxonomy
+    size_t oldSeqCnt = oldTaxonomy.GetAllSeqCount() ;
+    std::vector<size_t> seqIdMap(oldSeqCnt) ;
+    for (i = 0 ; i < oldSeqCnt ; ++i)
+    {
+      std::string seqName = oldTaxonomy.SeqIdToName(i) ;
+      seqIdMap[i] = _taxonomy.SeqNameToId(seqName) ;
+      if (seqIdMap[i] >= _taxonomy.GetSeqCount())
+      {
+        fprintf(stderr, "WARNING: taxonomy id doesn't exist for %s!\n", seqName.c_str()) ;
+        seqIdMap[i] = _taxonomy.AddExtraSeqName((char *)seqName.c_str()) ;
+      }
+    }
+    oldTaxonomy.Free() ;
+
+    std::map<size_t, size_t> existSeqLength ;
+    sprintf(fileName, "%s.3.cfr", indexPrefix) ;
+    fp = fopen(fileName, "r") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to open index file %s.\n", fileName) ;
+      exit(EXIT_FAILURE) ;
+    }
+    size_t tmp[2] ;
+    while (fread(tmp, sizeof(tmp[0]), 2, fp))
+      existSeqLength[ seqIdMap[tmp[0]] ] = tmp[1] ;
+    fclose(fp) ;
+
+    // Read in the new genomes. The construction parameters follow the existing index.
+    struct _FMIndexAuxData &oldAuxData = oldFmIndex._auxData ;
+    const size_t w = oldAuxData.precomputeWidth ;
+    const size_t sampleRate = oldAuxData.sampleRate ;
+    fmBuilderParam.precomputeWidth = w ;
+    fmBuilderParam.sampleRate = sampleRate ;
+    fmBuilderParam.sampleStrategy = oldAuxData.sampleStrategy ;
+
+    FixedSizeElemArray genomes ;
+    std::vector<size_t> genomeSeqIds ;
+    std::vector<size_t> genomeLens ;
+    CompactGenomes(refGenomeFile, conversionTableAtFileLevel, subsetTax, w,
+        existSeqLength, alphabetList, genomes, genomeSeqIds, genomeLens) ;
+    for (std::map<size_t, size_t>::iterator iter = existSeqLength.begin() ;
+        iter != existSeqLength.end() ; ++iter)
+      _seqLength[iter->first] = iter->second ;
+
+    size_t genomeCnt = genomeLens.size() ;
+    if (genomeCnt == 0)
+    {
+      fprintf(stderr, "ERROR: found 0 new genomes in the input or after filtering.\n") ;
+      exit(EXIT_FAILURE) ;
+    }
+    const size_t m = genomes.GetSize() ;
+    const size_t oldn = oldFmIndex.GetSize() ;
+    const size_t n = m + oldn ;
+    Utils::PrintLog("Found %lu new sequences with total length %lu bp.", genomeCnt, m) ;
+
+    Utils::PrintLog("Start to merge the new genomes into the BWT.") ;
+    FixedSizeElemArray BWT ;
+    size_t firstISA = 0 ;
+    size_t *newRows = (size_t *)malloc(sizeof(size_t) * m) ;
+    oldFmIndex.PrependText(genomes, m, fmBuilderParam, BWT, firstISA, newRows) ;
+
+    // sortedNewRows[k] - k is the number of rows from the existing index before the k-th new row
+    size_t *sortedNewRows = (size_t *)malloc(sizeof(size_t) * m) ;
+    memcpy(sortedNewRows, newRows, sizeof(size_t) * m) ;
+    std::sort(sortedNewRows, sortedNewRows + m) ;
+
+    Utils::PrintLog("Start to update the sampled SA.") ;
+    const size_t oldFirstSeqId = seqIdMap[oldAuxData.adjustedSA0] ;
+    fmBuilderParam.n = n ;
+    fmBuilderParam.sampleSize = DIV_CEIL(n, sampleRate) ;
+    fmBuilderParam.sampledSA.Malloc(FixedByteElemArray::GetElemLengthForValue(n), fmBuilderParam.sampleSize) ;
+
+    PartialSum lenPsum ;
+    lenPsum.Init(genomeLens.data(), genomeCnt) ;
+    if (fmBuilderParam.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT)
+    {
+      // The sampled rows from the new genomes.
+      for (i = 0 ; i < m ; ++i)
+      {
+        if (newRows[i] % sampleRate != 0)
+          continue ;
+        // The precomputeWidth + 1 here to handle the fuzzy boundary.
+        // The first genome in the existing index is longer than precomputeWidth.
+        fmBuilderParam.sampledSA.Write(newRows[i] / sampleRate, (i + w + 1 < m) ?
+          genomeSeqIds[ lenPsum.Search(i + w + 1) ] : oldFirstSeqId) ;
+      }
+
+      // The sampled rows from the existing index, whose values are found by walking the existing index
+      std::vector<size_t> oldRows ;
+      std::vector<size_t> sampledIdx ;
+      for (i = 0, k = 0 ; i < n ; i += sampleRate)
+      {
+        while (k < m && sortedNewRows[k] < i)
+          ++k ;
+        if (k < m && sortedNewRows[k] == i)
+          continue ;
+        oldRows.push_back(i - k) ;
+        sampledIdx.push_back(i / sampleRate) ;
+      }
+      std::vector<size_t> oldValues ;
+      oldFmIndex.BackwardToSampledSAForRows(oldRows, oldValues) ;
+      for (i = 0 ; i < oldRows.size() ; ++i)
+        fmBuilderParam.sampledSA.Write(sampledIdx[i], seqIdMap[ oldValues[i] ]) ;
+      std::vector<size_t>().swap(oldRows) ;
+      std::vector<size_t>().swap(sampledIdx) ;
+      std::vector<size_t>().swap(oldValues) ;
+    }
+
+    // From here, the row r in the existing index becomes r + upper_bound(sortedNewRows, r)
+    for (k = 0 ; k < m ; ++k)
+      sortedNewRows[k] -= k ;
+
+    if (fmBuilderParam.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+    {
+      // The text positions of the existing index are shifted by m, so its sampled positions change.
+      //   Their rows and values are found by walking the existing index.
+      std::vector<size_t> oldRows ;
+      std::vector<size_t> oldValues ;
+      oldFmIndex.GetRowsForTextPositions(sampleRate, m, oldRows) ;
+      oldFmIndex.BackwardToSampledSAForRows(oldRows, oldValues) ;
+      
+      fmBuilderParam.sampledRows = Utils::MallocByBits(n) ;
+      for (i = 0 ; i < m ; i += sampleRate)
+        Utils::BitSet(fmBuilderParam.sampledRows, newRows[i]) ;
+      for (i = 0 ; i < oldRows.size() ; ++i)
+      {
+        oldRows[i] += std::upper_bound(sortedNewRows, sortedNewRows + m, oldRows[i]) - sortedNewRows ;
+        Utils::BitSet(fmBuilderParam.sampledRows, oldRows[i]) ;
+      }
+      
+      // The sampled SA is in the order of the rows
+      DS_Rank9 rowRank ;
+      rowRank.Init(fmBuilderParam.sampledRows, n, fmBuilderParam.threadCnt) ;
+      for (i = 0 ; i < m ; i += sampleRate)
+        fmBuilderParam.sampledSA.Write(rowRank.Query(newRows[i], fmBuilderParam.sampledRows, n) - 1, 
+            (i + w + 1 < m) ? genomeSeqIds[ lenPsum.Search(i + w + 1) ] : oldFirstSeqId) ;
+      for (i = 0 ; i < oldRows.size() ; ++i)
+        fmBuilderParam.sampledSA.Write(rowRank.Query(oldRows[i], fmBuilderParam.sampledRows, n) - 1, 
+            seqIdMap[ oldValues[i] ]) ;
+    }
+
+    // Genome boundaries
+    fmBuilderParam.adjustedSA0 = genomeSeqIds[0] ;
+    fmBuilderParam.selectedSA.clear() ;
+    for (k = 0 ; k < oldAuxData.GetSelectedSACount() ; ++k)
+    {
+      size_t r, sa ;
+      oldAuxData.GetSelectedSA(k, r, sa) ;
+      r += std::upper_bound(sortedNewRows, sortedNewRows + m, r) - sortedNewRows ;
+      fmBuilderParam.selectedSA[r] = seqIdMap[sa] ;
+    }
+    size_t psum = 0 ;
+    for (i = 0 ; i < genomeCnt ; ++i)
+    {
+      psum += genomeLens[i] ;
+      if (psum < w + 1)
+        continue ;
+      fmBuilderParam.selectedSA[ newRows[psum - w - 1] ] =
+        (i + 1 < genomeCnt) ? genomeSeqIds[i + 1] : oldFirstSeqId ;
+    }
+
+    // Precomputed ranges
+    fmBuilderParam.precomputeSize = oldAuxData.precomputeSize ;
+    fmBuilderParam.precomputedRange = (std::pair<size_t, size_t> *)malloc(
+        sizeof(std::pair<size_t, size_t>) * fmBuilderParam.precomputeSize) ;
+    WORD firstW = 0 ; // the precompute w for the beginning of the existing text
+    for (i = 0 ; i < fmBuilderParam.precomputeSize ; ++i)
+    {
+      std::pair<size_t, size_t> range = oldAuxData.precomputedRange[i] ;
+      if (range.second > 0)
+      {
+        if (range.first <= oldFmIndex.GetFirstISA() && oldFmIndex.GetFirstISA() < range.first + range.second)
+          firstW = i ;
+        range.first += std::upper_bound(sortedNewRows, sortedNewRows + m, range.first) - sortedNewRows ;
+      }
+      fmBuilderParam.precomputedRange[i] = range ;
+    }
+    for (i = 0 ; i < m ; ++i)
+    {
+      WORD precomputeW = 0 ;
+      if (i + w <= m)
+        precomputeW = genomes.PackRead(i, w) ;
+      else // the suffix spans into the existing text
+        precomputeW = genomes.PackRead(i, m - i)
+          | ((firstW & MASK((w - (m - i)) * alphabetBits)) << ((m - i) * alphabetBits)) ;
+
+      std::pair<size_t, size_t> &range = fmBuilderParam.precomputedRange[precomputeW] ;
+      if (range.second == 0 || newRows[i] < range.first)
+        range.first = newRows[i] ;
+      ++range.second ;
+    }
+
+    free(sortedNewRows) ;
+    free(newRows) ;
+    genomes.Free() ;
+    oldFmIndex.Free() ;
+
+    InitBWTFormat(_fmIndex) ;
+    _fmIndex.Init(BWT, n, firstISA, fmBuilderParam, alphabetList, alphabetSize) ;
     Utils::PrintLog("centrifuger-build finishes.") ;
   }
 
-  void OutputBuilderMeta(FILE *fp, const FMIndex<Sequence_RunBlock> &fm) 
+  void OutputBuilderMeta(FILE *fp, const FMIndex<BWTSequence, Alphabet_DNA> &fm) 
   {
     fprintf(fp, "version\t" CENTRIFUGER_VERSION "\n") ;
     fprintf(fp, "SA_sample_rate\t%d\n", fm._auxData.sampleRate) ;
+    fprintf(fp, "SA_sample_strategy\t%s\n", 
+        fm._auxData.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT ? "text" : "row") ;
+    fprintf(fp, "bwt_format\t%s\n", BWTSequence::GetFormatName(_bwtFormat)) ;
 
     time_t mytime = time(NULL) ;
     struct tm *localT = localtime( &mytime ) ;
@@ -185,6 +740,162 @@ public:
     fprintf(fp, "build_date\t%s", stime) ;
   }
 
+  // Scan the input genomes and report the predicted memory of each building phase,
+  //   the index size and the building time for several thread counts without building the index.
+  // sampleLength: >0, calibrate the time estimation by building the index on the first sampleLength bp
+  void DryRun(ReadFiles &refGenomeFile, char *taxonomyFile, char *nameTable, char *conversionTable, bool conversionTableAtFileLevel, uint64_t subsetTax, size_t memoryConstraint, struct _FMBuilderParam &fmBuilderParam, const char *alphabetList, size_t sampleLength)
+  {
+    size_t i ;
+    const int alphabetSize = strlen(alphabetList) ;
+    
+    _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ; 
+    
+    SequenceCompactor seqCompactor ;
+    FixedSizeElemArray sample ;
+    seqCompactor.Init(alphabetList, sample, 1000000) ;
+    
+    std::map<size_t, int> selectedTaxIds ;
+    std::map<size_t, size_t> existSeqLength ;
+    if (subsetTax != 0)
+      _taxonomy.GetChildrenTax(_taxonomy.CompactTaxId(subsetTax), selectedTaxIds) ; 
+    size_t n = 0 ;
+    while (refGenomeFile.Next())
+    {
+      char fileNameBuffer[1024] ;
+      size_t seqid = GetIndexSeqId(refGenomeFile, conversionTableAtFileLevel, subsetTax, 
+          selectedTaxIds, existSeqLength, fileNameBuffer) ;
+      if (seqid == (size_t)-1)
+        continue ;
+      if (IsNearDuplicate(seqid, refGenomeFile.seq))
+        continue ;
+      size_t len = seqCompactor.CompactLength(refGenomeFile.seq) ;
+      if (len < fmBuilderParam.precomputeWidth + 1ull)
+        continue ;
+      
+      if (_seqLength.find(seqid) == _seqLength.end())
+        _seqLength[seqid] = len ;
+      else
+        _seqLength[seqid] += len ;
+      n += len ;
+
+      if (sample.GetSize() < sampleLength)
+        seqCompactor.Compact(refGenomeFile.seq, sample) ;
+    }
+    ReportDedup() ;
+    size_t genomeCnt = _seqLength.size() ;
+    if (genomeCnt == 0)
+    {
+      fprintf(stderr, "ERROR: found 0 genomes in the input or after filtering.\n") ;
+      exit(EXIT_FAILURE) ;
+    }
+    Utils::PrintLog("Found %lu sequences with total length %lu bp.", genomeCnt, n) ;
+
+    // The memory already used by the process, e.g., the taxonomy and the sequence names,
+    //   which stays through the construction.
+    struct rusage usage ;
+    getrusage(RUSAGE_SELF, &usage) ;
+    size_t baseSpace = (size_t)usage.ru_maxrss * 1024 ;
+
+    // Seconds per unit of the time models, roughly measured on a modern x86 core. 
+    double sortFactor = 3.5e-8 ;
+    double linearFactor = 1e-7 ;
+    if (sampleLength > 0)
+    {
+      size_t m = sample.GetSize() ;
+      if (m > sampleLength)
+        m = sampleLength ;
+      sample.SetSize(m) ;
+      Utils::PrintLog("Calibrate the time estimation with %lu bp.", m) ;
+      
+      struct _FMBuilderParam sampleParam ;
+      sampleParam.threadCnt = fmBuilderParam.threadCnt ;
+      // Keep the chunk count of the full build, so the extraction rounds of the sample
+      //   scale the same way as the full build.
+      sampleParam.saBlockSize = (size_t)((double)fmBuilderParam.saBlockSize * m / n) ;
+      if (sampleParam.saBlockSize < (size_t)4 * fmBuilderParam.saDcv)
+        sampleParam.saBlockSize = 4 * fmBuilderParam.saDcv ;
+      sampleParam.saDcv = fmBuilderParam.saDcv ;
+      sampleParam.sampleRate = fmBuilderParam.sampleRate ;
+      sampleParam.sampleStrategy = fmBuilderParam.sampleStrategy ;
+      sampleParam.precomputeWidth = fmBuilderParam.precomputeWidth ;
+      sampleParam.printLog = false ;
+
+      FixedSizeElemArray BWT ;
+      size_t firstISA ;
+      double startTime = Utils::GetWallTime() ;
+      FMBuilder::Build(sample, m, alphabetSize, BWT, firstISA, sampleParam) ;
+      double sortSeconds = Utils::GetWallTime() - startTime ;
+      
+      startTime = Utils::GetWallTime() ;
+      FMIndex<BWTSequence, Alphabet_DNA> sampleFmIndex ;
+      sampleFmIndex._auxData.printLog = false ;
+      sampleFmIndex.GetBWTSequence().SetFormat(_bwtFormat >= 0 ? _bwtFormat : BWT_FORMAT_RUNBLOCK) ;
+      sampleFmIndex.Init(BWT, m, firstISA, sampleParam, alphabetList, alphabetSize) ;
+      double linearSeconds = Utils::GetWallTime() - startTime ;
+      
+      struct _FMBuilderResourceEstimate sampleEstimate ;
+      FMBuilder::EstimateResource(m, alphabetSize, genomeCnt, sampleParam, sampleEstimate) ;
+      sortFactor = sortSeconds / sampleEstimate.sortTime ;
+      linearFactor = linearSeconds / sampleEstimate.linearTime ;
+      Utils::PrintLog("Sample build took %.2fs for suffix sorting and %.2fs for BWT compression.", 
+          sortSeconds, linearSeconds) ;
+    }
+    sample.Free() ;
+    
+    // Report
+    printf("Sequences: %lu\nTotal length: %lu\n", genomeCnt, n) ;
+    printf("threads\tbmax\tdcv\tcompact\tdcSort\tchunkSort\tsampledSA\trbbwt\tpeak\testimatedTime(s)\n") ;
+    size_t threadCnts[] = {1, 2, 4, 8, 16, 32, 64, fmBuilderParam.threadCnt} ;
+    const int threadCntsSize = sizeof(threadCnts) / sizeof(threadCnts[0]) ;
+    size_t indexSize = 0 ;
+    for (i = 0 ; i < (size_t)threadCntsSize ; ++i)
+    {
+      if (i == (size_t)threadCntsSize - 1)
+      {
+        // Only report the user specified thread count when it is not in the list 
+        size_t j ;
+        for (j = 0 ; j < i ; ++j)
+          if (threadCnts[j] == threadCnts[i])
+            break ;
+        if (j < i)
+          continue ;
+      }
+      struct _FMBuilderParam param ;
+      param.threadCnt = threadCnts[i] ;
+      param.saBlockSize = fmBuilderParam.saBlockSize ;
+      param.saDcv = fmBuilderParam.saDcv ;
+      param.sampleRate = fmBuilderParam.sampleRate ;
+      param.sampleStrategy = fmBuilderParam.sampleStrategy ;
+      param.precomputeWidth = fmBuilderParam.precomputeWidth ;
+      param.tmpPrefix = fmBuilderParam.tmpPrefix ;
+      param.printLog = false ;
+      if (memoryConstraint != 0)
+        FMBuilder::InferParametersGivenMemory(n, alphabetSize, memoryConstraint, param) ;
+
+      struct _FMBuilderResourceEstimate estimate ;
+      FMBuilder::EstimateResource(n, alphabetSize, genomeCnt, param, estimate) ;
+
+      char spaces[6][32] ;
+      Utils::BytesToSpaceString(baseSpace + estimate.compactSpace, spaces[0]) ;
+      Utils::BytesToSpaceString(baseSpace + estimate.dcSortSpace, spaces[1]) ;
+      Utils::BytesToSpaceString(baseSpace + estimate.chunkSortSpace, spaces[2]) ;
+      Utils::BytesToSpaceString(baseSpace + estimate.sampledSASpace, spaces[3]) ;
+      Utils::BytesToSpaceString(baseSpace + estimate.rbbwtSpace, spaces[4]) ;
+      Utils::BytesToSpaceString(baseSpace + estimate.peakSpace, spaces[5]) ;
+      printf("%lu\t%lu\t%d\t%s\t%s\t%s\t%s\t%s\t%s\t%.1f\n", threadCnts[i], 
+          estimate.saBlockSize, estimate.saDcv, spaces[0], spaces[1], spaces[2], spaces[3], spaces[4], spaces[5],
+          estimate.sortTime * sortFactor + estimate.linearTime * linearFactor) ;
+      indexSize = estimate.indexSize ;
+    }
+    
+    if (_bwtFormat == BWT_FORMAT_OCC) // the occurrence table takes 64 bytes per 128 characters
+      indexSize = indexSize - DIV_CEIL(n * 2, WORDBITS) * WORDBYTES * 5 / 4 + DIV_CEIL(n, 128) * 64 ;
+    
+    char indexSizeString[32] ;
+    Utils::BytesToSpaceString(indexSize + _taxonomy.GetSeqCount() * 32, indexSizeString) ;
+    printf("Index size: <= %s\n", indexSizeString) ;
+  }
+
   void Save(const char *outputPrefix)
   {
     char outputFileName[1024] ; 
@@ -18,11 +18,25 @@ char usage[] = "./centrifuger-build [OPTIONS]:\n"
   "\t-o STRING: output prefix [centrifuger]\n"
   "\t-t INT: number of threads [1]\n"
   "\t--build-mem STR: automatic infer bmax and dcv to match memory constraints, can use T,G,M,K to specify the memory size [not used]\n"
+  "\t--build-tmp STR: write BWT and sampled SA to temporary files with prefix STR to reduce the memory of suffix sorting; the whole BWT is loaded back to build the index [not used]\n"
+  "\t--checkpoint-interval INT: save the construction progress to <output>.*.ckpt files every INT minutes [off; 60 with --resume]\n"
+  "\t--resume: continue the construction from the checkpoint of the previous run with the same options\n"
+  "\t--shard-count INT: split the genomes into INT shards by taxonomy subtree, each shard has its own index files and is listed in the manifest file <output>.0.cfr [1]\n"
+  "\t--shard-id INT: only build the INT-th (0-based) shard, so the shards can be built in parallel as separate jobs. -1 for all the shards [-1]\n"
+  "\t--shard-rank STR: genomes under the same taxonomy node of this rank are in the same shard [genus]\n"
+  "\t--append STR: add the genomes to the existing index with prefix STR. The taxonomy files should cover all the genomes [not used]\n"
+  "\t--dry-run: scan the input and report the predicted memory of each phase, index size and time without building the index\n"
+  "\t--dry-run-sample INT: calibrate the --dry-run time estimation by building on the first INT bp [0: no calibration]\n"
+  "\t--dedup FLOAT: skip a sequence if its MinHash containment identity in the indexed sequences of the same species is at least FLOAT, e.g. 0.99 [not used]\n"
+  "\t--pfp: generate the suffix array with prefix-free parsing, faster for highly repetitive references [not used]\n"
   "\t--bmax INT: block size for blockwise suffix array sorting [16777216]\n"
   "\t--dcv INT: difference cover period [4096]\n"
   "\t--offrate INT: SA/offset is sampled every (2^<int>) BWT chars [4]\n"
+  "\t--offrate-by STR: sample SA/offset by BWT row (row), or by text position (text) to finish each locate within 2^offrate LF steps with about 1.25 extra bits per base [row, or the strategy of the --append index]\n"
+  "\t--max-lcp INT: mark whether each BWT row shares INT bases with its previous row, 2 bits per base, for the classification with --lcp-restart. Not supported with --append [0: not marked]\n"
   "\t--ftabchars INT: # of chars consumed in initial lookup (default: 10)\n"
   "\t--rbbwt-b INT: block size for run-block compressed BWT. 0 for auto. 1 for no compression [0]\n"
+  "\t--bwt-format STR: BWT representation: runblock (compressed) or occ (occurrence table, 2-3x larger index but faster classification) [runblock, or the format of the --append index]\n"
   "\t--subset-tax INT: only consider the subset of input genomes under taxonomy node INT [0]\n"
   ""
   ;
@@ -32,9 +46,23 @@ static struct option long_options[] = {
       { "bmax", required_argument, 0, ARGV_BMAX},
 			{ "dcv", required_argument, 0, ARGV_DCV},
       { "build-mem", required_argument, 0, ARGV_BUILD_MEMORY},
+      { "build-tmp", required_argument, 0, ARGV_BUILD_TMP},
+      { "checkpoint-interval", required_argument, 0, ARGV_CHECKPOINT_INTERVAL},
+      { "resume", no_argument, 0, ARGV_RESUME},
+      { "pfp", no_argument, 0, ARGV_PFP},
+      { "dedup", required_argument, 0, ARGV_DEDUP},
+      { "dry-run", no_argument, 0, ARGV_DRY_RUN},
+      { "dry-run-sample", required_argument, 0, ARGV_DRY_RUN_SAMPLE},
+      { "append", required_argument, 0, ARGV_APPEND},
+      { "shard-count", required_argument, 0, ARGV_SHARD_COUNT},
+      { "shard-id", required_argument, 0, ARGV_SHARD_ID},
+      { "shard-rank", required_argument, 0, ARGV_SHARD_RANK},
       { "offrate", required_argument, 0, ARGV_OFFRATE},
+      { "offrate-by", required_argument, 0, ARGV_OFFRATE_BY},
+      { "max-lcp", required_argument, 0, ARGV_MAX_LCP},
       { "ftabchars", required_argument, 0, ARGV_FTABCHARS},
       { "rbbwt-b", required_argument, 0, ARGV_RBBWT_B}, 
+      { "bwt-format", required_argument, 0, ARGV_BWT_FORMAT},
       { "taxonomy-tree", required_argument, 0, ARGV_TAXONOMY_TREE},
       { "conversion-table", required_argument, 0, ARGV_CONVERSION_TABLE},
 			{ "name-table", required_argument, 0, ARGV_NAME_TABLE},
@@ -58,15 +86,23 @@ int main(int argc, char *argv[])
   char *conversionTable = NULL ;
   uint64_t subsetTax = 0 ; 
   size_t buildMemoryConstraint = 0 ;
+  char *appendIndexPrefix = NULL ; // the existing index to add genomes
+  size_t rbbwtBlockSize = 0 ;
+  int bwtFormat = -1 ;
+  bool dryRun = false ;
+  double dedupIdentity = 0 ;
+  size_t dryRunSampleLength = 0 ;
+  int shardCnt = 1 ;
+  int shardId = -1 ;
+  const char *shardRank = "genus" ;
   ReadFiles refGenomeFile ;
   char *fileList = NULL ; // the file corresponds to "-l" option
   int fileListColumnCnt = 0 ;
   bool conversionTableAtFileLevel = false ;
 
-  Builder builder ;
-  
   struct _FMBuilderParam fmBuilderParam ;
   fmBuilderParam.sampleRate = 16 ;
+  fmBuilderParam.checkpointInterval = 0 ; // only with --checkpoint-interval or --resume
 
   while (1)
   {
@@ -137,17 +173,87 @@ int main(int argc, char *argv[])
     {
       buildMemoryConstraint = Utils::SpaceStringToBytes(optarg) ;
     }
+    else if (c == ARGV_BUILD_TMP)
+    {
+      fmBuilderParam.tmpPrefix = strdup(optarg) ;
+    }
+    else if (c == ARGV_CHECKPOINT_INTERVAL)
+    {
+      fmBuilderParam.checkpointInterval = atoi(optarg) * 60 ;
+    }
+    else if (c == ARGV_RESUME)
+    {
+      fmBuilderParam.resume = true ;
+    }
+    else if (c == ARGV_PFP)
+    {
+      fmBuilderParam.pfpWindow = 10 ;
+    }
+    else if (c == ARGV_DEDUP)
+    {
+      dedupIdentity = atof(optarg) ;
+    }
+    else if (c == ARGV_DRY_RUN)
+    {
+      dryRun = true ;
+    }
+    else if (c == ARGV_DRY_RUN_SAMPLE)
+    {
+      dryRun = true ;
+      dryRunSampleLength = Utils::SpaceStringToBytes(optarg) ;
+    }
+    else if (c == ARGV_APPEND)
+    {
+      appendIndexPrefix = strdup(optarg) ;
+    }
+    else if (c == ARGV_SHARD_COUNT)
+    {
+      shardCnt = atoi(optarg) ;
+    }
+    else if (c == ARGV_SHARD_ID)
+    {
+      shardId = atoi(optarg) ;
+    }
+    else if (c == ARGV_SHARD_RANK)
+    {
+      shardRank = optarg ;
+    }
     else if (c == ARGV_OFFRATE)
     {
       fmBuilderParam.sampleRate = (1<<atoi(optarg)) ;
     }
+    else if (c == ARGV_OFFRATE_BY)
+    {
+      if (!strcmp(optarg, "row"))
+        fmBuilderParam.sampleStrategy = FM_SAMPLE_STRATEGY_ROW ;
+      else if (!strcmp(optarg, "text"))
+        fmBuilderParam.sampleStrategy = FM_SAMPLE_STRATEGY_TEXT ;
+      else
+      {
+        fprintf(stderr, "Unknown --offrate-by %s. Should be row or text.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_MAX_LCP)
+    {
+      fmBuilderParam.maxLcp = atoi(optarg) ;
+    }
     else if (c == ARGV_FTABCHARS)
     {
       fmBuilderParam.precomputeWidth = atoi(optarg) ;
     }
     else if (c == ARGV_RBBWT_B)
     {
-      builder.SetRBBWTBlockSize(atoi(optarg)) ;
+      rbbwtBlockSize = atoi(optarg) ;
+    }
+    else if (c == ARGV_BWT_FORMAT)
+    {
+      bwtFormat = BWTSequence::GetFormatFromName(optarg) ;
+      if (bwtFormat < 0)
+      {
+        fprintf(stderr, "Unknown --bwt-format %s. Should be runblock or occ.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
     }
     else if (c == ARGV_SUBSET_TAXONOMY)
     {
@@ -184,13 +290,98 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (dryRun && appendIndexPrefix != NULL)
+  {
+    fprintf(stderr, "--dry-run does not support --append.\n") ;
+    return EXIT_FAILURE ;
+  }
+  
+  if (fmBuilderParam.resume && (dryRun || appendIndexPrefix != NULL))
+  {
+    fprintf(stderr, "--resume does not support --dry-run or --append.\n") ;
+    return EXIT_FAILURE ;
+  }
+  if (fmBuilderParam.resume && fmBuilderParam.checkpointInterval <= 0)
+    fmBuilderParam.checkpointInterval = 3600 ; // keep saving the progress in the resumed run
+  if (fmBuilderParam.maxLcp > 0 && appendIndexPrefix != NULL)
+  {
+    fprintf(stderr, "--max-lcp does not support --append.\n") ;
+    return EXIT_FAILURE ;
+  }
+
+  if (shardCnt > 1)
+  {
+    if (shardId >= shardCnt)
+    {
+      fprintf(stderr, "--shard-id has to be smaller than --shard-count.\n") ;
+      return EXIT_FAILURE ;
+    }
+    if (appendIndexPrefix != NULL)
+    {
+      fprintf(stderr, "--append does not support sharded index.\n") ;
+      return EXIT_FAILURE ;
+    }
+  }
+  else
+  {
+    shardCnt = 1 ;
+    shardId = 0 ;
+  }
+
   const char alphabetList[] = "ACGT" ;
-	
-	Utils::PrintLog("Start to read in the genome files.") ; 
-  builder.Build(refGenomeFile, taxonomyFile, nameTable, 
-      conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel,
-      subsetTax, buildMemoryConstraint, fmBuilderParam, alphabetList) ;
-  builder.Save(outputPrefix) ;
+  
+  // .0.cfr file is the manifest listing the prefix of each shard
+  if (shardCnt > 1 && shardId <= 0 && !dryRun)
+  {
+    char manifestFileName[1024] ;
+    sprintf(manifestFileName, "%s.0.cfr", outputPrefix) ;
+    FILE *fpManifest = fopen(manifestFileName, "w") ;
+    for (i = 0 ; i < shardCnt ; ++i)
+      fprintf(fpManifest, "%s.shard%d\n", outputPrefix, i) ;
+    fclose(fpManifest) ;
+  }
+
+  for (i = (shardId >= 0 ? shardId : 0) ; i < (shardId >= 0 ? shardId + 1 : shardCnt) ; ++i)
+  {
+    Builder builder ;
+    struct _FMBuilderParam shardFmBuilderParam = fmBuilderParam ;
+    builder.SetRBBWTBlockSize(rbbwtBlockSize) ;
+    builder.SetBWTFormat(bwtFormat) ;
+    builder.SetDedup(dedupIdentity) ;
+
+    char shardOutputPrefix[1100] ;
+    if (shardCnt > 1)
+    {
+      builder.SetShard(shardCnt, i, shardRank) ;
+      sprintf(shardOutputPrefix, "%s.shard%d", outputPrefix, i) ;
+      Utils::PrintLog("Start to build shard %d.", i) ;
+    }
+    else
+      strcpy(shardOutputPrefix, outputPrefix) ;
+    if (i > shardId) // building all the shards, read the input again
+      refGenomeFile.Rewind() ;
+    if (!dryRun && appendIndexPrefix == NULL && fmBuilderParam.checkpointInterval > 0)
+      shardFmBuilderParam.checkpointPrefix = shardOutputPrefix ;
+
+    Utils::PrintLog("Start to read in the genome files.") ; 
+    if (dryRun)
+    {
+      builder.DryRun(refGenomeFile, taxonomyFile, nameTable, 
+          conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel,
+          subsetTax, buildMemoryConstraint, shardFmBuilderParam, alphabetList, dryRunSampleLength) ;
+      continue ;
+    }
+    
+    if (appendIndexPrefix == NULL)
+      builder.Build(refGenomeFile, taxonomyFile, nameTable, 
+          conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel,
+          subsetTax, buildMemoryConstraint, shardFmBuilderParam, alphabetList) ;
+    else
+      builder.Append(appendIndexPrefix, refGenomeFile, taxonomyFile, nameTable, 
+          conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel,
+          subsetTax, shardFmBuilderParam, alphabetList) ;
+    builder.Save(shardOutputPrefix) ;
+  }
 
   free(taxonomyFile) ;
   free(nameTable) ;
@@ -198,6 +389,10 @@ int main(int argc, char *argv[])
     free(conversionTable) ;
   if (fileList)	
     free(fileList) ;
+  if (fmBuilderParam.tmpPrefix)
+    free(fmBuilderParam.tmpPrefix) ;
+  if (appendIndexPrefix)
+    free(appendIndexPrefix) ;
 	Utils::PrintLog("Done.") ; 
 
   return 0 ;
@@ -35,6 +35,10 @@ char usage[] = "./centrifuger [OPTIONS] > output.tsv:\n"
   "\t--read-format STR: format for read, barcode and UMI files, e.g. r1:0:-1,r2:0:-1,bc:0:15,um:16:-1 for paired-end files with barcode and UMI\n"
   "\t--min-hitlen INT: minimum length of partial hits [auto]\n"
   "\t--hitk-factor INT: resolve at most <int>*k entries for each hit [40; use 0 for no restriction]\n"
+  "\t--ftabchars INT: build a lookup table of INT-mers at loading to skip more search steps, log2(n)/4*4^INT bytes for each shard of n bp [the index's]\n"
+  "\t--ftab-cache: save the table from --ftabchars to <index prefix>.ftab<INT>.cfr and reuse it in later runs [no cache]\n"
+  "\t--load-offrate INT: keep the SA/offset sampled every (2^<int>) BWT chars at loading, less memory but slower classification. Not for the index built with --offrate-by text [the index's --offrate]\n"
+  "\t--lcp-restart: start the next hit search from the end of the previous hit using the LCP bits in the index (built with --max-lcp), so the hits are overlapping maximal matches [not used]\n"
   "\t--merge-readpair: merge overlapped paired-end reads and trim adapters [no merge]\n"
   "\t--barcode-whitelist STR: path to the barcode whitelist file.\n"
   "\t--barcode-translate STR: path to the barcode translation file.\n"
@@ -48,6 +52,10 @@ static struct option long_options[] = {
   { "min-hitlen", required_argument, 0, ARGV_MIN_HITLEN},
   { "hitk-factor", required_argument, 0, ARGV_MAX_RESULT_PER_HIT_FACTOR},
   { "merge-readpair", no_argument, 0, ARGV_MERGE_READ_PAIR },
+  { "lcp-restart", no_argument, 0, ARGV_LCP_RESTART },
+  { "ftabchars", required_argument, 0, ARGV_FTABCHARS},
+  { "ftab-cache", no_argument, 0, ARGV_FTAB_CACHE },
+  { "load-offrate", required_argument, 0, ARGV_LOAD_OFFRATE},
   { "read-format", required_argument, 0, ARGV_READFORMAT},
   { "barcode", required_argument, 0, ARGV_BARCODE},
   { "UMI", required_argument, 0, ARGV_UMI},
@@ -369,6 +377,22 @@ int main(int argc, char *argv[])
     {
       mergeReadPair = true ;
     }
+    else if (c == ARGV_LCP_RESTART)
+    {
+      classifierParam.lcpRestart = true ;
+    }
+    else if (c == ARGV_FTABCHARS)
+    {
+      classifierParam.extPrecomputeWidth = atoi(optarg) ;
+    }
+    else if (c == ARGV_FTAB_CACHE)
+    {
+      classifierParam.extPrecomputeCache = true ;
+    }
+    else if (c == ARGV_LOAD_OFFRATE)
+    {
+      classifierParam.loadSampleRate = (1<<atoi(optarg)) ;
+    }
     else if (c == ARGV_BARCODE)
     {
       hasBarcode = true ;
@@ -449,6 +473,7 @@ int main(int argc, char *argv[])
   if (threadCnt > 1 && readFormatter.GetSegmentCount(FORMAT_CATEGORY_COUNT) > 0)
     readFormatter.AllocateBuffers(4 * threadCnt) ;
 
+  classifierParam.threadCnt = threadCnt ;
   classifier.Init(idxPrefix, classifierParam) ;
   
   resWriter.SetHasBarcode(hasBarcode) ;
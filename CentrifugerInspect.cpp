@@ -5,7 +5,7 @@
 #include "argvdefs.h"
 #include "Taxonomy.hpp"
 #include "compactds/FMIndex.hpp"
-#include "compactds/Sequence_RunBlock.hpp"
+#include "BWTSequence.hpp"
 
 char usage[] = "./centrifuger-inspect [OPTIONS]:\n"
   "Required:\n"
@@ -125,7 +125,7 @@ int main(int argc, char *argv[])
   else if (inspectItem == ARGV_INSPECT_INDEXSIZE)
   {
     sprintf(buffer, "%s.1.cfr", idxPrefix) ; 
-    FMIndex<Sequence_RunBlock> fm ;
+    FMIndex<BWTSequence, Alphabet_DNA> fm ;
     FILE *fp = fopen(buffer, "r") ;
     fm.Load(fp) ;
     fclose(fp) ;
@@ -6,7 +6,7 @@
 #include "Taxonomy.hpp"
 #include "compactds/FMIndex.hpp"
 #include "compactds/Sequence_Hybrid.hpp"
-#include "compactds/Sequence_RunBlock.hpp"
+#include "BWTSequence.hpp"
 #include "compactds/SimpleVector.hpp"
 
 using namespace compactds ;
@@ -18,11 +18,21 @@ struct _classifierParam
   int maxResult ; // the number of entries in the results    
   int minHitLen ;
   int maxResultPerHitFactor ; // Get the SA/tax id for at most maxREsultPerHitsFactor * maxResult entries for each hit 
+  bool lcpRestart ; // restart the hit search from the LCP-expanded range of the previous hit
+  int extPrecomputeWidth ; // >0: build the lookup table of this width at loading, in place of the index's
+  bool extPrecomputeCache ; // save/load the table above to/from a file next to the index
+  int loadSampleRate ; // >0: keep the sampled SA every this many rows/text positions at loading
+  int threadCnt ; // the threads for loading
   _classifierParam()
   {
     maxResult = 1 ;
     minHitLen = 0 ;
     maxResultPerHitFactor = 40 ;
+    lcpRestart = false ;
+    extPrecomputeWidth = 0 ;
+    extPrecomputeCache = false ;
+    loadSampleRate = 0 ;
+    threadCnt = 1 ;
   }
 } ;
 
@@ -74,7 +84,9 @@ struct _BWTHit
 class Classifier
 {
 private:
-  FMIndex<Sequence_RunBlock> _fm ;
+  FMIndex<BWTSequence, Alphabet_DNA> *_fms ; // one FM index for each shard
+  int _shardCnt ;
+  std::vector< std::vector<size_t> > _shardSeqIdMap ; // map the seq ids in a shard to _taxonomy. Empty for identity. 
   Taxonomy _taxonomy ;
   std::map<size_t, size_t> _seqLength ;
   _classifierParam _param ;
@@ -98,9 +110,11 @@ private:
   void InferMinHitLen()
   {
     int mhl = 23 ; // Though centrifuge uses 22, but internally it filter length <= 22, so in our implementation, it should corresponds to 23.
-    int alphabetSize = _fm.GetAlphabetSize() ; 
+    int alphabetSize = _fms[0].GetAlphabetSize() ; 
     uint64_t kmerspace = Utils::PowerInt(alphabetSize, mhl)/ 2 ;
-    uint64_t n = _fm.GetSize() ;
+    uint64_t n = 0 ;
+    for (int i = 0 ; i < _shardCnt ; ++i)
+      n += _fms[i].GetSize() ;
     for ( ; mhl <= 32 ; ++mhl)
     {
       if (kmerspace >= 100 * n)
@@ -110,6 +124,50 @@ private:
     _param.minHitLen = mhl ;
   }
 
+  // Build the wider lookup table of the search after loading the FM index of a shard,
+  //   or load it from the cache file from a previous run.
+  void InitExtendedPrecomputedRange(FMIndex<BWTSequence, Alphabet_DNA> &fm, const char *prefix, 
+      const struct _classifierParam &param)
+  {
+    FILE *fp ;
+    const int width = param.extPrecomputeWidth ;
+    size_t space = fm.GetExtendedPrecomputedRangeSpace(width) ;
+    if (space == 0)
+    {
+      Utils::PrintLog("WARNING: --ftabchars %d is not larger than the index's, so the index's lookup table is used.", width) ;
+      return ;
+    }
+    
+    char *cacheName = (char *)malloc(sizeof(char) * (strlen(prefix) + 32)) ;
+    sprintf(cacheName, "%s.ftab%d.cfr", prefix, width) ;
+    bool loaded = false ;
+    if (param.extPrecomputeCache && (fp = fopen(cacheName, "r")) != NULL)
+    {
+      loaded = fm.LoadExtendedPrecomputedRange(fp, width) ;
+      fclose(fp) ;
+      if (loaded)
+        Utils::PrintLog("Loaded the lookup table of %d-mers from %s.", width, cacheName) ;
+    }
+
+    if (!loaded)
+    {
+      Utils::PrintLog("Build the lookup table of %d-mers (%llu bytes).", width, (unsigned long long)space) ;
+      fm.InitExtendedPrecomputedRange(width, param.threadCnt) ;
+      if (param.extPrecomputeCache)
+      {
+        fp = fopen(cacheName, "w") ;
+        if (fp == NULL)
+          Utils::PrintLog("WARNING: failed to write the lookup table to %s.", cacheName) ;
+        else
+        {
+          fm.SaveExtendedPrecomputedRange(fp) ;
+          fclose(fp) ;
+        }
+      }
+    }
+    free(cacheName) ;
+  }
+
   //l: hit length
   size_t CalculateHitScore(int l)
   {
@@ -138,23 +196,42 @@ private:
   }
 
   //@return: the number of hits 
-  size_t GetHitsFromRead(char *r, size_t len, SimpleVector<struct _BWTHit> &hits) 
+  size_t GetHitsFromRead(FMIndex<BWTSequence, Alphabet_DNA> &fm, char *r, size_t len, SimpleVector<struct _BWTHit> &hits) 
   {
     size_t sp = 0, ep = 0 ;
     int l = 0 ;
     int remaining = len ;
+    // With LCP restart, the next search keeps the last restartLen matched bases
+    //   of the previous hit, so the hits are maximal matches that can overlap.
+    const int maxLcp = _param.lcpRestart ? fm.GetMaxLcp() : 0 ;
+    int restartLen = 0 ;
     
     while (remaining >= _param.minHitLen)
     {
-      l = _fm.BackwardSearch(r, remaining, sp, ep) ;
-      if (l >= _param.minHitLen && sp <= ep)
+      if (restartLen > 0)
+        l = fm.BackwardSearchFrom(r, remaining, restartLen, sp, ep) ;
+      else
+        l = fm.BackwardSearch(r, remaining, sp, ep) ;
+      if (l >= _param.minHitLen && sp <= ep && l > restartLen)
       {
         struct _BWTHit nh(sp, ep, l, len - remaining, 0) ;
         hits.PushBack(nh) ;
       }
 
-      // +1 is to skip the base
-      remaining -= (l + 1) ;
+      if (maxLcp > 0 && l > maxLcp && l < remaining && sp <= ep)
+      {
+        // The range of the first maxLcp bases of the hit comes from the 
+        //   LCP bits instead of the search from scratch.
+        fm.ExpandRangeByLcp(sp, ep) ;
+        remaining -= (l - maxLcp) ;
+        restartLen = maxLcp ;
+      }
+      else
+      {
+        // +1 is to skip the base
+        remaining -= (l + 1) ;
+        restartLen = 0 ;
+      }
     }
     return hits.Size() ;
   }
@@ -167,7 +244,7 @@ private:
   //   Forward search probably would be ~20bp random hits + ~80 real hit
   //   Reverse-complement search: will be 90bp real hit
   //   As a result, we will lose the forward candidate
-  void AdjustHitBoundaryFromStrandHits(char *r, char *rc, int len, 
+  void AdjustHitBoundaryFromStrandHits(FMIndex<BWTSequence, Alphabet_DNA> &fm, char *r, char *rc, int len, 
       SimpleVector<struct _BWTHit> *strandHits)
   {
     int i, j, k ;
@@ -202,7 +279,7 @@ private:
           break ;
         if (rcRight > right)
         {
-          l = _fm.BackwardSearch(r, rcRight + 1, sp, ep) ;
+          l = fm.BackwardSearch(r, rcRight + 1, sp, ep) ;
           if (rcRight - l + 1 == left && sp <= ep)
           {
             struct _BWTHit nh(sp, ep, l, len - rcRight - 1, 1) ;
@@ -213,7 +290,7 @@ private:
 
         if (left < rcLeft)
         {
-          l = _fm.BackwardSearch(rc, len - left, sp, ep) ;
+          l = fm.BackwardSearch(rc, len - left, sp, ep) ;
           if (left + l - 1 == rcRight && sp <= ep)
           {
             struct _BWTHit nh(sp, ep, l, left, -1) ;
@@ -268,7 +345,7 @@ private:
   }
 
   // It seems the performance for not synchronize mate pair direction works better
-  size_t SearchForwardAndReverseWithWeakMateDirection(char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
+  size_t SearchForwardAndReverseWithWeakMateDirection(FMIndex<BWTSequence, Alphabet_DNA> &fm, char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
   {
     int i, k, ridx ;
     
@@ -292,9 +369,9 @@ private:
       strandHits[0].Clear() ; 
       strandHits[1].Clear() ;
       //Notice that GetHitsFromRead will not clear the hits
-      GetHitsFromRead(r, rlen, strandHits[1]) ;
-      GetHitsFromRead(rc, rlen, strandHits[0]) ;
-      AdjustHitBoundaryFromStrandHits(r, rc, rlen, strandHits) ;
+      GetHitsFromRead(fm, r, rlen, strandHits[1]) ;
+      GetHitsFromRead(fm, rc, rlen, strandHits[0]) ;
+      AdjustHitBoundaryFromStrandHits(fm, r, rc, rlen, strandHits) ;
       
       size_t strandScore[2] ;
       //int strandLongestHit[2] = {0, 0} ;
@@ -328,7 +405,7 @@ private:
   }
 
   //@return: the size of the hits after selecting the strand 
-  size_t SearchForwardAndReverse(char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
+  size_t SearchForwardAndReverse(FMIndex<BWTSequence, Alphabet_DNA> &fm, char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
   {
     int i, k ;
     char *rcR1 = NULL ;
@@ -339,9 +416,9 @@ private:
     
     SimpleVector<struct _BWTHit> strandHits[2] ; // 0: minus strand, 1: postive strand
     
-    GetHitsFromRead(r1, r1len, strandHits[1]) ;
-    GetHitsFromRead(rcR1, r1len, strandHits[0]) ;
-    AdjustHitBoundaryFromStrandHits(r1, rcR1, r1len, strandHits) ;
+    GetHitsFromRead(fm, r1, r1len, strandHits[1]) ;
+    GetHitsFromRead(fm, rcR1, r1len, strandHits[0]) ;
+    AdjustHitBoundaryFromStrandHits(fm, r1, rcR1, r1len, strandHits) ;
     if (r2)
     {
       rcR2 = strdup(r2) ;
@@ -349,9 +426,9 @@ private:
       ReverseComplement(rcR2, r2len) ;
       SimpleVector<struct _BWTHit> r2StrandHits[2] ; // 0: minus strand, 1: postive strand
       
-      GetHitsFromRead(r2, r2len, r2StrandHits[1]) ;
-      GetHitsFromRead(rcR2, r2len, r2StrandHits[0]) ;
-      AdjustHitBoundaryFromStrandHits(r2, rcR2, r2len, r2StrandHits) ;
+      GetHitsFromRead(fm, r2, r2len, r2StrandHits[1]) ;
+      GetHitsFromRead(fm, rcR2, r2len, r2StrandHits[0]) ;
+      AdjustHitBoundaryFromStrandHits(fm, r2, rcR2, r2len, r2StrandHits) ;
       for (i = 0 ; i <= 1 ; ++i)
         strandHits[i].PushBack(r2StrandHits[1 - i]) ;
     }
@@ -385,12 +462,39 @@ private:
     return hits.Size() ;
   }
 
-  size_t GetClassificationFromHits(const SimpleVector<struct _BWTHit> &hits, struct _classifierResult &result)
+  // Add the scores of the hits to the record of each seq id
+  // seqIdMap: map the seq id from fm to _taxonomy, empty for identity
+  // shardHits: the hits of the read in each shard, and the hits to collect are shardHits[shard]. 
+  //   A hit is unique only if no other shard has a hit on the same part of the read.
+  void CollectSeqHitRecords(FMIndex<BWTSequence, Alphabet_DNA> &fm, const std::vector<size_t> &seqIdMap, 
+      const std::vector< SimpleVector<struct _BWTHit> > &shardHits, int shard, 
+      std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord)
   {
     int i, k ;
     size_t j ;
+    const SimpleVector<struct _BWTHit> &hits = shardHits[shard] ;
     int hitCnt = hits.Size() ;
-    std::map<size_t, struct _seqHitRecord > seqIdStrandHitRecord[2] ;
+    
+    std::vector<bool> uniqHit(hitCnt) ;
+    for (i = 0 ; i < hitCnt ; ++i)
+    {
+      uniqHit[i] = (hits[i].ep == hits[i].sp) ;
+      for (j = 0 ; j < shardHits.size() && uniqHit[i] ; ++j)
+      {
+        if ((int)j == shard)
+          continue ;
+        int otherHitCnt = shardHits[j].Size() ;
+        for (k = 0 ; k < otherHitCnt ; ++k)
+        {
+          const struct _BWTHit &h = shardHits[j][k] ;
+          if (h.strand == hits[i].strand && h.offset == hits[i].offset && h.l == hits[i].l)
+          {
+            uniqHit[i] = false ;
+            break ;
+          }
+        }
+      }
+    }
     
     struct _seqHitRecord prevUniqHitRecord ; // record information from previous unique hit 
     prevUniqHitRecord.seqId = 0 ;
@@ -427,7 +531,7 @@ private:
         for (j = hits[i].sp ; j <= hits[i].ep ; ++j)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("%lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) )) ;
 #endif
@@ -445,7 +549,7 @@ private:
         for (j = hits[i].sp ; j <= hits[i].ep ; j += step)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("%lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) )) ;
 #endif
@@ -456,7 +560,7 @@ private:
         for (j = hits[i].ep ; j >= hits[i].sp && j <= hits[i].ep ; j -= step)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("%lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) )) ;
 #endif
@@ -472,8 +576,9 @@ private:
           iter != localSeqIdHit.end() ; ++iter)
       {
         size_t seqId = iter->first ;
-        if (!mixStrand && i > 0 && hits[i].ep == hits[i].sp && 
-            hits[i - 1].ep == hits[i - 1].sp && 
+        if (seqIdMap.size() > 0)
+          seqId = seqIdMap[seqId] ;
+        if (!mixStrand && i > 0 && uniqHit[i] && uniqHit[i - 1] && 
             hits[i - 1].strand == hits[i].strand &&
             hits[i - 1].offset + hits[i - 1].l + 1 == hits[i].offset && // the other strand adjustication may cause overlaps of the hit regions. Make sure the two hits only separate by 1 base.
             seqId == prevUniqHitRecord.seqId) // Merge adjacent unique hits
@@ -499,7 +604,7 @@ private:
             seqIdStrandHitRecord[k][seqId].hitLength += hits[i].l ;
           }
         
-          if (hits[i].ep == hits[i].sp)
+          if (uniqHit[i])
           {
             prevUniqHitRecord.seqId = seqId ;
             prevUniqHitRecord.score = score ;
@@ -508,7 +613,13 @@ private:
         }
       }
     }
+  }
 
+  // Select the best score across the records and reduce the corresponding taxonomy ids
+  size_t GetClassificationFromSeqHitRecords(std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord, 
+      struct _classifierResult &result)
+  {
+    int i, k ;
     // Select the best score
     size_t bestScore = 0 ;
     size_t secondBestScore = 0 ;
@@ -601,43 +712,131 @@ public:
     _compChar['C'] = 'G' ;
     _compChar['G'] = 'C' ;
     _compChar['T'] = 'A' ;
+    
+    _fms = NULL ;
+    _shardCnt = 0 ;
   }
 
   ~Classifier() {Free() ;}
 
   void Free()
   {
-    _fm.Free() ;
+    if (_fms != NULL)
+    {
+      delete[] _fms ;
+      _fms = NULL ;
+    }
+    _shardCnt = 0 ;
+    _shardSeqIdMap.clear() ;
     _taxonomy.Free() ;
     _seqLength.clear() ;
   }
 
+  // idxPrefix: the index prefix. If the manifest file idxPrefix.0.cfr exists, 
+  //   each line in it is the prefix of a shard and all the shards are loaded. 
   void Init(char *idxPrefix, struct _classifierParam param)
   {
+    int i ;
+    size_t j ;
     FILE *fp ;
     char *nameBuffer = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 17))  ;  
  
-    // .1.cfr file for FM index
-    sprintf(nameBuffer, "%s.1.cfr", idxPrefix) ;
+    // .0.cfr file is the shard manifest
+    std::vector<std::string> shardPrefixes ;
+    sprintf(nameBuffer, "%s.0.cfr", idxPrefix) ;
     fp = fopen(nameBuffer, "r") ;
-    _fm.Load(fp) ;
-    fclose(fp) ;
-
-    // .2.cfr file is for taxonomy structure
-    sprintf(nameBuffer, "%s.2.cfr", idxPrefix) ;
-    fp = fopen(nameBuffer, "r") ;
-    _taxonomy.Load(fp) ;
-    fclose(fp) ;
+    if (fp != NULL)
+    {
+      char lineBuffer[1026] ;
+      char shardPrefix[1024] ;
+      while (fgets(lineBuffer, sizeof(lineBuffer), fp) != NULL)
+      {
+        size_t len = strlen(lineBuffer) ;
+        if (len >= 1024 && lineBuffer[len - 1] != '\n')
+        {
+          fprintf(stderr, "ERROR: shard prefix in manifest %s is longer than 1023 characters.\n", nameBuffer) ;
+          exit(EXIT_FAILURE) ;
+        }
+        if (sscanf(lineBuffer, "%1023s", shardPrefix) == 1)
+          shardPrefixes.push_back(shardPrefix) ;
+      }
+      fclose(fp) ;
+      if (shardPrefixes.size() == 0)
+      {
+        fprintf(stderr, "ERROR: manifest %s does not list any shard.\n", nameBuffer) ;
+        exit(EXIT_FAILURE) ;
+      }
+      Utils::PrintLog("Found %d shards in the index.", (int)shardPrefixes.size()) ;
+    }
+    else
+      shardPrefixes.push_back(idxPrefix) ;
+    free(nameBuffer) ;
 
-    // .3.cfr file is for sequence length
-    sprintf(nameBuffer, "%s.3.cfr", idxPrefix) ;
-    fp = fopen(nameBuffer, "r") ;
-    size_t tmp[2] ;
-    while (fread(tmp, sizeof(tmp[0]), 2, fp))
+    _shardCnt = shardPrefixes.size() ;
+    _fms = new FMIndex<BWTSequence, Alphabet_DNA>[_shardCnt] ;
+    _shardSeqIdMap.resize(_shardCnt) ;
+    for (i = 0 ; i < _shardCnt ; ++i)
     {
-      _seqLength[tmp[0]] = tmp[1] ;
+      nameBuffer = (char *)malloc(sizeof(char) * (shardPrefixes[i].length() + 17)) ;
+      
+      // .1.cfr file for FM index
+      sprintf(nameBuffer, "%s.1.cfr", shardPrefixes[i].c_str()) ;
+      fp = fopen(nameBuffer, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open index file %s.\n", nameBuffer) ;
+        exit(EXIT_FAILURE) ;
+      }
+      _fms[i].Load(fp, param.loadSampleRate) ;
+      fclose(fp) ;
+      if (param.extPrecomputeWidth > 0)
+        InitExtendedPrecomputedRange(_fms[i], shardPrefixes[i].c_str(), param) ;
+
+      // .2.cfr file is for taxonomy structure
+      // The shards share the taxonomy tree, but the extra sequences could differ, 
+      //   so we map the seq ids of other shards to the first one by names.
+      sprintf(nameBuffer, "%s.2.cfr", shardPrefixes[i].c_str()) ;
+      fp = fopen(nameBuffer, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open index file %s.\n", nameBuffer) ;
+        exit(EXIT_FAILURE) ;
+      }
+      if (i == 0)
+        _taxonomy.Load(fp) ;
+      else
+      {
+        Taxonomy shardTaxonomy ;
+        shardTaxonomy.Load(fp) ;
+        size_t seqCnt = shardTaxonomy.GetAllSeqCount() ;
+        _shardSeqIdMap[i].resize(seqCnt) ;
+        for (j = 0 ; j < seqCnt ; ++j)
+        {
+          std::string seqName = shardTaxonomy.SeqIdToName(j) ;
+          size_t seqId = _taxonomy.SeqNameToId(seqName) ;
+          if (seqId >= _taxonomy.GetAllSeqCount())
+            seqId = _taxonomy.AddExtraSeqName((char *)seqName.c_str()) ;
+          _shardSeqIdMap[i][j] = seqId ;
+        }
+      }
+      fclose(fp) ;
+
+      // .3.cfr file is for sequence length
+      sprintf(nameBuffer, "%s.3.cfr", shardPrefixes[i].c_str()) ;
+      fp = fopen(nameBuffer, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open index file %s.\n", nameBuffer) ;
+        exit(EXIT_FAILURE) ;
+      }
+      size_t tmp[2] ;
+      while (fread(tmp, sizeof(tmp[0]), 2, fp))
+      {
+        _seqLength[ i == 0 ? tmp[0] : _shardSeqIdMap[i][tmp[0]] ] = tmp[1] ;
+      }
+      fclose(fp) ;
+      free(nameBuffer) ;
     }
-    fclose(fp) ;
     
     Utils::PrintLog("Finishes loading index.") ;
     
@@ -647,19 +846,25 @@ public:
       InferMinHitLen() ;
       Utils::PrintLog("Inferred --min-hitlen: %d", _param.minHitLen) ;
     }
-
-    free(nameBuffer) ;
+    if (_param.lcpRestart && _fms[0].GetMaxLcp() == 0)
+      Utils::PrintLog("WARNING: the index has no LCP bits (built without --max-lcp), so --lcp-restart is not used.") ;
   }
 
   // Main function to return the classification results 
+  // Each shard is searched separately, and the scores for the sequences 
+  //   from all the shards are merged before selecting the best one.
   void Query(char *r1, char *r2, struct _classifierResult &result)
   {
+    int i ;
     result.Clear() ;
 
-    SimpleVector<struct _BWTHit> hits ;
-    
-    SearchForwardAndReverse(r1, r2, hits) ;
-    GetClassificationFromHits(hits, result) ;
+    std::map<size_t, struct _seqHitRecord> seqIdStrandHitRecord[2] ;
+    std::vector< SimpleVector<struct _BWTHit> > shardHits(_shardCnt) ;
+    for (i = 0 ; i < _shardCnt ; ++i)
+      SearchForwardAndReverse(_fms[i], r1, r2, shardHits[i]) ;
+    for (i = 0 ; i < _shardCnt ; ++i)
+      CollectSeqHitRecords(_fms[i], _shardSeqIdMap[i], shardHits, i, seqIdStrandHitRecord) ;
+    GetClassificationFromSeqHitRecords(seqIdStrandHitRecord, result) ;
     result.queryLength = strlen(r1) ;
     if (r2)
       result.queryLength += strlen(r2) ;
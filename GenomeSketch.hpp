@@ -0,0 +1,200 @@
+#ifndef _MOURISL_GENOMESKETCH_HEADER
+#define _MOURISL_GENOMESKETCH_HEADER
+
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+#include <set>
+
+// The bottom-s MinHash sketch of the canonical k-mers in a sequence.
+// Used to estimate the identity between two genomes as in Mash.
+class GenomeSketch
+{
+private:
+  int _k ;
+  int _sketchSize ;
+  std::vector<uint64_t> _hashes ; // the smallest _sketchSize distinct hash values in increasing order
+  uint64_t _hashBound ; // _hashes has all the hash values of the k-mers up to this bound
+
+  // The finalizer of MurmurHash3
+  static uint64_t Hash(uint64_t key)
+  {
+    key ^= key >> 33 ;
+    key *= 0xff51afd7ed558ccdull ;
+    key ^= key >> 33 ;
+    key *= 0xc4ceb9fe1a85ec53ull ;
+    key ^= key >> 33 ;
+    return key ;
+  }
+
+  static int NucToNum(char c)
+  {
+    switch (c)
+    {
+      case 'A': case 'a': return 0 ;
+      case 'C': case 'c': return 1 ;
+      case 'G': case 'g': return 2 ;
+      case 'T': case 't': return 3 ;
+      default: return -1 ;
+    }
+  }
+public:
+  GenomeSketch()
+  {
+    _k = 21 ;
+    _sketchSize = 10000 ;
+    _hashBound = ~0ull ;
+  }
+
+  ~GenomeSketch() {}
+
+  void SetParameters(int k, int sketchSize)
+  {
+    _k = k ;
+    _sketchSize = sketchSize ;
+  }
+
+  void Init(const char *seq)
+  {
+    int i ;
+    const uint64_t mask = (_k < 32) ? ((1ull << (2 * _k)) - 1) : ~0ull ;
+    uint64_t kmer = 0 ;
+    uint64_t rcKmer = 0 ; // the reverse complement of kmer
+    int kmerLen = 0 ;
+    std::set<uint64_t> bottom ;
+
+    _hashes.clear() ;
+    for (i = 0 ; seq[i] ; ++i)
+    {
+      int c = NucToNum(seq[i]) ;
+      if (c == -1)
+      {
+        kmerLen = 0 ;
+        continue ;
+      }
+      kmer = ((kmer << 2) | c) & mask ;
+      rcKmer = (rcKmer >> 2) | ((uint64_t)(3 - c) << (2 * (_k - 1))) ;
+      if (kmerLen < _k)
+        ++kmerLen ;
+      if (kmerLen < _k)
+        continue ;
+
+      uint64_t h = Hash(kmer < rcKmer ? kmer : rcKmer) ;
+      if ((int)bottom.size() < _sketchSize)
+        bottom.insert(h) ;
+      else if (h < *bottom.rbegin())
+      {
+        if (bottom.insert(h).second)
+          bottom.erase(--bottom.end()) ;
+      }
+    }
+    _hashes.assign(bottom.begin(), bottom.end()) ;
+    _hashBound = ((int)_hashes.size() >= _sketchSize) ? _hashes.back() : ~0ull ;
+  }
+
+  size_t GetSize() const
+  {
+    return _hashes.size() ;
+  }
+
+  // Add the k-mers of b, so this becomes the bottom sketch of the union.
+  // The union is exact only up to the smaller hash bound of the two.
+  void Merge(const GenomeSketch &b)
+  {
+    std::vector<uint64_t> merged ;
+    size_t i = 0, j = 0 ;
+    uint64_t bound = (_hashBound < b._hashBound) ? _hashBound : b._hashBound ;
+    while ((int)merged.size() < _sketchSize && (i < _hashes.size() || j < b._hashes.size()))
+    {
+      if (j >= b._hashes.size() || (i < _hashes.size() && _hashes[i] < b._hashes[j]))
+        merged.push_back(_hashes[i++]) ;
+      else
+      {
+        if (i < _hashes.size() && _hashes[i] == b._hashes[j])
+          ++i ;
+        merged.push_back(b._hashes[j++]) ;
+      }
+      if (merged.back() > bound)
+      {
+        merged.pop_back() ;
+        break ;
+      }
+    }
+    _hashes.swap(merged) ;
+    _hashBound = ((int)_hashes.size() >= _sketchSize) ? _hashes.back() : bound ;
+  }
+
+  // Estimate the Jaccard index from the bottom sketch of the union
+  double Jaccard(const GenomeSketch &b) const
+  {
+    size_t i = 0, j = 0 ;
+    int unionCnt = 0 ;
+    int sharedCnt = 0 ;
+    while (unionCnt < _sketchSize && i < _hashes.size() && j < b._hashes.size())
+    {
+      if (_hashes[i] == b._hashes[j])
+      {
+        ++sharedCnt ;
+        ++i ;
+        ++j ;
+      }
+      else if (_hashes[i] < b._hashes[j])
+        ++i ;
+      else
+        ++j ;
+      ++unionCnt ;
+    }
+    // The remaining hashes in the longer sketch
+    size_t rest = (_hashes.size() - i) + (b._hashes.size() - j) ;
+    if (unionCnt + rest > (size_t)_sketchSize)
+      unionCnt = _sketchSize ;
+    else
+      unionCnt += rest ;
+    if (unionCnt == 0)
+      return 0 ;
+    return (double)sharedCnt / unionCnt ;
+  }
+
+  // 1 - Mash distance
+  double Identity(const GenomeSketch &b) const
+  {
+    double jaccard = Jaccard(b) ;
+    if (jaccard <= 0)
+      return 0 ;
+    return 1 + log(2 * jaccard / (1 + jaccard)) / _k ;
+  }
+
+  // Estimate the fraction of the k-mers of this sequence that are also in b, |A∩B|/|A|.
+  // Only the hashes up to b's hash bound are comparable.
+  double Containment(const GenomeSketch &b) const
+  {
+    size_t i, j = 0 ;
+    int comparableCnt = 0 ;
+    int sharedCnt = 0 ;
+    for (i = 0 ; i < _hashes.size() ; ++i)
+    {
+      if (_hashes[i] > b._hashBound)
+        break ;
+      ++comparableCnt ;
+      while (j < b._hashes.size() && b._hashes[j] < _hashes[i])
+        ++j ;
+      if (j < b._hashes.size() && b._hashes[j] == _hashes[i])
+        ++sharedCnt ;
+    }
+    if (comparableCnt == 0)
+      return 0 ;
+    return (double)sharedCnt / comparableCnt ;
+  }
+
+  // The identity of this sequence to its best match in b, as in Mash screen
+  double ContainmentIdentity(const GenomeSketch &b) const
+  {
+    double containment = Containment(b) ;
+    if (containment <= 0)
+      return 0 ;
+    return pow(containment, 1.0 / _k) ;
+  }
+} ;
+
+#endif
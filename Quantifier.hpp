@@ -355,22 +355,87 @@ public:
   // format: 0: centrifuger. Future: 1-kraken, 2-kmcp/ganon
   void Init(char *indexPrefix)
   {
-    char fileName[1024] ;
+    size_t i, j ;
+    char fileName[1100] ;
 
-    // read in the index
-    _taxonomy.Free() ;
-    sprintf(fileName, "%s.2.cfr", indexPrefix) ;
+    if (strlen(indexPrefix) > 1023)
+    {
+      fprintf(stderr, "ERROR: index prefix %s is too long.\n", indexPrefix) ;
+      exit(EXIT_FAILURE) ;
+    }
+
+    // The manifest file .0.cfr lists the shards for sharded index, one prefix per line 
+    std::vector<std::string> shardPrefixes ;
+    sprintf(fileName, "%s.0.cfr", indexPrefix) ;
     FILE *fp = fopen(fileName, "r") ;
-    _taxonomy.Load(fp) ;
-    fclose(fp) ;
+    if (fp != NULL)
+    {
+      char lineBuffer[1026] ;
+      char shardPrefix[1024] ;
+      while (fgets(lineBuffer, sizeof(lineBuffer), fp) != NULL)
+      {
+        size_t len = strlen(lineBuffer) ;
+        if (len >= 1024 && lineBuffer[len - 1] != '\n')
+        {
+          fprintf(stderr, "ERROR: shard prefix in manifest %s is longer than 1023 characters.\n", fileName) ;
+          exit(EXIT_FAILURE) ;
+        }
+        if (sscanf(lineBuffer, "%1023s", shardPrefix) == 1)
+          shardPrefixes.push_back(shardPrefix) ;
+      }
+      fclose(fp) ;
+      if (shardPrefixes.size() == 0)
+      {
+        fprintf(stderr, "ERROR: manifest %s does not list any shard.\n", fileName) ;
+        exit(EXIT_FAILURE) ;
+      }
+    }
+    else
+      shardPrefixes.push_back(indexPrefix) ;
 
+    // read in the index
+    _taxonomy.Free() ;
     _seqLength.clear() ;
-    sprintf(fileName, "%s.3.cfr", indexPrefix) ;
-    fp = fopen(fileName, "r") ;
-    size_t tmp[2] ;
-    while (fread(tmp, sizeof(tmp[0]), 2, fp))
-      _seqLength[tmp[0]] = tmp[1] ;
-    fclose(fp) ;
+    for (i = 0 ; i < shardPrefixes.size() ; ++i)
+    {
+      // Map the seq ids in other shards to the first shard by names
+      std::vector<size_t> seqIdMap ;
+      sprintf(fileName, "%s.2.cfr", shardPrefixes[i].c_str()) ;
+      fp = fopen(fileName, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open %s.\n", fileName) ;
+        exit(EXIT_FAILURE) ;
+      }
+      if (i == 0)
+        _taxonomy.Load(fp) ;
+      else
+      {
+        Taxonomy shardTaxonomy ;
+        shardTaxonomy.Load(fp) ;
+        seqIdMap.resize(shardTaxonomy.GetAllSeqCount()) ;
+        for (j = 0 ; j < seqIdMap.size() ; ++j)
+        {
+          std::string seqName = shardTaxonomy.SeqIdToName(j) ;
+          seqIdMap[j] = _taxonomy.SeqNameToId(seqName) ;
+          if (seqIdMap[j] >= _taxonomy.GetAllSeqCount())
+            seqIdMap[j] = _taxonomy.AddExtraSeqName((char *)seqName.c_str()) ;
+        }
+      }
+      fclose(fp) ;
+
+      sprintf(fileName, "%s.3.cfr", shardPrefixes[i].c_str()) ;
+      fp = fopen(fileName, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open %s.\n", fileName) ;
+        exit(EXIT_FAILURE) ;
+      }
+      size_t tmp[2] ;
+      while (fread(tmp, sizeof(tmp[0]), 2, fp))
+        _seqLength[ i == 0 ? tmp[0] : seqIdMap[tmp[0]] ] = tmp[1] ;
+      fclose(fp) ;
+    }
   
     _abund = (double *)calloc(_taxonomy.GetNodeCount() + 1, sizeof(_abund[0])) ;
     _readCount = (double *)calloc(_taxonomy.GetNodeCount() + 1, sizeof(_readCount)) ;
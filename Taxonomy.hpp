@@ -581,6 +581,24 @@ public:
     return _nodeCnt;
   }
 
+  // Return the closest ancestor of ctid (itself included) with the rank, _nodeCnt if none.
+  // Unlike GetTaxIdAtParentRank, it walks to the root instead of stopping at a larger rank id,
+  //   because the rank ids do not follow the tree levels, e.g. a strain under a subspecies.
+  size_t GetTaxIdAtAncestorRank(size_t ctid, uint8_t rank)
+  {
+    size_t i ;
+    for (i = 0 ; i < _nodeCnt ; ++i) // bound the walk in case the parents form a cycle
+    {
+      const TaxonomyNode &node = _taxonomyTree[ctid] ;
+      if (node.rank == rank)
+        return ctid ;
+      if (node.parentTid == ctid)
+        break ;
+      ctid = node.parentTid ;
+    }
+    return _nodeCnt ;
+  }
+
   size_t GetNodeCount()
   {
     return _nodeCnt ;
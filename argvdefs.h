@@ -6,9 +6,23 @@ enum
   ARGV_BMAX = 10000,
   ARGV_DCV,
   ARGV_BUILD_MEMORY,
+  ARGV_BUILD_TMP,
+  ARGV_CHECKPOINT_INTERVAL,
+  ARGV_RESUME,
+  ARGV_PFP,
+  ARGV_DEDUP,
+  ARGV_DRY_RUN,
+  ARGV_DRY_RUN_SAMPLE,
+  ARGV_APPEND,
+  ARGV_SHARD_COUNT,
+  ARGV_SHARD_ID,
+  ARGV_SHARD_RANK,
   ARGV_OFFRATE,
+  ARGV_OFFRATE_BY,
+  ARGV_MAX_LCP,
   ARGV_FTABCHARS,
   ARGV_RBBWT_B,
+  ARGV_BWT_FORMAT,
   ARGV_TAXONOMY_TREE,
   ARGV_CONVERSION_TABLE,
   ARGV_NAME_TABLE,
@@ -17,6 +31,9 @@ enum
   ARGV_MIN_HITLEN,
   ARGV_MAX_RESULT_PER_HIT_FACTOR,
   ARGV_MERGE_READ_PAIR,
+  ARGV_LCP_RESTART,
+  ARGV_FTAB_CACHE,
+  ARGV_LOAD_OFFRATE,
   ARGV_READFORMAT,
   ARGV_BARCODE,
   ARGV_UMI,
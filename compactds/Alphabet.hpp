@@ -220,5 +220,72 @@ public:
     }
   }
 } ;
+
+// The nucleotide alphabet ACGT with the plain 2-bit code (A=0, C=1, G=2, T=3),
+//   the same as Alphabet::InitFromList("ACGT", 4).
+// The size and code length are compile-time constants, and the coding is by
+//   branch-free table lookups, so the data structures specialized 
+//   with this class can unroll the loops over the code bits.
+class Alphabet_DNA
+{
+private:
+  static const int8_t *CodeTable()
+  {
+    // -1 for the characters not in the alphabet
+    static const int8_t table[256] = {
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, 0, -1, 1, -1, -1, -1, 2, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    } ;
+    return table ;
+  }
+public:
+  static const int SIZE = 4 ;
+  static const int CODE_LEN = 2 ;
+
+  // Assume c is in the alphabet
+  static WORD Encode(ALPHABET c)
+  {
+    return CodeTable()[(uint8_t)c] & 3 ;
+  }
+
+  static ALPHABET Decode(WORD code)
+  {
+    return "ACGT"[code] ;
+  }
+
+  static bool IsIn(ALPHABET c)
+  {
+    return CodeTable()[(uint8_t)c] >= 0 ;
+  }
+
+  // Test whether the runtime alphabet a codes the characters in the same way
+  static bool IsCompatible(const Alphabet &a)
+  {
+    if (a.GetSize() != SIZE)
+      return false ;
+    int i ;
+    for (i = 0 ; i < SIZE ; ++i)
+    {
+      int l = 0 ;
+      if (a.Encode(Decode(i), l) != (WORD)i || l != CODE_LEN)
+        return false ;
+    }
+    return true ;
+  }
+} ;
 }
-#endif 
+#endif
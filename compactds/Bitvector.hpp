@@ -5,16 +5,30 @@
 
 #define BITVECTOR_DEFAULT_SELECT_SPEED 3
 
+#define BITVECTOR_RANK_LAYOUT_SEPARATE 0 // the rank counters are in an array separate from the bits
+#define BITVECTOR_RANK_LAYOUT_INTERLEAVED 1 // the rank counters are next to the bits of each block
+
 // The overall functionality of bitvector
 namespace compactds {
 class Bitvector
 {
 protected:
   size_t _space ;
+  int _threadCnt ; // the number of threads for construction
 public:
-  Bitvector() {_space = 0 ;} 
+  Bitvector() {_space = 0 ; _threadCnt = 1 ;} 
   ~Bitvector() {}
   
+  void SetThreadCnt(int threadCnt)
+  {
+    _threadCnt = threadCnt ;
+  }
+
+  // Only the plain bitvector has more than one layout
+  void SetRankLayout(int layout)
+  {
+  }
+  
   // W is the plain bit vector
   virtual void Init(const WORD *W, const size_t n) = 0 ; 
   virtual void Free() = 0 ;
@@ -56,6 +70,21 @@ public:
       return Rank0(i, inclusive) ;
   }
 
+  // Return the number of type bits in [0..i] and [0..j] through ri and rj, i <= j
+  void RankPair(int type, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    ri = Rank(type, i) ;
+    rj = Rank(type, j) ;
+  }
+
+  // Return the ith bit, and the number of such bits in [0..i] through rank 
+  int AccessAndRank(size_t i, size_t &rank) const
+  {
+    int b = Access(i) ;
+    rank = Rank(b, i) ;
+    return b ;
+  }
+
   virtual void Save(FILE *fp) 
   {
     SAVE_VAR(fp, _space) ;
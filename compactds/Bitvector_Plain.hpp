@@ -20,6 +20,10 @@ private:
   // Variables for _ranking query
   DS_Rank9 _rank ;
   int _rb ; 
+  
+  // The bits and rank counters in the interleaved layout, and _B is released then.
+  DS_Rank9Interleaved _irank ;
+  int _rankLayout ;
 
   // Variables for _selection
   DS_Select _select ;
@@ -28,6 +32,8 @@ private:
   int _selectSpeed ;
   int _selectTypeSupport ;
 
+  // The tag before the interleaved layout in the file, which cannot be _space of the separate layout
+  static const size_t INTERLEAVED_LAYOUT_TAG = 0xffffffffffff1a9eull ;
 public:
   Bitvector_Plain() 
   {
@@ -35,6 +41,7 @@ public:
     _B = NULL ;
     _selectSpeed = BITVECTOR_DEFAULT_SELECT_SPEED ;
     _selectTypeSupport = 3 ;
+    _rankLayout = BITVECTOR_RANK_LAYOUT_SEPARATE ;
   }
   ~Bitvector_Plain() {Free();}
   
@@ -58,6 +65,18 @@ public:
     this->_selectTypeSupport = selectTypeSupport ;
   }
 
+  // The interleaved layout only supports access and rank, 
+  //   so it is used only when the select speed is DS_SELECT_SPEED_NO.
+  void SetRankLayout(int layout)
+  {
+    _rankLayout = layout ;
+  }
+
+  int GetRankLayout() const
+  {
+    return _rankLayout ;
+  }
+
   
   void Malloc(const size_t &n)
   {
@@ -75,6 +94,7 @@ public:
       _B = NULL ;
     }
     _rank.Free() ;
+    _irank.Free() ;
     _select.Free() ;
     _n = 0 ;
   }
@@ -105,9 +125,20 @@ public:
   {
     _space = Utils::BitsToWordBytes(_n) ;
     _rank.Free() ;
+    _irank.Free() ;
     _select.Free() ;
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED && _selectSpeed != DS_SELECT_SPEED_NO)
+      _rankLayout = BITVECTOR_RANK_LAYOUT_SEPARATE ;
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+    {
+      _irank.Init(_B, _n, _threadCnt) ;
+      free(_B) ;
+      _B = NULL ;
+      _space = _irank.GetSpace() - sizeof(_irank) ;
+      return ;
+    }
     //_rank.Init(_rb, _B, _n) ;
-    _rank.Init(_B, _n) ;
+    _rank.Init(_B, _n, _threadCnt) ;
     _space += _rank.GetSpace() - sizeof(_rank) ;
     _select.Init(_sb, _B, _n, _selectSpeed, _selectTypeSupport) ;
     _space += _select.GetSpace() - sizeof(_select) ;
@@ -127,15 +158,65 @@ public:
   // Return the ith bits (0-based)
   int Access(size_t i) const
   {
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+      return _irank.Access(i) ;
     return Utils::BitRead(_B, i) ;
   }
 
   // Return the number of 1s before i
   size_t Rank1(size_t i, int inclusive = 1) const
   {
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+      return _irank.Query(i, _n, inclusive) ;
     return _rank.Query(i, _B, _n, inclusive) ;
   }
 
+  // Same as Bitvector's, but bind Rank1 statically so the rank can be inlined
+  //   into the search loops (e.g., the wavelet tree's).
+  size_t Rank0(size_t i, int inclusive = 1) const
+  {
+    return i + inclusive - Bitvector_Plain::Rank1(i, inclusive) ;
+  }
+
+  size_t Rank(int type, size_t i, int inclusive = 1) const
+  {
+    if (type == 1)
+      return Bitvector_Plain::Rank1(i, inclusive) ;
+    else
+      return Bitvector_Plain::Rank0(i, inclusive) ;
+  }
+
+  // Return the number of type bits in [0..i] and [0..j] through ri and rj, i <= j.
+  void RankPair(int type, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+      _irank.QueryPair(i, j, _n, ri, rj) ;
+    else
+      _rank.QueryPair(i, j, _B, _n, ri, rj) ;
+    if (type == 0)
+    {
+      ri = i + 1 - ri ;
+      rj = j + 1 - rj ;
+    }
+  }
+
+  // Return the ith bit, and the number of such bits in [0..i] through rank.
+  // The bit and the rank come from the same word.
+  int AccessAndRank(size_t i, size_t &rank) const
+  {
+    int b ;
+    size_t r1 ;
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+      b = _irank.AccessAndRank(i, r1) ;
+    else
+    {
+      b = Utils::BitRead(_B, i) ;
+      r1 = _rank.Query(i, _B, _n, 1) ;
+    }
+    rank = b ? r1 : i + 1 - r1 ;
+    return b ;
+  }
+
   // Return the index of th i-th (this i is 1-based, so rank and select are inversible) 1
   size_t Select(size_t i) const
   {
@@ -181,13 +262,20 @@ public:
 
   void Save(FILE *fp)
   {
+    if (_rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+    {
+      size_t tag = INTERLEAVED_LAYOUT_TAG ;
+      SAVE_VAR(fp, tag) ;
+    }
     Bitvector::Save(fp) ;
     SAVE_VAR(fp, _n) ;
     SAVE_VAR(fp, _rb) ;
     SAVE_VAR(fp, _sb) ;
     SAVE_VAR(fp, _selectSpeed) ;
     SAVE_VAR(fp, _selectTypeSupport) ;
-    if (_n > 0)
+    if (_n > 0 && _rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+      _irank.Save(fp) ;
+    else if (_n > 0)
     {
       fwrite(_B, sizeof(*_B), Utils::BitsToWords(_n), fp) ;
       _rank.Save(fp) ;
@@ -198,6 +286,15 @@ public:
   void Load(FILE *fp)
   {
     Free() ;
+    size_t tag = 0 ;
+    LOAD_VAR(fp, tag) ;
+    if (tag == INTERLEAVED_LAYOUT_TAG)
+      _rankLayout = BITVECTOR_RANK_LAYOUT_INTERLEAVED ;
+    else
+    {
+      _rankLayout = BITVECTOR_RANK_LAYOUT_SEPARATE ;
+      fseek(fp, -(long)sizeof(tag), SEEK_CUR) ;
+    }
     Bitvector::Load(fp) ;
     LOAD_VAR(fp, _n) ;
     LOAD_VAR(fp, _rb) ;
@@ -205,7 +302,12 @@ public:
     LOAD_VAR(fp, _selectSpeed) ;
     LOAD_VAR(fp, _selectTypeSupport) ;
     
-    if (_n > 0)
+    if (_n > 0 && _rankLayout == BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+    {
+      _B = NULL ;
+      _irank.Load(fp) ;
+    }
+    else if (_n > 0)
     {
       _B = Utils::MallocByBits(_n) ;
       fread(_B, sizeof(*_B), Utils::BitsToWords(_n), fp) ;
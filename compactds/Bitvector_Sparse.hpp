@@ -194,6 +194,7 @@ public:
   // Return the number of 1s before i
   size_t Rank1(size_t i, int inclusive = 1) const 
   {
+    int bit ;
     if (inclusive == 0)
     {
       if (i == 0)
@@ -201,9 +202,20 @@ public:
       else
         --i ; 
     }
+    return RankAndTest(i, bit) ;
+  }
 
+  // Return the number of 1s in [0..i], and the ith bit through bit.
+  // The bit is tested on the last 1 counted by the rank, so it needs no extra select.
+  size_t RankAndTest(size_t i, int &bit) const
+  {
+    bit = 0 ;
     if (i >= _lastOneIdx) // this should contains the case that i>=n
+    {
+      if (i == _lastOneIdx && _onecnt > 0)
+        bit = 1 ;
       return _onecnt ;
+    }
     
     size_t iH = i >> _lowerBits ;
     size_t iL = i & MASK(_lowerBits) ;
@@ -238,7 +250,8 @@ public:
     {
       // The current r block is empty
       // or the first element in the block is greater than what we search for.
-      // So the number of 1s before current block (l) is the answer
+      // So the number of 1s before current block (l) is the answer, 
+      //   and the last 1 is in an earlier block.
       return l ; 
     }
 
@@ -261,9 +274,21 @@ public:
           r = m - 1 ;
       }
     }
+    // l-1 is the last element index <= the desired one in the current block
+    if (_L.Read(l - 1) == iL)
+      bit = 1 ;
     return l ; // l-1 is the last element index <= the desired one, so l is the number element   
   }
 
+  // Return the ith bit, and the number of such bits in [0..i] through rank.
+  int AccessAndRank(size_t i, size_t &rank) const
+  {
+    int b ;
+    size_t r1 = RankAndTest(i, b) ;
+    rank = b ? r1 : i + 1 - r1 ;
+    return b ;
+  }
+
   // Return the index of th i-th (i is 1-based, so rank and select are inversible) 1
   size_t Select(size_t i) const
   {
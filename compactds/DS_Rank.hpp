@@ -4,6 +4,8 @@
 #include "Utils.hpp"
 #include "FixedSizeElemArray.hpp"
 
+#include <pthread.h>
+
 // The standalone data structe for rank query on a plain bitvector
 // Time complexity: constant time 
 // Extra space complexity (bits): n/b + n/w*log(bw)
@@ -104,7 +106,7 @@ public:
   size_t Query(size_t i, const WORD *B, const size_t &n, int inclusive = 1) const
   {
     if (i >= n)
-      return Query(n - 1, B, n, inclusive) ;
+      i = n - 1 ; // not a recursive call so the query can be inlined
 
     size_t wi = i >> WORDBITS_WIDTH ;
     return _R[wi >> _bshift] + ((wi&(_b - 1)) ? _subR.Read(wi - (wi >> _bshift) - 1) : 0) 
@@ -143,6 +145,17 @@ public:
 } ;
 
 // Optimized for recording offset every 8 words.
+struct _DS_Rank9BuildThreadArg
+{
+  int tid ;
+  int threadCnt ;
+  
+  const WORD *B ;
+  uint64_t *R ;
+  size_t wordCnt ;
+  size_t blockFrom, blockTo ; // [blockFrom, blockTo) blocks handled by this thread
+} ;
+
 class DS_Rank9
 {
 private:
@@ -246,6 +259,86 @@ public:
     }
   }
   
+  // Fill the sub-block counts for blocks in [blockFrom, blockTo), 
+  //   and temporarily put the total number of 1s of each block in R[2*bi].
+  // The result is the same as the serial Init after the prefix sum. 
+  static void *BuildBlocks_Thread(void *arg)
+  {
+    struct _DS_Rank9BuildThreadArg *pArg = (struct _DS_Rank9BuildThreadArg *)arg ;
+    const int b = 8 ;
+    const int subrWidth = 9 ;
+    const WORD *B = pArg->B ;
+    uint64_t *R = pArg->R ;
+    size_t bi ;
+    for (bi = pArg->blockFrom ; bi < pArg->blockTo ; ++bi)
+    {
+      size_t from = bi * b ;
+      size_t to = from + b ;
+      if (to > pArg->wordCnt)
+        to = pArg->wordCnt ;
+      
+      uint64_t localOneCntSum = 0 ;
+      uint64_t subr = 0 ;
+      int br ;
+      for (br = 0 ; br < b ; ++br)
+      {
+        if (br > 0 && (from + br < to || to - from > 1))
+          subr |= (localOneCntSum << ((br - 1) * subrWidth)) ;
+        if (from + br < to)
+          localOneCntSum += Utils::Popcount(B[from + br]) ;
+      }
+      R[2 * bi] = localOneCntSum ;
+      R[2 * bi + 1] = subr ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Multi-threaded construction
+  void Init(const WORD *B, const size_t &n, int threadCnt)
+  {
+    const int b = 8 ;
+    _wordCnt = Utils::BitsToWords(n) ;
+    size_t blockCnt = DIV_CEIL(_wordCnt, b) ;
+    if (threadCnt <= 1 || blockCnt < (size_t)threadCnt)
+    {
+      Init(B, n) ;
+      return ;
+    }
+
+    _R = (uint64_t *)calloc(blockCnt * 2, sizeof(uint64_t)) ;
+    _space = sizeof(uint64_t) * blockCnt * 2 ;
+    
+    int i ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * threadCnt) ;
+    struct _DS_Rank9BuildThreadArg *args = (struct _DS_Rank9BuildThreadArg *)
+      malloc(sizeof(struct _DS_Rank9BuildThreadArg) * threadCnt) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      args[i].tid = i ;
+      args[i].threadCnt = threadCnt ;
+      args[i].B = B ;
+      args[i].R = _R ;
+      args[i].wordCnt = _wordCnt ;
+      args[i].blockFrom = blockCnt / threadCnt * i ;
+      args[i].blockTo = (i == threadCnt - 1) ? blockCnt : blockCnt / threadCnt * (i + 1) ;
+      pthread_create(&threads[i], NULL, BuildBlocks_Thread, (void *)(args + i)) ;
+    }
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    free(threads) ;
+    free(args) ;
+
+    // Turn the block counts into the partial sums.
+    size_t bi ;
+    uint64_t onecntSum = 0 ;
+    for (bi = 0 ; bi < blockCnt ; ++bi)
+    {
+      uint64_t tmp = _R[2 * bi] ;
+      _R[2 * bi] = onecntSum ;
+      onecntSum += tmp ;
+    }
+  }
+  
   // read the si-th subblock in block bi
   int DecodeSubR(size_t bi, size_t si) const
   {
@@ -255,7 +348,7 @@ public:
   size_t Query(size_t i, const WORD *B, const size_t &n, int inclusive = 1) const
   {
     if (i >= n)
-      return Query(n - 1, B, n, inclusive) ;
+      i = n - 1 ; // not a recursive call so the query can be inlined
     
     const size_t wi = (i>>WORDBITS_WIDTH) ; // word id
     const size_t ri = (wi >> 3) * 2 ; // region/block id
@@ -270,6 +363,30 @@ public:
       + Utils::Popcount(B[wi] & ((MASK(i&(WORDBITS - 1))<<inclusive) + inclusive)) ;
   }
 
+  // The inclusive ranks of i and j (i <= j < n) through ri and rj.
+  // The counters are loaded once when the two positions are in the same block.
+  void QueryPair(size_t i, size_t j, const WORD *B, const size_t &n, size_t &ri, size_t &rj) const
+  {
+    const size_t wi = (i>>WORDBITS_WIDTH) ;
+    const size_t wj = (j>>WORDBITS_WIDTH) ;
+    if ((wi >> 3) != (wj >> 3))
+    {
+      ri = Query(i, B, n) ;
+      rj = Query(j, B, n) ;
+      return ;
+    }
+    
+    const size_t bi = (wi >> 3) * 2 ;
+    const uint64_t blockR = _R[bi] ;
+    const uint64_t subR = _R[bi + 1] ;
+    const size_t ti = (wi & 7) - 1 ;
+    const size_t tj = (wj & 7) - 1 ;
+    ri = blockR + ((subR >> ((ti + ((ti>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(B[wi] & ((MASK(i&(WORDBITS - 1))<<1) + 1)) ;
+    rj = blockR + ((subR >> ((tj + ((tj>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(B[wj] & ((MASK(j&(WORDBITS - 1))<<1) + 1)) ;
+  }
+
   void Save(FILE *fp)
   {
     SAVE_VAR(fp, _space) ;
@@ -293,6 +410,148 @@ public:
     fread(_R, sizeof(_R[0]), blockCnt * 2, fp) ; 
   }
 } ;
+
+// Rank9 with the counters stored next to the bits.
+// Each block is 10 words: the count before the block, the packed sub-block counts as in DS_Rank9, 
+//   and the 8 words (512 bits) of the bitvector. The blocks start from a 64-byte aligned address,
+//   so a block always sits in two adjacent cache lines and a rank query does not touch
+//   a separate counter array. The structure holds the bits, so the original bitvector can be released.
+// Extra space is the same as DS_Rank9: 2 words every 8 words.
+class DS_Rank9Interleaved
+{
+private:
+  WORD *_IB ; // the interleaved blocks
+  size_t _wordCnt ;
+  size_t _space ;
+  
+  static const int BLOCK_WORDS = 10 ;
+
+  void AllocateBlocks(size_t blockCnt)
+  {
+    void *p = NULL ;
+    if (posix_memalign(&p, 64, sizeof(WORD) * BLOCK_WORDS * (blockCnt > 0 ? blockCnt : 1)) != 0)
+    {
+      Utils::PrintLog("Failed to allocate the memory for the interleaved rank blocks.") ;
+      exit(1) ;
+    }
+    _IB = (WORD *)p ;
+    _space = sizeof(WORD) * BLOCK_WORDS * blockCnt ;
+  }
+public:
+  DS_Rank9Interleaved()
+  {
+    _IB = NULL ;
+    _wordCnt = _space = 0 ;
+  }
+
+  ~DS_Rank9Interleaved() { Free() ; }
+
+  void Free()
+  {
+    if (_IB != NULL)
+    {
+      free(_IB) ;
+      _IB = NULL ;
+    }
+    _wordCnt = _space = 0 ;
+  }
+
+  size_t GetSpace() { return _space + sizeof(*this); }
+
+  // The counters are from DS_Rank9, so the construction is multi-threaded in the same way.
+  void Init(const WORD *B, const size_t &n, int threadCnt)
+  {
+    Free() ;
+    DS_Rank9 rank ;
+    rank.Init(B, n, threadCnt) ;
+    const uint64_t *R = rank.GetR() ;
+
+    _wordCnt = Utils::BitsToWords(n) ;
+    size_t blockCnt = DIV_CEIL(_wordCnt, 8) ;
+    AllocateBlocks(blockCnt) ;
+    size_t bi ;
+    for (bi = 0 ; bi < blockCnt ; ++bi)
+    {
+      WORD *block = _IB + bi * BLOCK_WORDS ;
+      block[0] = R[2 * bi] ;
+      block[1] = R[2 * bi + 1] ;
+      size_t from = bi * 8 ;
+      size_t len = MIN(_wordCnt - from, (size_t)8) ;
+      memcpy(block + 2, B + from, sizeof(WORD) * len) ;
+      if (len < 8)
+        memset(block + 2 + len, 0, sizeof(WORD) * (8 - len)) ;
+    }
+  }
+
+  int Access(size_t i) const
+  {
+    const size_t wi = (i>>WORDBITS_WIDTH) ;
+    return (_IB[(wi >> 3) * BLOCK_WORDS + 2 + (wi & 7)] >> (i&(WORDBITS - 1))) & 1ull ;
+  }
+
+  // The same branchless computation as DS_Rank9::Query
+  size_t Query(size_t i, const size_t &n, int inclusive = 1) const
+  {
+    if (i >= n)
+      i = n - 1 ; // not a recursive call so the query can be inlined
+    
+    const size_t wi = (i>>WORDBITS_WIDTH) ;
+    const WORD *block = _IB + (wi >> 3) * BLOCK_WORDS ;
+    const size_t t = (wi & 7) - 1 ;
+    return block[0] + ((block[1] >> ((t + ((t>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(block[2 + (wi & 7)] & ((MASK(i&(WORDBITS - 1))<<inclusive) + inclusive)) ;
+  }
+
+  // The inclusive ranks of i and j (i <= j < n) through ri and rj.
+  void QueryPair(size_t i, size_t j, const size_t &n, size_t &ri, size_t &rj) const
+  {
+    const size_t wi = (i>>WORDBITS_WIDTH) ;
+    const size_t wj = (j>>WORDBITS_WIDTH) ;
+    if ((wi >> 3) != (wj >> 3))
+    {
+      ri = Query(i, n) ;
+      rj = Query(j, n) ;
+      return ;
+    }
+
+    const WORD *block = _IB + (wi >> 3) * BLOCK_WORDS ;
+    const size_t ti = (wi & 7) - 1 ;
+    const size_t tj = (wj & 7) - 1 ;
+    ri = block[0] + ((block[1] >> ((ti + ((ti>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(block[2 + (wi & 7)] & ((MASK(i&(WORDBITS - 1))<<1) + 1)) ;
+    rj = block[0] + ((block[1] >> ((tj + ((tj>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(block[2 + (wj & 7)] & ((MASK(j&(WORDBITS - 1))<<1) + 1)) ;
+  }
+
+  // Return the ith bit, and the number of 1s in [0..i] through rank.
+  int AccessAndRank(size_t i, size_t &rank) const
+  {
+    const size_t wi = (i>>WORDBITS_WIDTH) ;
+    const WORD *block = _IB + (wi >> 3) * BLOCK_WORDS ;
+    const size_t t = (wi & 7) - 1 ;
+    const WORD w = block[2 + (wi & 7)] ;
+    rank = block[0] + ((block[1] >> ((t + ((t>>60)&8))*9)) & 0x1ff) 
+      + Utils::Popcount(w & ((MASK(i&(WORDBITS - 1))<<1) + 1)) ;
+    return (w >> (i&(WORDBITS - 1))) & 1ull ;
+  }
+
+  void Save(FILE *fp)
+  {
+    SAVE_VAR(fp, _space) ;
+    SAVE_VAR(fp, _wordCnt) ;
+    fwrite(_IB, sizeof(WORD), BLOCK_WORDS * DIV_CEIL(_wordCnt, 8), fp) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+    LOAD_VAR(fp, _space) ;
+    LOAD_VAR(fp, _wordCnt) ;
+    size_t blockCnt = DIV_CEIL(_wordCnt, 8) ;
+    AllocateBlocks(blockCnt) ;
+    fread(_IB, sizeof(WORD), BLOCK_WORDS * blockCnt, fp) ;
+  }
+} ;
 }
 
 #endif 
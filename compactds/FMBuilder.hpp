@@ -7,9 +7,17 @@
 #include <map>
 
 #include <pthread.h> 
+#include <unistd.h>
 
 #include "Utils.hpp"
 #include "SuffixArrayGenerator.hpp"
+#include "FixedByteElemArray.hpp"
+#include "PrefixFreeParser.hpp"
+#include "DS_Rank.hpp"
+
+// The strategies to sample the suffix array
+#define FM_SAMPLE_STRATEGY_ROW 0 // SA[i] for the BWT rows with i % sampleRate == 0
+#define FM_SAMPLE_STRATEGY_TEXT 1 // SA[i] for the BWT rows with SA[i] % sampleRate == 0, so locating takes at most sampleRate - 1 LF steps
 
 namespace compactds {
 struct _FMBuilderParam
@@ -21,9 +29,10 @@ struct _FMBuilderParam
   size_t threadCnt ;
   
   int sampleRate ;
-  int sampleStrategy ; // on SA, on T or on the ends of BWT runs.
+  int sampleStrategy ; // FM_SAMPLE_STRATEGY_*
   size_t sampleSize ;
-  size_t *sampledSA ;
+  FixedByteElemArray sampledSA ; // holds the text positions during the construction
+  WORD *sampledRows ; // FM_SAMPLE_STRATEGY_TEXT: the bits marking the sampled BWT rows, whose text positions are in sampledSA in row order
 
   int precomputeWidth ;
   size_t precomputeSize ;
@@ -42,10 +51,18 @@ struct _FMBuilderParam
   size_t adjustedSA0 ; // specialized sampled SA.
 
   FILE *dumpSaFp ; // dump SA to this file.
+  char *tmpPrefix ; // spill BWT and sampled SA to files with this prefix during the construction.
+
+  int pfpWindow ; // >0: generate the suffix array with prefix-free parsing using this trigger window size
+  size_t pfpModulus ; // a window is a trigger string if its hash is 0 mod this value
+
+  char *checkpointPrefix ; // periodically save the construction progress to files with this prefix. NULL: no checkpoint.
+  int checkpointInterval ; // the seconds between two checkpoints
+  bool resume ; // continue from the checkpoint with checkpointPrefix
 
   _FMBuilderParam()
   {
-    sampleStrategy = 0 ;
+    sampleStrategy = FM_SAMPLE_STRATEGY_ROW ;
     saBlockSize = 1<<24 ;
     saDcv = 4096 ;
     sampleRate = 1<<5 ;
@@ -57,12 +74,18 @@ struct _FMBuilderParam
 
     maxLcp = 0 ;
     dumpSaFp = NULL ; 
+    tmpPrefix = NULL ;
+    pfpWindow = 0 ;
+    pfpModulus = 100 ;
+    checkpointPrefix = NULL ;
+    checkpointInterval = 3600 ;
+    resume = false ;
     
     // The memory for these arrays shall handled explicitly outside.
-    sampledSA = NULL ;
     precomputedRange = NULL ;
     semiLcpGreater = NULL ;
     semiLcpEqual = NULL ;
+    sampledRows = NULL ;
   }
 
   // Use this free with caution,
@@ -71,17 +94,51 @@ struct _FMBuilderParam
   // Use this only when generating BWT string.
   void Free() 
   {
-    if (sampledSA != NULL)
-      free(sampledSA) ;
+    sampledSA.Free() ;
     if (precomputedRange != NULL)
       free(precomputedRange) ;
     if (semiLcpGreater != NULL)
       free(semiLcpGreater) ;
     if (semiLcpEqual != NULL)
       free(semiLcpEqual) ;
+    if (sampledRows != NULL)
+      free(sampledRows) ;
   }
 } ;
 
+// The predicted resource usage for building the FM index on a text
+struct _FMBuilderResourceEstimate
+{
+  size_t saBlockSize ;
+  int saDcv ;
+  
+  // Peak memory (bytes) of each phase
+  size_t compactSpace ; // reading and compacting the text
+  size_t dcSortSpace ; // sorting the difference cover sample
+  size_t chunkSortSpace ; // sorting the suffix array chunks and generating BWT
+  size_t sampledSASpace ; // transforming the sampled SA
+  size_t rbbwtSpace ; // compressing the BWT in FMIndex::Init
+  size_t peakSpace ;
+  
+  size_t indexSize ; // the upper bound of the index size (bytes)
+
+  // The time in model units, see EstimateSortTime.
+  double sortTime ; // suffix array sorting
+  double linearTime ; // the passes linear to text length: compaction, BWT compression
+} ;
+
+// The progress of the construction saved in the checkpoint
+struct _FMBuilderCheckpointState
+{
+  size_t n ;
+  size_t cutCnt ;
+  size_t nextCut ; // the chunks before this one are finished
+  size_t filled ; // the number of finished BWT entries
+  size_t lastSA ;
+  size_t firstISA ;
+  size_t persistedLen ; // the BWT and sampled SA before this are in the data files. Always a multiple of the window alignment.
+} ;
+
 struct _FMBuilderChunkThreadArg
 {
   int tid ;
@@ -92,7 +149,8 @@ struct _FMBuilderChunkThreadArg
   
   SuffixArrayGenerator *saGenerator ;
   size_t from, to ;
-  std::vector< std::vector<size_t> > pos ;
+  int saElemLength ;
+  FixedByteElemArray *pos ; // pos[j]: the positions in chunk from+j from this thread's portion of T
 } ;
 
 struct _FMBuilderSASortThreadArg 
@@ -104,7 +162,7 @@ struct _FMBuilderSASortThreadArg
   size_t n ;
 
   SuffixArrayGenerator *saGenerator ;
-  size_t *sa ;
+  FixedByteElemArray *sa ;
   size_t saSize ;
   
   size_t accuChunkSize ;
@@ -119,17 +177,19 @@ struct _FMBuilderPostprocessThreadArg
   FixedSizeElemArray *BWT ;
 	size_t n ;
 
-	size_t *saChunk ;
+	const FixedByteElemArray *saChunk ;
 	size_t saSize ;
   size_t prevChunkLastSA ;
   size_t *pFirstISA ;
 
 	size_t accuChunkSize ; // The start for this chunk
+  size_t windowStart ; // BWT and sampledSA in memory start from this index. Non-zero only when spilling to disk.
 
   int skippedBWT ; // The number of BWT entries that skipped becuase they overlap with the WORD from the previous chun/k
 
   WORD firstPrecomputeW ; // The first precompute w range might be the same as the last w in the previous chunk in parallel, so we store them here, and merge after the parallel execution 
   size_t firstPrecomputeWLen ; 
+  size_t firstPrecomputeWStart ; // the BWT index of the first precompute w, which can be after the chunk start when the suffixes there are shorter than the precompute width
 
   struct _FMBuilderParam *builderParam ;
 } ;
@@ -161,26 +221,28 @@ private:
     size_t s = segLen * pArg->tid ;
     size_t e = s + segLen - 1 ;
     pArg->saGenerator->GetChunksPositions(*(pArg->T), pArg->n, 
-        pArg->from, pArg->to, s, e, pArg->pos) ;
+        pArg->from, pArg->to, s, e, pArg->saElemLength, pArg->pos) ;
     pthread_exit(NULL) ;
   }
   
   // Compare the semiLCP between T[sai...], and T[saj,...], write the result to semiLcp[biti]
+  // The threads write to the neighboring bits in the same word at the chunk boundaries,
+  //   so the bits are set atomically.
   static void SetSemiLcpBit(const FixedSizeElemArray &T, size_t n, size_t sai, size_t saj, size_t biti, size_t maxLcp, WORD *semiLcpGreater, WORD *semiLcpEqual)
   {
     size_t l = 0 ;
     l = ComputeSemiLcp(T, n, sai, saj, maxLcp + 1) ;
     if (l > maxLcp)
-      Utils::BitSet(semiLcpGreater, biti) ;
+      __sync_fetch_and_or(semiLcpGreater + (biti >> WORDBITS_WIDTH), 1ull << (biti & (WORDBITS - 1))) ;
     else if (l == maxLcp)
-      Utils::BitSet(semiLcpEqual, biti) ;
+      __sync_fetch_and_or(semiLcpEqual + (biti >> WORDBITS_WIDTH), 1ull << (biti & (WORDBITS - 1))) ;
   }
 
   static void *SortSA_Thread(void *arg)
   {
     struct _FMBuilderSASortThreadArg *pArg = (struct _FMBuilderSASortThreadArg *)arg ;
     pArg->saGenerator->SortSuffixByPos(*(pArg->T),pArg->n, 
-        pArg->sa, pArg->saSize, pArg->sa ) ;
+        *(pArg->sa), pArg->saSize) ;
     //printf("TEST %d\n",  saSortThreadArgs[0][0].sa[0]) ;
     pthread_exit(NULL) ;
   }
@@ -194,7 +256,7 @@ private:
 
     size_t i ;
     size_t size = pArg->saSize ;
-    size_t *saChunk = pArg->saChunk ;
+    const FixedByteElemArray &saChunk = *(pArg->saChunk) ;
     struct _FMBuilderParam &param = *(pArg->builderParam) ;
     const FixedSizeElemArray &T = *(pArg->T) ;
     FixedSizeElemArray &BWT = *(pArg->BWT) ;
@@ -204,10 +266,12 @@ private:
     //printf("%d %d %d %d\n", size, j, saSortThreadArgs[prevPosTag][j].pos->at(1),
     //    saChunk[0]) ;
     size_t bwtFilled = pArg->accuChunkSize ;
+    const size_t windowStart = pArg->windowStart ; // BWT and sampledSA are indexed relative to this 
     int skipLength = 0 ; // skip this amount of BWT as they may write to a word 
-    if (tid > 0 && BWT.GetElemOffsetInWord(bwtFilled) > 0)
+    if (tid > 0 && BWT.GetElemOffsetInWord(bwtFilled - windowStart) > 0)
     {
-      while (BWT.GetElemWordIndex(bwtFilled) == BWT.GetElemWordIndex(bwtFilled + skipLength))
+      while ((size_t)skipLength < size 
+          && BWT.GetElemWordIndex(bwtFilled - windowStart) == BWT.GetElemWordIndex(bwtFilled - windowStart + skipLength))
       {
         ++skipLength ;
       }
@@ -222,13 +286,18 @@ private:
         if (saChunk[i] == 0)
         {
           *(pArg->pFirstISA) = bwtFilled ;
-          BWT.Write(bwtFilled, T.Read(n - 1)) ;
+          BWT.Write(bwtFilled - windowStart, T.Read(n - 1)) ;
         }
         else
-          BWT.Write(bwtFilled, T.Read( saChunk[i] - 1 ) ) ;
+          BWT.Write(bwtFilled - windowStart, T.Read( saChunk[i] - 1 ) ) ;
 
-        if (param.sampledSA != NULL && bwtFilled % param.sampleRate == 0)
-          param.sampledSA[bwtFilled / param.sampleRate] = saChunk[i] ;
+        if (param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+        {
+          if (saChunk[i] % param.sampleRate == 0)
+            param.sampledSA.Write(saChunk[i] / param.sampleRate, bwtFilled) ;
+        }
+        else if (param.sampledSA.GetSize() > 0 && bwtFilled % param.sampleRate == 0)
+          param.sampledSA.Write((bwtFilled - windowStart) / param.sampleRate, saChunk[i]) ;
       }
 
       if (param.precomputedRange != NULL)
@@ -243,6 +312,7 @@ private:
           {
             pArg->firstPrecomputeW = w ;
             pArg->firstPrecomputeWLen = 1 ;
+            pArg->firstPrecomputeWStart = bwtFilled ;
             setFirstPrecomputeW = true ;
           }
           else
@@ -276,7 +346,6 @@ private:
 
       if (param.maxLcp > 0 && i > 0)
       {
-        //TODO: need to address the racing for the semiLcpBits
         SetSemiLcpBit(T, n, saChunk[i], saChunk[i - 1], pArg->accuChunkSize + i, 
             param.maxLcp, param.semiLcpGreater, param.semiLcpEqual) ;
       }
@@ -288,7 +357,259 @@ private:
     pthread_exit(NULL) ;
   }
 
+  static FILE *OpenSpillFile(const struct _FMBuilderParam &param, const char *suffix, const char *mode)
+  {
+    char fileName[1024] ;
+    sprintf(fileName, "%s.%s.tmp", param.tmpPrefix, suffix) ;
+    FILE *fp = fopen(fileName, mode) ;
+    if (fp == NULL)
+    {
+      Utils::PrintLog("Failed to open temporary file %s.", fileName) ;
+      exit(1) ;
+    }
+    return fp ;
+  }
+
+  // Write the SA chunk to the dump file as size_t array
+  static void DumpSA(const FixedByteElemArray &sa, size_t size, FILE *fp)
+  {
+    const size_t bufferSize = 1024 ;
+    size_t buffer[bufferSize] ;
+    size_t i, j ;
+    for (i = 0 ; i < size ; i += bufferSize)
+    {
+      size_t len = MIN(bufferSize, size - i) ;
+      for (j = 0 ; j < len ; ++j)
+        buffer[j] = sa[i + j] ;
+      fwrite(buffer, sizeof(buffer[0]), len, fp) ;
+    }
+  }
+
+  // Write the finished BWT and sampled SA in the window, which covers
+  //   [windowStart, filled), to the spill files. Unless isFinal, only the 
+  //   prefix that is a multiple of align is written, and the rest is moved
+  //   to the beginning of the window.
+  // return: the new windowStart
+  static size_t SpillWindow(FixedSizeElemArray &BWT, struct _FMBuilderParam &param,
+      size_t windowStart, size_t filled, size_t align, bool isFinal, 
+      FILE *fpBWT, FILE *fpSampledSA)
+  {
+    size_t i ;
+    size_t len = filled - windowStart ;
+    size_t spillLen = isFinal ? len : len / align * align ;
+    if (spillLen == 0)
+      return windowStart ;
+
+    bool spillSampledSA = (param.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT) ; // the samples by text position stay in memory
+    fwrite(BWT.GetData(), sizeof(WORD), Utils::BitsToWords(spillLen * BWT.GetElemLength()), fpBWT) ;
+    if (spillSampledSA)
+      fwrite(param.sampledSA.GetData(), param.sampledSA.GetElemLength(), DIV_CEIL(spillLen, param.sampleRate), fpSampledSA) ;
+    if (isFinal)
+      return filled ;
+
+    for (i = spillLen ; i < len ; ++i)
+      BWT.Write(i - spillLen, BWT.Read(i)) ;
+    if (spillSampledSA)
+      param.sampledSA.ShiftToFront(spillLen / param.sampleRate, 
+          DIV_CEIL(len, param.sampleRate) - spillLen / param.sampleRate) ;
+    return windowStart + spillLen ;
+  }
+
+  // Mark the sampled rows in param.sampledRows, and rearrange param.sampledSA, 
+  //   where the k-th element is the row for text position k*sampleRate, 
+  //   to hold the text positions in the order of the rows.
+  // The permutation is applied in place by following its cycles.
+  static void ArrangeTextSamplesByRow(struct _FMBuilderParam &param)
+  {
+    size_t i, k ;
+    const size_t n = param.n ;
+    const size_t sampleSize = param.sampleSize ;
+    FixedByteElemArray &sampledSA = param.sampledSA ;
+
+    if (param.sampledRows != NULL)
+      free(param.sampledRows) ;
+    param.sampledRows = Utils::MallocByBits(n) ;
+    for (k = 0 ; k < sampleSize ; ++k)
+      Utils::BitSet(param.sampledRows, sampledSA[k]) ;
+    DS_Rank9 rowRank ;
+    rowRank.Init(param.sampledRows, n, param.threadCnt) ;
+    
+    WORD *arranged = Utils::MallocByBits(sampleSize) ;
+    for (i = 0 ; i < sampleSize ; ++i)
+    {
+      if (Utils::BitRead(arranged, i))
+        continue ;
+      // Element k holds the row of text position k*sampleRate until it is arranged.
+      k = i ;
+      size_t row = sampledSA[k] ;
+      while (1)
+      {
+        size_t to = rowRank.Query(row, param.sampledRows, n) - 1 ;
+        size_t nextRow = sampledSA[to] ;
+        sampledSA.Write(to, k * param.sampleRate) ;
+        Utils::BitSet(arranged, to) ;
+        if (to == i)
+          break ;
+        k = to ;
+        row = nextRow ;
+      }
+    }
+    free(arranged) ;
+  }
+
+  // isTmp: open <file>.tmp, which becomes the checkpoint file through CommitCheckpointFile 
+  static FILE *OpenCheckpointFile(const struct _FMBuilderParam &param, const char *suffix, const char *mode, bool isTmp)
+  {
+    char fileName[1100] ;
+    GetCheckpointFileName(param, suffix, fileName) ;
+    if (isTmp)
+      strcat(fileName, ".tmp") ;
+    FILE *fp = fopen(fileName, mode) ;
+    if (fp == NULL)
+    {
+      Utils::PrintLog("Failed to open checkpoint file %s.", fileName) ;
+      exit(1) ;
+    }
+    return fp ;
+  }
+
+  // Make the checkpoint file written as <file>.tmp the current one. 
+  //   Renaming is atomic, so a crash while writing keeps the previous checkpoint.
+  static void CommitCheckpointFile(const struct _FMBuilderParam &param, const char *suffix)
+  {
+    char fileName[1024] ;
+    char tmpFileName[1100] ;
+    GetCheckpointFileName(param, suffix, fileName) ;
+    sprintf(tmpFileName, "%s.tmp", fileName) ;
+    rename(tmpFileName, fileName) ;
+  }
+
+  // Save the construction progress. The BWT and sampled SA before state.persistedLen 
+  //   are already in fpBWT and fpSampledSA, and the rest up to state.filled goes
+  //   to the state file together with the auxiliary arrays. 
+  static void WriteCheckpoint(const struct _FMBuilderCheckpointState &state, const FixedSizeElemArray &BWT, 
+      size_t windowStart, const struct _FMBuilderParam &param, FILE *fpBWT, FILE *fpSampledSA)
+  {
+    fflush(fpBWT) ;
+    fflush(fpSampledSA) ;
+    FILE *fp = OpenCheckpointFile(param, "state", "wb", true) ;
+    SAVE_VAR(fp, state) ;
+    
+    int alphabetBits = BWT.GetElemLength() ;
+    int saElemLength = param.sampledSA.GetElemLength() ;
+    size_t tailWords = Utils::BitsToWords((state.filled - state.persistedLen) * alphabetBits) ;
+    size_t tailSamples = DIV_CEIL(state.filled, param.sampleRate) - state.persistedLen / param.sampleRate ;
+    if (tailWords > 0)
+      fwrite(BWT.GetData() + (state.persistedLen - windowStart) * alphabetBits / WORDBITS, 
+          sizeof(WORD), tailWords, fp) ;
+    if (tailSamples > 0)
+      fwrite(param.sampledSA.GetData() + (state.persistedLen - windowStart) / param.sampleRate * saElemLength, 
+          saElemLength, tailSamples, fp) ;
+    
+    fwrite(param.precomputedRange, sizeof(param.precomputedRange[0]), param.precomputeSize, fp) ;
+    size_t size = param.selectedISA.size() ;
+    SAVE_VAR(fp, size) ;
+    for (std::map<size_t, size_t>::const_iterator iter = param.selectedISA.begin() ;
+        iter != param.selectedISA.end() ; ++iter)
+    {
+      SAVE_VAR(fp, iter->first) ;
+      SAVE_VAR(fp, iter->second) ;
+    }
+    if (param.maxLcp > 0)
+    {
+      fwrite(param.semiLcpGreater, sizeof(WORD), Utils::BitsToWords(state.n), fp) ;
+      fwrite(param.semiLcpEqual, sizeof(WORD), Utils::BitsToWords(state.n), fp) ;
+    }
+    fclose(fp) ;
+    CommitCheckpointFile(param, "state") ;
+  }
+
+  // Restore the construction progress saved by WriteCheckpoint from fp.
+  // fpBWT, fpSampledSA: the data files holding the persisted BWT and sampled SA,
+  //   their positions are set to the end of the persisted part for the following writes.
+  // windowCapacity: the allocated window size when spilling to disk.
+  static void LoadCheckpoint(FILE *fp, size_t n, size_t cutCnt, int alphabetBits, int saElemLength,
+      FixedSizeElemArray &BWT, struct _FMBuilderParam &param, struct _FMBuilderCheckpointState &state, 
+      FILE *fpBWT, FILE *fpSampledSA, size_t &windowCapacity)
+  {
+    size_t i ;
+    LOAD_VAR(fp, state) ;
+    if (state.n != n || state.cutCnt != cutCnt)
+    {
+      Utils::PrintLog("The checkpoint does not match the input. Please remove the .ckpt files and start over.") ;
+      exit(1) ;
+    }
+    
+    size_t windowStart = 0 ;
+    size_t persistedWords = state.persistedLen * alphabetBits / WORDBITS ;
+    size_t persistedSamples = state.persistedLen / param.sampleRate ;
+    if (param.tmpPrefix == NULL)
+    {
+      fread((WORD *)BWT.GetData(), sizeof(WORD), persistedWords, fpBWT) ;
+      fread((uint8_t *)param.sampledSA.GetData(), saElemLength, persistedSamples, fpSampledSA) ;
+    }
+    else // the persisted part stays in the spill files, and the window starts after that.
+    {
+      windowStart = state.persistedLen ;
+      windowCapacity = state.filled - windowStart ;
+      if (windowCapacity > 0)
+      {
+        BWT.Malloc(alphabetBits, windowCapacity) ;
+        param.sampledSA.Malloc(saElemLength, DIV_CEIL(windowCapacity, param.sampleRate)) ;
+      }
+    }
+    fseek(fpBWT, persistedWords * sizeof(WORD), SEEK_SET) ;
+    fseek(fpSampledSA, persistedSamples * saElemLength, SEEK_SET) ;
+
+    size_t tailWords = Utils::BitsToWords((state.filled - state.persistedLen) * alphabetBits) ;
+    size_t tailSamples = DIV_CEIL(state.filled, param.sampleRate) - persistedSamples ;
+    if (tailWords > 0)
+      fread((WORD *)BWT.GetData() + (state.persistedLen - windowStart) * alphabetBits / WORDBITS,
+          sizeof(WORD), tailWords, fp) ;
+    if (tailSamples > 0)
+      fread((uint8_t *)param.sampledSA.GetData() + (state.persistedLen - windowStart) / param.sampleRate * saElemLength, 
+          saElemLength, tailSamples, fp) ;
+    
+    fread(param.precomputedRange, sizeof(param.precomputedRange[0]), param.precomputeSize, fp) ;
+    size_t size ;
+    LOAD_VAR(fp, size) ;
+    param.selectedISA.clear() ;
+    for (i = 0 ; i < size ; ++i)
+    {
+      size_t key, value ;
+      LOAD_VAR(fp, key) ;
+      LOAD_VAR(fp, value) ;
+      param.selectedISA[key] = value ;
+    }
+    if (param.maxLcp > 0)
+    {
+      fread(param.semiLcpGreater, sizeof(WORD), Utils::BitsToWords(n), fp) ;
+      fread(param.semiLcpEqual, sizeof(WORD), Utils::BitsToWords(n), fp) ;
+    }
+  }
+
 public:
+  // The checkpoint files are <checkpointPrefix>.<suffix>.ckpt
+  static void GetCheckpointFileName(const struct _FMBuilderParam &param, const char *suffix, char *fileName)
+  {
+    sprintf(fileName, "%s.%s.ckpt", param.checkpointPrefix, suffix) ;
+  }
+
+  // Remove the checkpoint files after the construction finishes
+  static void RemoveCheckpoint(const struct _FMBuilderParam &param)
+  {
+    const char *suffixes[] = {"text", "sa", "state", "bwt", "ssa"} ;
+    char fileName[1024] ;
+    size_t i ;
+    if (param.checkpointPrefix == NULL)
+      return ;
+    for (i = 0 ; i < sizeof(suffixes) / sizeof(suffixes[0]) ; ++i)
+    {
+      GetCheckpointFileName(param, suffixes[i], fileName) ;
+      remove(fileName) ;
+    }
+  }
+
   // Allocate and init the memorys for auxiliary data arrays in FM index
   // chrbit: number of bits for each character
   static void MallocAuxiliaryData(size_t chrbit, size_t n, struct _FMBuilderParam &param)
@@ -297,7 +618,10 @@ public:
     param.n = n ;
     
     param.sampleSize = DIV_CEIL(n, param.sampleRate) ;
-    param.sampledSA = (size_t *)malloc(sizeof(size_t) * DIV_CEIL(n, param.sampleRate)) ;
+    if (param.tmpPrefix == NULL || param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+      param.sampledSA.Malloc(FixedByteElemArray::GetElemLengthForValue(n), DIV_CEIL(n, param.sampleRate)) ;
+    else // only a window of sampled SA is kept in memory, see Build()
+      param.sampledSA.Free() ;
 
     if (param.precomputeWidth > 0)
     {
@@ -327,10 +651,97 @@ public:
     }
   }
 
+  // The number of threads that can run at the same time
+  static size_t GetParallelism(size_t threadCnt)
+  {
+    long coreCnt = sysconf(_SC_NPROCESSORS_ONLN) ;
+    if (coreCnt > 0 && (size_t)coreCnt < threadCnt)
+      return coreCnt ;
+    return threadCnt ;
+  }
+
+  // The time model of the blockwise suffix array sorting, in the unit of a suffix comparison.
+  // Each round extracts threadCnt chunks by scanning the whole text, so the extraction
+  //   grows with n^2/(blockSize*threadCnt), while the chunk sorting grows with n*log(blockSize).
+  static size_t EstimateSortTime(size_t n, size_t blockSize, size_t dcv, size_t threadCnt)
+  {
+    size_t dcSize = DIV_CEIL(n, dcv) * DifferenceCover::EstimateCoverSize(dcv) ;
+    size_t rounds = DIV_CEIL(SuffixArrayGenerator::EstimateChunkCount(n, blockSize, dcv), threadCnt) ;
+    return (dcSize * Utils::Log2Ceil(dcSize) // sort difference cover 
+      + 2 * rounds * n // extract the chunks
+      + n * Utils::Log2Ceil(blockSize) // sort the chunks
+      + 4 * n) // fill BWT, sampled SA and the precomputed range
+      / GetParallelism(threadCnt) ;
+  }
+
+  // Estimate the peak memory of each building phase, the index size and the time,
+  //   with the block size and difference cover in param.
+  // genomeCnt: number of sequences, which determines the sampled SA width in the index
+  static void EstimateResource(size_t n, int alphabetSize, size_t genomeCnt, 
+      const struct _FMBuilderParam &param, struct _FMBuilderResourceEstimate &estimate)
+  {
+    size_t alphabetBits = Utils::Log2Ceil(alphabetSize) ;
+    size_t textSpace = DIV_CEIL(n * alphabetBits, WORDBITS) * WORDBYTES ;
+    size_t dcSize = DIV_CEIL(n, param.saDcv) * DifferenceCover::EstimateCoverSize(param.saDcv) ;
+    size_t sampleSize = DIV_CEIL(n, param.sampleRate) ;
+    size_t saBytes = FixedByteElemArray::GetElemLengthForValue(n) ; // the packed SA chunks and sampled SA
+    size_t precomputeSpace = (1ull<<(alphabetBits * param.precomputeWidth)) * 2 * WORDBYTES ;
+    size_t selectedSASpace = genomeCnt * 2 * 48 ; // selectedISA and selectedSA are std::map
+    
+    estimate.saBlockSize = param.saBlockSize ;
+    estimate.saDcv = param.saDcv ;
+
+    // The compacted text grows by doubling its capacity
+    estimate.compactSpace = 2 * textSpace ;
+    
+    // sa, rank and L, and the buffer for the parallel sort. 
+    //   The precomputed range is allocated before the difference cover sorting.
+    estimate.dcSortSpace = textSpace + (param.threadCnt > 1 ? 4 : 3) * dcSize * WORDBYTES 
+      + precomputeSpace ; 
+    
+    // Each thread holds one chunk at a time
+    size_t chunkCnt = SuffixArrayGenerator::EstimateChunkCount(n, param.saBlockSize, param.saDcv) ;
+    size_t activeThreadCnt = MIN(param.threadCnt, chunkCnt) ;
+    estimate.chunkSortSpace = textSpace 
+      + (param.tmpPrefix == NULL ? textSpace : 0) // BWT
+      + (3 * activeThreadCnt * DIV_CEIL(n, chunkCnt) // SA position (grown by doubling), SA result
+          + ((param.tmpPrefix == NULL || param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT) ? sampleSize : 0)) * saBytes 
+      + (dcSize // SA value for difference cover 
+          + chunkCnt * param.saDcv) * WORDBYTES // _cutLCP
+      + precomputeSpace + selectedSASpace ;
+    
+    estimate.sampledSASpace = textSpace + sampleSize * saBytes + precomputeSpace + selectedSASpace ; 
+    
+    // BWT, the packed copy for the run blocks, the wavelet tree bits with the rank directory, 
+    //   the split children of the top level and the packed sampled SA.
+    size_t packedSampledSASpace = DIV_CEIL(sampleSize * Utils::Log2Ceil(genomeCnt + 1), WORDBITS) * WORDBYTES ; 
+    if (param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT) // the sampled rows with the interleaved rank directory
+      packedSampledSASpace += DIV_CEIL(n, 512) * 10 * WORDBYTES ;
+    estimate.rbbwtSpace = textSpace + textSpace + textSpace * 5 / 4 + textSpace 
+      + sampleSize * saBytes + packedSampledSASpace + precomputeSpace + selectedSASpace ;
+    
+    estimate.peakSpace = estimate.compactSpace ;
+    if (estimate.dcSortSpace > estimate.peakSpace)
+      estimate.peakSpace = estimate.dcSortSpace ;
+    if (estimate.chunkSortSpace > estimate.peakSpace)
+      estimate.peakSpace = estimate.chunkSortSpace ;
+    if (estimate.sampledSASpace > estimate.peakSpace)
+      estimate.peakSpace = estimate.sampledSASpace ;
+    if (estimate.rbbwtSpace > estimate.peakSpace)
+      estimate.peakSpace = estimate.rbbwtSpace ;
+
+    // Without the run-block compression. 
+    estimate.indexSize = textSpace * 5 / 4 + packedSampledSASpace + precomputeSpace + selectedSASpace ;
+    
+    estimate.sortTime = EstimateSortTime(n, param.saBlockSize, param.saDcv, param.threadCnt) ; 
+    estimate.linearTime = n ; // text packing and BWT compression are single-threaded
+  }
+
   // Determine the parameters for block size and difference cover size
   //   based on memory requirement (bytes).
   // Assume mem is quite large.
-  static void InferParametersGivenMemory(size_t n, int alphabetSize, size_t memory,
+  // return: false if the memory is too small to build the index
+  static bool InferParametersGivenMemory(size_t n, int alphabetSize, size_t memory,
       struct _FMBuilderParam &param)
   {
     size_t logBlockSize ;
@@ -341,10 +752,25 @@ public:
     size_t bestBlockSize = 0 ;
     size_t bestDcv = 0 ;
 		
-    if (2 * n * alphabetBits / 8 > memory) // The input text and the output BWT
-      return ;
+    // The input text and the output BWT. The BWT and sampled SA stay on disk
+    //   when spilling.
+    size_t textSpace = (param.tmpPrefix == NULL ? 2 : 1) * n * alphabetBits / 8 ;
+    size_t sampledSASpace = ((param.tmpPrefix == NULL || param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT) ?
+        DIV_CEIL(n, param.sampleRate) : 0) ;
+    size_t saBytes = FixedByteElemArray::GetElemLengthForValue(n) ; // the packed SA chunks and sampled SA
+    size_t precomputeSpace = (1ull<<(alphabetBits * param.precomputeWidth)) * 2 * WORDBYTES ;
+    
+    // After sorting, the text is released, but the whole BWT and sampled SA are in memory
+    //   (reloaded from the spill files when spilling) to build the index, whose BWT 
+    //   takes about three more copies of the packed BWT and whose sampled SA is a 
+    //   packed copy of the sampled SA. This does not depend on the 
+    //   block size, so no sorting parameters can meet a smaller memory limit.
+    size_t bwtSpace = DIV_CEIL(n * alphabetBits, WORDBITS) * WORDBYTES ;
+    size_t indexingSpace = 4 * bwtSpace + 2 * DIV_CEIL(n, param.sampleRate) * saBytes + precomputeSpace ;
+    if (indexingSpace > memory || textSpace > memory) 
+      return false ;
     
-    memory -= 2 * n * alphabetBits / 8 ;
+    memory -= textSpace ;
     for (dcv = 512 ; dcv <= 8196 ; dcv *= 2)
     {
       size_t dcSize = DIV_CEIL(n, dcv) * DifferenceCover::EstimateCoverSize(dcv) ;
@@ -354,18 +780,16 @@ public:
         //if (blockSize >= n / param.threadCnt)
         //  break ;
         size_t space = (2 * param.threadCnt * blockSize // SA position, SA result
-            + dcSize // SA value for difference cover 
+            + sampledSASpace // sampledSA
+            ) * saBytes 
+          + (dcSize // SA value for difference cover 
             + SuffixArrayGenerator::EstimateChunkCount(n, blockSize, dcv) * dcv // _cutLCP 
-            + DIV_CEIL(n, param.sampleRate) // sampledSA
             + (1ull<<(alphabetBits * param.precomputeWidth))*2 // precompted width
             ) * WORDBYTES ;  
         
         if (space <= memory)
         {
-          size_t iterations = DIV_CEIL(n, (param.threadCnt * blockSize)) ;
-          size_t time = dcSize * Utils::Log2Ceil(n) // sort difference cover 
-            + iterations * n * dcv // making cuts
-            + iterations * (blockSize * Utils::Log2Ceil(blockSize) + dcv * blockSize) ; // sort block
+          size_t time = EstimateSortTime(n, blockSize, dcv, param.threadCnt) ;
           //printf("%lu(%lu) %lu %lu. %lu %lu. %lu\n", dcv, dcSize, blockSize, iterations, 
           //    space, time, memory) ; 
           if (time < bestTime)
@@ -391,6 +815,7 @@ public:
             param.saBlockSize, param.saDcv) ;
       }
     }
+    return true ;
   }
 
   // T: text
@@ -404,13 +829,113 @@ public:
     size_t i, j, k ;
     SuffixArrayGenerator saGenerator ;
     size_t alphabetBits = Utils::Log2Ceil(alphabetSize) ;
+    const int saElemLength = FixedByteElemArray::GetElemLengthForValue(n) ; // the SA chunks are packed to save memory
     MallocAuxiliaryData(alphabetBits, n, param) ; 
-    BWT.Malloc(alphabetBits, n) ;
-    if (param.printLog)
-      Utils::PrintLog("Generate difference cover and chunks.") ;
-    size_t cutCnt = saGenerator.Init(T, n, param.saBlockSize, param.saDcv, alphabetSize) ;
-    if (param.printLog)
-      Utils::PrintLog("Found %llu chunks.", cutCnt) ;
+    
+    // When spilling to disk, BWT and sampledSA only hold [windowStart, windowStart + windowCapacity). 
+    //   windowStart is kept as a multiple of windowAlign so the spilled part ends at a word boundary.
+    size_t windowStart = 0 ;
+    size_t windowCapacity = 0 ;
+    size_t windowAlign = 0 ;
+    {
+      size_t a = WORDBITS ;
+      size_t b = param.sampleRate ;
+      while (b) // gcd
+      {
+        size_t tmp = a % b ;
+        a = b ;
+        b = tmp ;
+      }
+      windowAlign = WORDBITS / a * param.sampleRate ;
+    }
+
+    // The checkpoint keeps the finished BWT and sampled SA in the data files:
+    //   the spill files when spilling to disk, otherwise the .bwt.ckpt and .ssa.ckpt files.
+    //   The chunks from prefix-free parsing come from a stream, so they are not checkpointed.
+    //   The samples by text position are scattered over the whole array, so they are not checkpointed either.
+    char fileName[1024] ;
+    bool useCheckpoint = (param.checkpointPrefix != NULL && param.pfpWindow == 0 
+        && param.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT) ;
+    FILE *fpCheckpointState = NULL ; // the saved progress to resume from
+    if (param.checkpointPrefix != NULL && param.pfpWindow > 0 && param.printLog)
+      Utils::PrintLog("Checkpoint is not supported with prefix-free parsing.") ;
+    else if (param.checkpointPrefix != NULL && param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT && param.printLog)
+      Utils::PrintLog("Checkpoint is not supported with sampling SA by text position.") ;
+    if (useCheckpoint && param.resume)
+    {
+      GetCheckpointFileName(param, "state", fileName) ;
+      fpCheckpointState = fopen(fileName, "rb") ;
+    }
+    const char *dataFileMode = (fpCheckpointState != NULL) ? "r+b" : "wb" ;
+    
+    FILE *fpSpilledBWT = NULL ;
+    FILE *fpSpilledSampledSA = NULL ;
+    if (param.tmpPrefix == NULL)
+      BWT.Malloc(alphabetBits, n) ;
+    else
+    {
+      fpSpilledBWT = OpenSpillFile(param, "bwt", dataFileMode) ;
+      if (param.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT) // the samples by text position stay in memory
+        fpSpilledSampledSA = OpenSpillFile(param, "ssa", dataFileMode) ;
+    }
+    FILE *fpPersistedBWT = fpSpilledBWT ;
+    FILE *fpPersistedSampledSA = fpSpilledSampledSA ;
+    if (useCheckpoint && param.tmpPrefix == NULL)
+    {
+      fpPersistedBWT = OpenCheckpointFile(param, "bwt", dataFileMode, false) ;
+      fpPersistedSampledSA = OpenCheckpointFile(param, "ssa", dataFileMode, false) ;
+    }
+    size_t persistedLen = 0 ; // BWT and sampled SA before this are in the data files
+    double lastCheckpointTime = Utils::GetWallTime() ;
+
+    PrefixFreeParser pfParser ;
+    size_t cutCnt ;
+    if (param.pfpWindow > 0)
+    {
+      // The suffix array comes out in order, so the chunks are simply the
+      //   consecutive blocks of it.
+      if (param.printLog)
+        Utils::PrintLog("Generate the prefix-free parse.") ;
+      pfParser.Init(T, n, param.pfpWindow, param.pfpModulus) ;
+      cutCnt = DIV_CEIL(n, param.saBlockSize) ;
+      if (param.printLog)
+        Utils::PrintLog("Found %lu distinct phrases in the parse of length %lu.", 
+            pfParser.GetPhraseCount(), pfParser.GetParseLength()) ;
+    }
+    else
+    {
+      FILE *fpSACheckpoint = NULL ;
+      if (useCheckpoint && param.resume)
+      {
+        GetCheckpointFileName(param, "sa", fileName) ;
+        fpSACheckpoint = fopen(fileName, "rb") ;
+      }
+
+      if (fpSACheckpoint != NULL)
+      {
+        if (param.printLog)
+          Utils::PrintLog("Load difference cover and chunks from the checkpoint.") ;
+        saGenerator.Load(fpSACheckpoint) ;
+        fclose(fpSACheckpoint) ;
+        cutCnt = saGenerator.GetChunkCount() ;
+      }
+      else
+      {
+        if (param.printLog)
+          Utils::PrintLog("Generate difference cover and chunks.") ;
+        saGenerator.SetThreadCnt(param.threadCnt) ;
+        cutCnt = saGenerator.Init(T, n, param.saBlockSize, param.saDcv, alphabetSize) ;
+        if (useCheckpoint)
+        {
+          fpSACheckpoint = OpenCheckpointFile(param, "sa", "wb", true) ;
+          saGenerator.Save(fpSACheckpoint) ;
+          fclose(fpSACheckpoint) ;
+          CommitCheckpointFile(param, "sa") ;
+        }
+      }
+      if (param.printLog)
+        Utils::PrintLog("Found %llu chunks.", cutCnt) ;
+    }
    
     pthread_t *threads = (pthread_t *)malloc(sizeof(*threads) * param.threadCnt) ;
     struct _FMBuilderChunkThreadArg *chunkThreadArgs ;
@@ -420,7 +945,7 @@ public:
 
     pthread_attr_init( &attr ) ;
     pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE ) ;
-    size_t **sa ; // suffix array chunks
+    FixedByteElemArray *sa ; // suffix array chunks
     size_t *saChunkSize ; // actual size
     size_t *saChunkCapacity ; // the memory capacity
     
@@ -432,15 +957,16 @@ public:
       chunkThreadArgs[i].saGenerator = &saGenerator ;
       chunkThreadArgs[i].T = &T ;
       chunkThreadArgs[i].n = n ;
+      chunkThreadArgs[i].saElemLength = saElemLength ;
+      chunkThreadArgs[i].pos = new FixedByteElemArray[param.threadCnt] ;
     }
 
-    sa = (size_t **)malloc(sizeof(sa[0]) * param.threadCnt) ;
+    sa = new FixedByteElemArray[param.threadCnt] ;
     saChunkSize = (size_t *)malloc(sizeof(saChunkSize) * param.threadCnt) ;
     saChunkCapacity = (size_t *)malloc(sizeof(saChunkCapacity) * param.threadCnt) ;
     saSortThreadArgs = (struct _FMBuilderSASortThreadArg*)malloc(sizeof(struct _FMBuilderSASortThreadArg) * param.threadCnt) ; 
     for (i = 0 ; i < param.threadCnt ; ++i)
     {
-      sa[i] = NULL ;
       saChunkSize[i] = 0 ;
       saChunkCapacity[i] = 0 ;
 
@@ -465,55 +991,109 @@ public:
 
     size_t lastSA = 0 ; // record the last SA from previous batch or chunk
     size_t accuChunkSizeForSort = 0 ; // accumulated chunk size
+    size_t startCut = 0 ;
     i = 0 ;
+
+    if (fpCheckpointState != NULL)
+    {
+      struct _FMBuilderCheckpointState state ;
+      LoadCheckpoint(fpCheckpointState, n, cutCnt, alphabetBits, saElemLength, BWT, param, state,
+          fpPersistedBWT, fpPersistedSampledSA, windowCapacity) ;
+      fclose(fpCheckpointState) ;
+      
+      startCut = state.nextCut ;
+      accuChunkSizeForSort = state.filled ;
+      lastSA = state.lastSA ;
+      firstISA = state.firstISA ;
+      persistedLen = state.persistedLen ;
+      if (param.tmpPrefix != NULL)
+        windowStart = persistedLen ;
+      if (param.printLog)
+        Utils::PrintLog("Resume from the checkpoint with %lu/%lu chunks finished.", startCut, cutCnt) ;
+    }
     
     if (param.dumpSaFp)
       fwrite(&n, sizeof(size_t), 1, param.dumpSaFp) ;
 
     // Start the core iterations
-    for (i = 0 ; i < cutCnt ; i += param.threadCnt)
+    for (i = startCut ; i < cutCnt ; i += param.threadCnt)
     {
-      // Load positions for current batch
-      if (param.printLog)
-        Utils::PrintLog("Extract %d chunks. (%lu/%lu chunks finished)", param.threadCnt, i, cutCnt) ;
-      for (j = 0 ; j < param.threadCnt ; ++j)
-      {
-        chunkThreadArgs[j].from = i ;
-        chunkThreadArgs[j].to = (i + param.threadCnt - 1 < n ? i + param.threadCnt - 1 : n - 1) ;
-        pthread_create(&threads[j], &attr, PosInChunk_Thread, (void *)(chunkThreadArgs + j)) ;
-        //PosInChunk_Thread((void *)(chunkThreadArgs + j)) ;
-      }
-
-      if (param.printLog)
-        Utils::PrintLog("Wait for the chunk extraction to finish.") ;
-      for (j = 0 ; j < param.threadCnt ; ++j)
-        pthread_join(threads[j], NULL) ;
-
       size_t chunkCnt = param.threadCnt ;
       if (i + chunkCnt >= cutCnt)
         chunkCnt = cutCnt - i ;
 
-      // concatenate the pos in the chunks
-      for (j = 0 ; j < chunkCnt ; ++j)
+      if (param.pfpWindow > 0)
       {
-        size_t totalSize = 0 ;
-        for (k = 0 ; k < param.threadCnt ; ++k)
-          totalSize += chunkThreadArgs[k].pos[j].size() ;
-        saChunkSize[j] = totalSize ; 
-        if (totalSize > saChunkCapacity[j])
+        for (j = 0 ; j < chunkCnt ; ++j)
         {
-          free(sa[j]) ;
-          saChunkCapacity[j] = totalSize ;
-          sa[j] = (size_t *)malloc(sizeof(sa[j]) * totalSize) ;
+          size_t size = MIN(param.saBlockSize, n - (i + j) * param.saBlockSize) ;
+          if (size > saChunkCapacity[j])
+          {
+            saChunkCapacity[j] = size ;
+            sa[j].Malloc(saElemLength, size) ;
+          }
+          saChunkSize[j] = pfParser.GetNextSA(sa[j], size) ;
         }
+      }
+      else
+      {
+        // Load positions for current batch
+        if (param.printLog)
+          Utils::PrintLog("Extract %d chunks. (%lu/%lu chunks finished)", param.threadCnt, i, cutCnt) ;
+        for (j = 0 ; j < param.threadCnt ; ++j)
+        {
+          chunkThreadArgs[j].from = i ;
+          chunkThreadArgs[j].to = (i + param.threadCnt - 1 < n ? i + param.threadCnt - 1 : n - 1) ;
+          pthread_create(&threads[j], &attr, PosInChunk_Thread, (void *)(chunkThreadArgs + j)) ;
+          //PosInChunk_Thread((void *)(chunkThreadArgs + j)) ;
+        }
+
+        if (param.printLog)
+          Utils::PrintLog("Wait for the chunk extraction to finish.") ;
+        for (j = 0 ; j < param.threadCnt ; ++j)
+          pthread_join(threads[j], NULL) ;
 
-        totalSize = 0 ;
-        for (k = 0 ; k < param.threadCnt ; ++k)
+        // concatenate the pos in the chunks
+        for (j = 0 ; j < chunkCnt ; ++j)
         {
-          memcpy(sa[j] + totalSize, chunkThreadArgs[k].pos[j].data(),
-              sizeof(sa[j][0]) * chunkThreadArgs[k].pos[j].size()) ;
-          totalSize += chunkThreadArgs[k].pos[j].size() ;
-          std::vector<size_t>().swap(chunkThreadArgs[k].pos[j]) ;
+          size_t totalSize = 0 ;
+          for (k = 0 ; k < param.threadCnt ; ++k)
+            totalSize += chunkThreadArgs[k].pos[j].GetSize() ;
+          saChunkSize[j] = totalSize ; 
+          if (totalSize > saChunkCapacity[j])
+          {
+            saChunkCapacity[j] = totalSize ;
+            sa[j].Malloc(saElemLength, totalSize) ;
+          }
+
+          totalSize = 0 ;
+          for (k = 0 ; k < param.threadCnt ; ++k)
+          {
+            sa[j].CopyFrom(totalSize, chunkThreadArgs[k].pos[j]) ;
+            totalSize += chunkThreadArgs[k].pos[j].GetSize() ;
+            chunkThreadArgs[k].pos[j].Free() ;
+          }
+        }
+      }
+
+      if (param.tmpPrefix != NULL)
+      {
+        size_t required = accuChunkSizeForSort - windowStart ;
+        for (j = 0 ; j < chunkCnt ; ++j)
+          required += saChunkSize[j] ;
+        if (required > windowCapacity)
+        {
+          if (windowCapacity == 0)
+            BWT.Malloc(alphabetBits, required) ;
+          else
+            BWT.Resize(required) ;
+          if (param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+            ; // the samples by text position are allocated for the whole text
+          else if (windowCapacity == 0)
+            param.sampledSA.Malloc(saElemLength, DIV_CEIL(required, param.sampleRate)) ;
+          else
+            param.sampledSA.Resize(DIV_CEIL(required, param.sampleRate)) ;
+          windowCapacity = required ;
         }
       }
 
@@ -524,11 +1104,12 @@ public:
       {
         if (param.printLog)
           Utils::PrintLog("Chunk %d elements: %llu", j, saChunkSize[j]) ;
-        saSortThreadArgs[j].sa = sa[j] ;
+        saSortThreadArgs[j].sa = sa + j ;
         saSortThreadArgs[j].saSize = saChunkSize[j] ;
         saSortThreadArgs[j].accuChunkSize = accuChunkSizeForSort ;
         accuChunkSizeForSort += saChunkSize[j] ;
-        pthread_create(&threads[j], &attr, SortSA_Thread, (void *)(saSortThreadArgs + j)) ;
+        if (param.pfpWindow == 0) // the chunks from prefix-free parsing are already sorted
+          pthread_create(&threads[j], &attr, SortSA_Thread, (void *)(saSortThreadArgs + j)) ;
         //SortSA_Thread( (void *)(saSortThreadArgs + j)) ;
       }
 
@@ -537,11 +1118,11 @@ public:
         Utils::PrintLog("Wait for the chunk sort to finish.") ;
       for (j = 0 ; j < chunkCnt ; ++j)
       {
-        pthread_join(threads[j], NULL) ;
+        if (param.pfpWindow == 0)
+          pthread_join(threads[j], NULL) ;
         
         if (param.dumpSaFp)
-          fwrite(saSortThreadArgs[j].sa, sizeof(saSortThreadArgs[j].sa[0]), 
-              saSortThreadArgs[j].saSize, param.dumpSaFp) ;
+          DumpSA(sa[j], saChunkSize[j], param.dumpSaFp) ;
       }
 
       // Process the information from the chunks. 
@@ -550,14 +1131,16 @@ public:
       
       for (j = 0 ; j < chunkCnt ; ++j)
       {
-        postprocessThreadArgs[j].saChunk = sa[j] ;
+        postprocessThreadArgs[j].saChunk = sa + j ;
         postprocessThreadArgs[j].saSize = saChunkSize[j] ;
         postprocessThreadArgs[j].accuChunkSize = saSortThreadArgs[j].accuChunkSize ;
+        postprocessThreadArgs[j].windowStart = windowStart ;
         
         // Variables that needed to simplify the overlap between previous chunk and current chunk.
         postprocessThreadArgs[j].skippedBWT = 0 ;
         postprocessThreadArgs[j].firstPrecomputeW = 0 ;
         postprocessThreadArgs[j].firstPrecomputeWLen = 0 ;
+        postprocessThreadArgs[j].firstPrecomputeWStart = 0 ;
         
         // the last element from previous chunk. 
         postprocessThreadArgs[j].prevChunkLastSA = lastSA ;
@@ -575,7 +1158,7 @@ public:
       {
         int l ; 
         //size_t size = postprocessThreadArgs[j].saSize ;
-        size_t *saChunk = postprocessThreadArgs[j].saChunk ;
+        const FixedByteElemArray &saChunk = *(postprocessThreadArgs[j].saChunk) ;
         size_t accuChunkSize = postprocessThreadArgs[j].accuChunkSize ;
 
         for (l = 0 ; l < postprocessThreadArgs[j].skippedBWT ; ++l)
@@ -585,17 +1168,22 @@ public:
           if (saChunk[l] == 0)
           {
             firstISA = bwtFilled ;
-            BWT.Write(bwtFilled, T.Read(n - 1)) ;
+            BWT.Write(bwtFilled - windowStart, T.Read(n - 1)) ;
           }
           else
-            BWT.Write(bwtFilled, T.Read( saChunk[l] - 1 ) ) ;
+            BWT.Write(bwtFilled - windowStart, T.Read( saChunk[l] - 1 ) ) ;
 
-          if (param.sampledSA != NULL && bwtFilled % param.sampleRate == 0)
-            param.sampledSA[bwtFilled / param.sampleRate] = saChunk[l] ;
+          if (param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+          {
+            if (saChunk[l] % param.sampleRate == 0)
+              param.sampledSA.Write(saChunk[l] / param.sampleRate, bwtFilled) ;
+          }
+          else if (param.sampledSA.GetSize() > 0 && bwtFilled % param.sampleRate == 0)
+            param.sampledSA.Write((bwtFilled - windowStart) / param.sampleRate, saChunk[l]) ;
         }
 
         // Fill the precomputew
-        if (param.precomputedRange != NULL)   
+        if (param.precomputedRange != NULL && postprocessThreadArgs[j].firstPrecomputeWLen > 0)   
         {
           WORD w = postprocessThreadArgs[j].firstPrecomputeW ;
           size_t wlen = postprocessThreadArgs[j].firstPrecomputeWLen ;
@@ -606,15 +1194,70 @@ public:
           else // This w is the first one to show up.
           {
             // This also handles that the same precompute w spans more than one chunk.
-            param.precomputedRange[w].first = accuChunkSize ;
+            param.precomputedRange[w].first = postprocessThreadArgs[j].firstPrecomputeWStart ;
             param.precomputedRange[w].second = wlen ;
           }
         }
 
         // TODO: Fill the lcp structure
       }
+
+      if (param.tmpPrefix != NULL)
+        windowStart = SpillWindow(BWT, param, windowStart, accuChunkSizeForSort, windowAlign, 
+            false, fpSpilledBWT, fpSpilledSampledSA) ;
+
+      if (useCheckpoint && i + chunkCnt < cutCnt 
+          && Utils::GetWallTime() - lastCheckpointTime >= param.checkpointInterval)
+      {
+        if (param.tmpPrefix == NULL)
+        {
+          // Append the newly finished BWT and sampled SA, aligned like the spilled window 
+          size_t persistEnd = accuChunkSizeForSort / windowAlign * windowAlign ;
+          fwrite(BWT.GetData() + persistedLen * alphabetBits / WORDBITS, sizeof(WORD), 
+              (persistEnd - persistedLen) * alphabetBits / WORDBITS, fpPersistedBWT) ;
+          fwrite(param.sampledSA.GetData() + persistedLen / param.sampleRate * saElemLength, saElemLength, 
+              (persistEnd - persistedLen) / param.sampleRate, fpPersistedSampledSA) ;
+          persistedLen = persistEnd ;
+        }
+        else
+          persistedLen = windowStart ;
+
+        struct _FMBuilderCheckpointState state ;
+        state.n = n ;
+        state.cutCnt = cutCnt ;
+        state.nextCut = i + chunkCnt ;
+        state.filled = accuChunkSizeForSort ;
+        state.lastSA = lastSA ;
+        state.firstISA = firstISA ;
+        state.persistedLen = persistedLen ;
+        WriteCheckpoint(state, BWT, windowStart, param, fpPersistedBWT, fpPersistedSampledSA) ;
+        lastCheckpointTime = Utils::GetWallTime() ;
+        if (param.printLog)
+          Utils::PrintLog("Saved the checkpoint with %lu/%lu chunks finished.", i + chunkCnt, cutCnt) ;
+      }
     } // end of the main while loop for populating BWTs
     
+    if (useCheckpoint && param.tmpPrefix == NULL)
+    {
+      fclose(fpPersistedBWT) ;
+      fclose(fpPersistedSampledSA) ;
+    }
+    
+    if (param.tmpPrefix != NULL)
+    {
+      SpillWindow(BWT, param, windowStart, n, windowAlign, true, 
+          fpSpilledBWT, fpSpilledSampledSA) ;
+      fclose(fpSpilledBWT) ;
+      if (fpSpilledSampledSA != NULL)
+        fclose(fpSpilledSampledSA) ;
+      BWT.Free() ;
+      if (param.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT)
+        param.sampledSA.Free() ;
+    }
+
+    if (param.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+      ArrangeTextSamplesByRow(param) ;
+    
     // Fill in the selectedSA from selectedISA.
     for (std::map<size_t, size_t>::iterator iter = param.selectedISA.begin() ;
         iter != param.selectedISA.end(); ++iter)
@@ -622,23 +1265,58 @@ public:
       param.selectedSA[iter->second] = iter->first ;
     }
     std::map<size_t, size_t>().swap(param.selectedISA) ; // ISA will not be useful
+    pfParser.Free() ;
 
     free(threads) ;
     pthread_attr_destroy(&attr) ;
-    delete[] chunkThreadArgs ;
     for (j = 0 ; j < param.threadCnt ; ++j)
-    {
-      if (sa[j] != NULL)
-      {
-        free(sa[j]) ;
-      }
-    }
-    free(sa) ;
+      delete[] chunkThreadArgs[j].pos ;
+    delete[] chunkThreadArgs ;
+    delete[] sa ;
     free(saChunkSize) ;
     free(saChunkCapacity) ;
     free(saSortThreadArgs) ;
     free(postprocessThreadArgs) ;
   }
+
+  // Load the BWT and sampled SA spilled by Build() when param.tmpPrefix is set,
+  //   and remove the temporary files. Call this after the text is released.
+  // Only the memory of the suffix sorting is reduced by spilling: the whole BWT and 
+  //   sampled SA are in memory again from here, see InferParametersGivenMemory.
+  static void LoadSpilledData(FixedSizeElemArray &BWT, int alphabetSize, 
+      struct _FMBuilderParam &param)
+  {
+    size_t n = param.n ;
+    char fileName[1024] ;
+    FILE *fp ;
+    
+    BWT.Malloc(Utils::Log2Ceil(alphabetSize), n) ;
+    fp = OpenSpillFile(param, "bwt", "rb") ;
+    size_t wordCnt = Utils::BitsToWords(n * BWT.GetElemLength()) ;
+    if (fread((WORD *)BWT.GetData(), sizeof(WORD), wordCnt, fp) != wordCnt)
+    {
+      Utils::PrintLog("Failed to read the BWT from the temporary file %s.bwt.tmp.", param.tmpPrefix) ;
+      exit(1) ;
+    }
+    fclose(fp) ;
+    sprintf(fileName, "%s.bwt.tmp", param.tmpPrefix) ;
+    remove(fileName) ;
+    
+    if (param.sampleStrategy != FM_SAMPLE_STRATEGY_TEXT) // otherwise, the sampled SA is not spilled
+    {
+      param.sampledSA.Malloc(FixedByteElemArray::GetElemLengthForValue(n), param.sampleSize) ;
+      fp = OpenSpillFile(param, "ssa", "rb") ;
+      if (fread((uint8_t *)param.sampledSA.GetData(), param.sampledSA.GetElemLength(), param.sampleSize, fp) 
+          != param.sampleSize)
+      {
+        Utils::PrintLog("Failed to read the sampled SA from the temporary file %s.ssa.tmp.", param.tmpPrefix) ;
+        exit(1) ;
+      }
+      fclose(fp) ;
+      sprintf(fileName, "%s.ssa.tmp", param.tmpPrefix) ;
+      remove(fileName) ;
+    }
+  }
 } ;
 }
 
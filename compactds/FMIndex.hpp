@@ -2,9 +2,14 @@
 #define _MOURISL_COMPACTDS_FM_INDEX
 
 #include <stdio.h>
+#include <pthread.h>
+
+#include <algorithm>
 
 #include "Alphabet.hpp"
 #include "FixedSizeElemArray.hpp"
+#include "Bitvector_Plain.hpp"
+#include "Bitvector_Sparse.hpp"
 #include "FMBuilder.hpp"
 
 // Auxiliary data, other than the BWT and F (alphabet partial sum), for FM index
@@ -14,10 +19,11 @@ struct _FMIndexAuxData
 {
   size_t n ; // the length of the text
 
-  int sampleStrategy ;
+  int sampleStrategy ; // FM_SAMPLE_STRATEGY_*
   int sampleRate ;
   size_t sampleSize ;
   FixedSizeElemArray sampledSA ;
+  Bitvector_Plain sampledRows ; // FM_SAMPLE_STRATEGY_TEXT: the rows having sampledSA, which is in the order of the rows
 
   // precomputedRange: the BWT range for a prefix of size param.precomputeWidth
   //                  The pair format is (the start position, and the length of the range).
@@ -31,7 +37,9 @@ struct _FMIndexAuxData
   WORD *semiLcpEqual ;
 
   size_t adjustedSA0 ;
-  std::map<size_t, size_t> selectedSA ; // SAs for speical purposes: e.g. boundary of genomes 
+  // SAs for speical purposes: e.g. boundary of genomes 
+  Bitvector_Sparse selectedSARows ; // the rows with selected SA
+  FixedSizeElemArray selectedSA ; // the selected SAs in the order of the rows
   WORD *selectedSAFilter ; // Quick test whether a SA could be selectedSA 
   int selectedSAFilterSampleRate ;
 
@@ -39,7 +47,7 @@ struct _FMIndexAuxData
 
   _FMIndexAuxData()
   {
-    sampleStrategy = 0 ;
+    sampleStrategy = FM_SAMPLE_STRATEGY_ROW ;
     sampleRate = 0 ;
     sampleSize = 0 ;
     precomputeWidth = 0 ;
@@ -65,6 +73,7 @@ struct _FMIndexAuxData
   void Free()
   {
     sampledSA.Free() ;
+    sampledRows.Free() ;
     
     if (precomputedRange)
     {
@@ -80,15 +89,68 @@ struct _FMIndexAuxData
       semiLcpEqual = NULL ;
     }
 
-    if (selectedSA.size() > 0)
+    if (selectedSAFilter)
     {
-      selectedSA.clear() ;
+      selectedSARows.Free() ;
+      selectedSA.Free() ;
       free(selectedSAFilter) ;
+      selectedSAFilter = NULL ;
+    }
+  }
+
+  // rows: sorted rows with the selected SA
+  void InitSelectedSA(const size_t *rows, const size_t *values, size_t size)
+  {
+    size_t i ;
+    if (size == 0)
+      return ;
+    
+    int valueBits = 1 ;
+    for (i = 0 ; i < size ; ++i)
+    {
+      int bitCounts = Utils::CountBits(values[i]) ;
+      if (bitCounts > valueBits)
+        valueBits = bitCounts ;
     }
+    selectedSA.Malloc(valueBits, size) ;
+    for (i = 0 ; i < size ; ++i)
+      selectedSA.Write64(i, values[i]) ;
+
+    selectedSARows.SetSupportRank(true) ;
+    selectedSARows.InitFromOnes(rows, size, n) ;
+    
+    selectedSAFilter = Utils::MallocByBits(DIV_CEIL(n, selectedSAFilterSampleRate)) ; 
+    for (i = 0 ; i < size ; ++i)
+      Utils::BitSet(selectedSAFilter, rows[i] / selectedSAFilterSampleRate) ;
+  }
+
+  size_t GetSelectedSACount() const
+  {
+    return selectedSA.GetSize() ;
+  }
+  
+  // Get the k-th (0-based) selected SA and its row
+  void GetSelectedSA(size_t k, size_t &row, size_t &sa) const
+  {
+    row = selectedSARows.Select(k + 1) ;
+    sa = selectedSA.Read(k) ;
+  }
+
+  // @return: whether row i has selected SA, which is returned through sa
+  bool SearchSelectedSA(size_t i, size_t &sa) const
+  {
+    size_t rank ;
+    if (selectedSAFilter == NULL 
+        || !Utils::BitRead(selectedSAFilter, i / selectedSAFilterSampleRate)
+        || !selectedSARows.AccessAndRank(i, rank))
+      return false ;
+    sa = selectedSA.Read(rank - 1) ;
+    return true ;
   }
 
   void Save(FILE *fp) 
   {
+    size_t i ;
     SAVE_VAR(fp, n) ;
     SAVE_VAR(fp, sampleStrategy) ;
     SAVE_VAR(fp, sampleRate) ;
@@ -98,6 +160,8 @@ struct _FMIndexAuxData
     SAVE_VAR(fp, adjustedSA0) ;
 
     sampledSA.Save(fp) ;
+    if (sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+      sampledRows.Save(fp) ;
     SAVE_ARR(fp, precomputedRange, precomputeSize) ;
 
     SAVE_VAR(fp, maxLcp) ;
@@ -108,18 +172,22 @@ struct _FMIndexAuxData
     }
 
     // For speical SAs
-    size_t tmpSize = selectedSA.size() ;
+    size_t tmpSize = GetSelectedSACount() ;
     SAVE_VAR(fp, tmpSize) ;
     SAVE_VAR(fp, selectedSAFilterSampleRate) ;
-    for (std::map<size_t, size_t>::iterator iter = selectedSA.begin() ;
-        iter != selectedSA.end() ; ++iter)
+    for (i = 0 ; i < tmpSize ; ++i)
     {
-      size_t pair[2] = {iter->first, iter->second} ;
+      size_t pair[2] ;
+      GetSelectedSA(i, pair[0], pair[1]) ;
       fwrite(pair, sizeof(size_t), 2, fp) ;
     }
   }
 
-  void Load(FILE *fp)
+  // loadSampleRate: keep the sampled SA only for every loadSampleRate rows. 
+  //   0 or no larger than sampleRate: keep all. 
+  //   Not for the text strategy: the sampled values may not be text positions (e.g., sequence ids), 
+  //   so the samples cannot be thinned by their text positions.
+  void Load(FILE *fp, int loadSampleRate = 0)
   {
     Free() ;
     size_t i ;
@@ -132,7 +200,33 @@ struct _FMIndexAuxData
     LOAD_VAR(fp, precomputeSize) ;
     LOAD_VAR(fp, adjustedSA0) ;
 
-    sampledSA.Load(fp) ; 
+    // The sample rates are powers of 2, so k is an integer.
+    int k = 1 ;
+    if (loadSampleRate > sampleRate)
+      k = loadSampleRate / sampleRate ;
+    if (k > 1 && sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+    {
+      Utils::PrintLog("ERROR: the sampled SA by text positions cannot be subsampled at loading.") ;
+      exit(1) ;
+    }
+    if (k > 1)
+    {
+      // The kept rows are multiples of sampleRate*k, i.e., every k-th entry.
+      size_t space = sampledSA.LoadSubsampled(fp, k) ;
+      sampleSize = sampledSA.GetSize() ;
+      if (printLog)
+      {
+        Utils::PrintLog("Sampled SA every %d rows instead of %d: saves %llu bytes, and each locate takes about %d more LF steps on average.", 
+            sampleRate * k, sampleRate, (unsigned long long)space, sampleRate * (k - 1)) ;
+      }
+      sampleRate *= k ;
+    }
+    else
+    {
+      sampledSA.Load(fp) ; 
+      if (sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+        sampledRows.Load(fp) ;
+    }
     precomputedRange = (std::pair<size_t, size_t> *)malloc(
         sizeof(std::pair<size_t, size_t>) * precomputeSize) ;
     LOAD_ARR(fp, precomputedRange, precomputeSize) ;
@@ -151,19 +245,120 @@ struct _FMIndexAuxData
     LOAD_VAR(fp, selectedSAFilterSampleRate) ;
     if (tmpSize > 0)
     {
-      selectedSAFilter = Utils::MallocByBits(DIV_CEIL(n, selectedSAFilterSampleRate)) ; 
+      size_t *pairs = (size_t *)malloc(sizeof(size_t) * 2 * tmpSize) ;
+      fread(pairs, sizeof(size_t), 2 * tmpSize, fp) ;
+      size_t *rows = (size_t *)malloc(sizeof(size_t) * tmpSize) ;
+      size_t *values = (size_t *)malloc(sizeof(size_t) * tmpSize) ;
       for (i = 0 ; i < tmpSize ; ++i)
       {
-        size_t pair[2] ;
-        fread(pair, sizeof(size_t), 2, fp) ;
-        selectedSA[pair[0]] = pair[1] ;
-        Utils::BitSet(selectedSAFilter, pair[0] / selectedSAFilterSampleRate) ;
+        rows[i] = pairs[2 * i] ;
+        values[i] = pairs[2 * i + 1] ;
       }
+      free(pairs) ;
+      InitSelectedSA(rows, values, tmpSize) ;
+      free(rows) ;
+      free(values) ;
     }
   }
 } ;
 
+struct _FMIndexCountAlphabetThreadArg
+{
+  int tid ;
+  int threadCnt ;
+  const FixedSizeElemArray *BWT ;
+  size_t n ;
+  int alphabetSize ;
+  size_t *count ; // the alphabet count in this thread's portion of BWT
+} ;
+
+struct _FMIndexExtendPrecomputeThreadArg
+{
+  int tid ;
+  int threadCnt ;
+  void *fm ;
+} ;
+
+// The alphabet coding and the BWT queries used in FMIndex.
+// FixedAlphabet=void: the runtime Alphabet in the FM index and the generic interface of SeqClass.
+// Otherwise: the compile-time alphabet like Alphabet_DNA, and SeqClass should provide
+//   the code-based AccessCodeAndRank<L>, RankCode<L> and RankCodePair<L>.
+template <class SeqClass, class FixedAlphabet>
+struct _FMIndexAlphabetOps
+{
+  static WORD Encode(const Alphabet &coder, ALPHABET c)
+  {
+    return FixedAlphabet::Encode(c) ;
+  }
+
+  static bool IsIn(const Alphabet &alphabets, ALPHABET c)
+  {
+    return FixedAlphabet::IsIn(c) ;
+  }
+
+  static bool IsCompatible(const Alphabet &alphabets)
+  {
+    return FixedAlphabet::IsCompatible(alphabets) ;
+  }
+
+  // Return the code of BWT[i], and also the character through c and its rank in BWT[0..i] through rank
+  static WORD AccessAndRank(const SeqClass &BWT, const Alphabet &coder, size_t i, ALPHABET &c, size_t &rank)
+  {
+    WORD code = BWT.template AccessCodeAndRank<FixedAlphabet::CODE_LEN>(i, rank) ;
+    c = FixedAlphabet::Decode(code) ;
+    return code ;
+  }
+
+  static size_t Rank(const SeqClass &BWT, ALPHABET c, WORD code, size_t i, int inclusive)
+  {
+    return BWT.template RankCode<FixedAlphabet::CODE_LEN>(code, i, inclusive) ;
+  }
+
+  // The inclusive ranks at i and j (i <= j)
+  static void RankPair(const SeqClass &BWT, ALPHABET c, WORD code, size_t i, size_t j, size_t &ri, size_t &rj)
+  {
+    BWT.template RankCodePair<FixedAlphabet::CODE_LEN>(code, i, j, ri, rj) ;
+  }
+} ;
+
 template <class SeqClass>
+struct _FMIndexAlphabetOps<SeqClass, void>
+{
+  static WORD Encode(const Alphabet &coder, ALPHABET c)
+  {
+    return coder.Encode(c) ;
+  }
+
+  static bool IsIn(const Alphabet &alphabets, ALPHABET c)
+  {
+    return alphabets.IsIn(c) ;
+  }
+
+  static bool IsCompatible(const Alphabet &alphabets)
+  {
+    return true ;
+  }
+
+  static WORD AccessAndRank(const SeqClass &BWT, const Alphabet &coder, size_t i, ALPHABET &c, size_t &rank)
+  {
+    c = BWT.AccessAndRank(i, rank) ;
+    return coder.Encode(c) ;
+  }
+
+  static size_t Rank(const SeqClass &BWT, ALPHABET c, WORD code, size_t i, int inclusive)
+  {
+    return BWT.Rank(c, i, inclusive) ;
+  }
+
+  static void RankPair(const SeqClass &BWT, ALPHABET c, WORD code, size_t i, size_t j, size_t &ri, size_t &rj)
+  {
+    BWT.RankPair(c, i, j, ri, rj) ;
+  }
+} ;
+
+// FixedAlphabet: void for the alphabet given at runtime, or a compile-time
+//   alphabet (Alphabet_DNA) to specialize the search operations.
+template <class SeqClass, class FixedAlphabet = void>
 class FMIndex
 {
 private:
@@ -175,6 +370,50 @@ private:
   size_t _plainAlphabetBits ; // Needed for coding index accessing precomputedRange
   size_t _firstISA ; // ISA[0]
   ALPHABET _lastChr ; // last character in the original text 
+  WORD _lastChrCode ; // plain code of _lastChr
+
+  // The wider lookup table built after loading the index, tried before precomputedRange.
+  // It is not part of the index file.
+  // Entry w is the (start, length) pair at elements 2w and 2w+1, each taking log2(n+1) bits.
+  size_t _extPrecomputeWidth ;
+  size_t _extPrecomputeSize ;
+  FixedSizeElemArray _extPrecomputedRange ;
+
+  typedef _FMIndexAlphabetOps<SeqClass, FixedAlphabet> AlphabetOps ;
+
+  void CheckFixedAlphabet()
+  {
+    if (!AlphabetOps::IsCompatible(_alphabets) || !AlphabetOps::IsCompatible(_plainAlphabetCoder))
+    {
+      Utils::PrintLog("The alphabet of the FM index does not match the compile-time alphabet.") ;
+      exit(1) ;
+    }
+  }
+
+  // Since we do not use $, the last character in the original string 
+  //   will be moved to the _firstISA instead of the first position
+  //   We need to move this back for the rank of the code.
+  // Potential future refactoring: appending an A to the end of the string
+  size_t LastChrRankAdjustment(WORD code, size_t p, int inclusive)
+  {
+    return (code == _lastChrCode && (p < _firstISA || (!inclusive && p == _firstISA))) ? 1 : 0 ;
+  }
+
+  // Rank with both the character and its plain code, so each path can use its preferred one.
+  size_t RankCode(ALPHABET c, WORD code, size_t p, int inclusive)
+  {
+    return AlphabetOps::Rank(_BWT, c, code, p, inclusive) 
+      + LastChrRankAdjustment(code, p, inclusive) ;
+  }
+
+  // LF mapping from row p, the character and its rank come from one traversal of BWT
+  size_t LF(size_t p)
+  {
+    ALPHABET c ;
+    size_t rank ;
+    WORD code = AlphabetOps::AccessAndRank(_BWT, _plainAlphabetCoder, p, c, rank) ;
+    return _plainAlphabetPartialSum[code] + rank + LastChrRankAdjustment(code, p, 1) - 1 ;
+  }
   
   // @return: whether SA[i] information is stored
   // the SA information is returned through the reference sa 
@@ -185,22 +424,118 @@ private:
       sa = _auxData.adjustedSA0 ;
       return true ;
     }
+    
+    if (_auxData.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+    {
+      size_t rank ;
+      if (_auxData.sampledRows.AccessAndRank(i, rank))
+      {
+        sa = _auxData.sampledSA[rank - 1] ;
+        return true ;
+      }
+    }
     else if (i % _auxData.sampleRate == 0)
     {
       sa = _auxData.sampledSA[i / _auxData.sampleRate] ;
       return true ;
     }
-    else if (_auxData.selectedSAFilter)
+    
+    return _auxData.SearchSelectedSA(i, sa) ;
+  }
+  static void *CountAlphabet_Thread(void *arg)
+  {
+    struct _FMIndexCountAlphabetThreadArg *pArg = (struct _FMIndexCountAlphabetThreadArg *)arg ;
+    size_t i ;
+    size_t segLen = DIV_CEIL(pArg->n, pArg->threadCnt) ;
+    size_t from = segLen * pArg->tid ;
+    size_t to = MIN(from + segLen, pArg->n) ;
+    memset(pArg->count, 0, sizeof(pArg->count[0]) * pArg->alphabetSize) ;
+    for (i = from ; i < to ; ++i)
+      ++pArg->count[pArg->BWT->Read(i)] ;
+    pthread_exit(NULL) ;
+  }
+
+  // Fill the entries of the extended table under the prefix code w of length depth,
+  //   the range of w is [sp, ep].
+  void FillExtendedPrecomputedRange(WORD w, size_t depth, size_t sp, size_t ep)
+  {
+    if (depth == _extPrecomputeWidth)
     {
-      if (Utils::BitRead(_auxData.selectedSAFilter,  i / _auxData.selectedSAFilterSampleRate)
-          && (_auxData.selectedSA.find(i) != _auxData.selectedSA.end()))
+      _extPrecomputedRange.Write64(2 * w, sp) ;
+      _extPrecomputedRange.Write64(2 * w + 1, ep - sp + 1) ;
+      return ;
+    }
+
+    const int alphabetSize = _plainAlphabetCoder.GetSize() ;
+    size_t nextSp, nextEp ;
+    int c ;
+    for (c = 0 ; c < alphabetSize ; ++c)
+    {
+      BackwardExtend(_plainAlphabetCoder.Decode(c, _plainAlphabetBits), sp, ep, nextSp, nextEp) ;
+      if (nextSp > nextEp || nextEp > _n)
+        continue ;
+      FillExtendedPrecomputedRange((w << _plainAlphabetBits) | c, depth + 1, nextSp, nextEp) ;
+    }
+  }
+
+  static void *ExtendPrecomputedRange_Thread(void *arg)
+  {
+    struct _FMIndexExtendPrecomputeThreadArg *pArg = (struct _FMIndexExtendPrecomputeThreadArg *)arg ;
+    FMIndex *fm = (FMIndex *)(pArg->fm) ;
+    size_t i, j ;
+    // Interleave the blocks of the original table, as their ranges have uneven sizes.
+    // A block of 32 entries extends to a multiple of 64 elements in the packed table, 
+    //   so the threads do not write to the same word.
+    const size_t blockSize = 32 ;
+    const size_t precomputeSize = fm->_auxData.precomputeSize ;
+    for (i = pArg->tid * blockSize ; i < precomputeSize ; i += pArg->threadCnt * blockSize)
+    {
+      for (j = i ; j < i + blockSize && j < precomputeSize ; ++j)
       {
-        sa = _auxData.selectedSA[i] ;
-        return true ;
+        if (fm->_auxData.precomputedRange[j].second == 0)
+          continue ;
+        size_t sp = fm->_auxData.precomputedRange[j].first ;
+        fm->FillExtendedPrecomputedRange(j, fm->_auxData.precomputeWidth, sp,
+            sp + fm->_auxData.precomputedRange[j].second - 1) ;
       }
     }
+    pthread_exit(NULL) ;
+  }
 
-    return false ;
+  // Count the occurrence of each alphabet in BWT into count
+  void CountAlphabet(const FixedSizeElemArray &BWT, size_t n, int alphabetSize, int threadCnt, size_t *count)
+  {
+    size_t i ;
+    int t, c ;
+    if (threadCnt <= 1)
+    {
+      for (i = 0 ; i < n ; ++i)
+        ++count[BWT.Read(i)] ; 
+      return ;
+    }
+    
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * threadCnt) ;
+    struct _FMIndexCountAlphabetThreadArg *args = (struct _FMIndexCountAlphabetThreadArg *)
+      malloc(sizeof(struct _FMIndexCountAlphabetThreadArg) * threadCnt) ;
+    for (t = 0 ; t < threadCnt ; ++t)
+    {
+      args[t].tid = t ;
+      args[t].threadCnt = threadCnt ;
+      args[t].BWT = &BWT ;
+      args[t].n = n ;
+      args[t].alphabetSize = alphabetSize ;
+      args[t].count = (size_t *)malloc(sizeof(size_t) * alphabetSize) ;
+      pthread_create(&threads[t], NULL, CountAlphabet_Thread, (void *)(args + t)) ;
+    }
+    for (t = 0 ; t < threadCnt ; ++t)
+    {
+      pthread_join(threads[t], NULL) ;
+      for (c = 0 ; c < alphabetSize ; ++c)
+        count[c] += args[t].count[c] ;
+      free(args[t].count) ;
+    }
+    free(threads) ;
+    free(args) ;
   }
 public:
   struct _FMIndexAuxData _auxData ; // the data used for locate operation
@@ -208,6 +543,8 @@ public:
   FMIndex() 
   {
     _n = 0 ;
+    _extPrecomputeWidth = 0 ;
+    _extPrecomputeSize = 0 ;
   }
   
   ~FMIndex() 
@@ -225,6 +562,12 @@ public:
     _BWT.SetExtraParameter(p) ;
   }
 
+  // The BWT sequence, e.g. to set the options specific to SeqClass before Init
+  SeqClass &GetBWTSequence()
+  {
+    return _BWT ;
+  }
+
   void Free()
   {
     if (_n > 0)
@@ -233,6 +576,113 @@ public:
       free(_plainAlphabetPartialSum) ;
       _auxData.Free() ;
     }
+    FreeExtendedPrecomputedRange() ;
+  }
+
+  void FreeExtendedPrecomputedRange()
+  {
+    _extPrecomputedRange.Free() ;
+    _extPrecomputeWidth = 0 ;
+    _extPrecomputeSize = 0 ;
+  }
+
+  // The space of the table for width, 0 if width does not extend precomputedRange
+  size_t GetExtendedPrecomputedRangeSpace(size_t width)
+  {
+    if (width <= _auxData.precomputeWidth || _auxData.precomputeWidth == 0)
+      return 0 ;
+    return Utils::BitsToWords((size_t)2 * Utils::Log2Ceil(_n + 1) << (_plainAlphabetBits * width)) * sizeof(WORD) ;
+  }
+
+  // Build the lookup table for the prefixes of length width from the loaded index,
+  //   by extending each range in precomputedRange. 
+  // The search uses it in place of precomputedRange, so the index needs no rebuilding 
+  //   for a larger precomputeWidth.
+  void InitExtendedPrecomputedRange(size_t width, int threadCnt)
+  {
+    int t ;
+    FreeExtendedPrecomputedRange() ;
+    if (GetExtendedPrecomputedRangeSpace(width) == 0)
+      return ;
+    _extPrecomputeWidth = width ;
+    _extPrecomputeSize = 1ull << (_plainAlphabetBits * width) ;
+    // The empty entries are left as 0
+    _extPrecomputedRange.Malloc(Utils::Log2Ceil(_n + 1), 2 * _extPrecomputeSize) ;
+    
+    if (threadCnt < 1)
+      threadCnt = 1 ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * threadCnt) ;
+    struct _FMIndexExtendPrecomputeThreadArg *args = (struct _FMIndexExtendPrecomputeThreadArg *)
+      malloc(sizeof(struct _FMIndexExtendPrecomputeThreadArg) * threadCnt) ;
+    for (t = 0 ; t < threadCnt ; ++t)
+    {
+      args[t].tid = t ;
+      args[t].threadCnt = threadCnt ;
+      args[t].fm = this ;
+      pthread_create(&threads[t], NULL, ExtendPrecomputedRange_Thread, (void *)(args + t)) ;
+    }
+    for (t = 0 ; t < threadCnt ; ++t)
+      pthread_join(threads[t], NULL) ;
+    free(threads) ;
+    free(args) ;
+  }
+
+  // The checksum of the alphabet counts (the C array) and 4096 evenly spaced BWT characters, 
+  //   which tells apart the indexes with the same size and ISA[0] without reading the whole BWT.
+  uint64_t GetExtendedPrecomputedRangeChecksum()
+  {
+    size_t i ;
+    const int alphabetSize = _plainAlphabetCoder.GetSize() ;
+    uint64_t checksum = 14695981039346656037ull ; // FNV-1a
+    for (i = 0 ; i <= (size_t)alphabetSize ; ++i)
+      checksum = (checksum ^ _plainAlphabetPartialSum[i]) * 1099511628211ull ;
+    const size_t step = DIV_CEIL(_n, 4096) ;
+    for (i = 0 ; i < _n ; i += step)
+      checksum = (checksum ^ (uint64_t)_BWT.Access(i)) * 1099511628211ull ;
+    return checksum ;
+  }
+
+  // The extended table is saved with the index size, ISA[0] and the checksum above
+  //   to tell whether it comes from the same index.
+  void SaveExtendedPrecomputedRange(FILE *fp)
+  {
+    uint64_t checksum = GetExtendedPrecomputedRangeChecksum() ;
+    int elemLength = _extPrecomputedRange.GetElemLength() ;
+    SAVE_VAR(fp, _extPrecomputeWidth) ;
+    SAVE_VAR(fp, _n) ;
+    SAVE_VAR(fp, _firstISA) ;
+    SAVE_VAR(fp, checksum) ;
+    SAVE_VAR(fp, elemLength) ;
+    SAVE_ARR(fp, _extPrecomputedRange.GetData(), 
+        Utils::BitsToWords((size_t)elemLength * _extPrecomputedRange.GetSize())) ;
+  }
+
+  // @return: whether the table in fp is for width and this index
+  bool LoadExtendedPrecomputedRange(FILE *fp, size_t width)
+  {
+    size_t fileWidth = 0, n = 0, firstISA = 0 ;
+    uint64_t checksum = 0 ;
+    int elemLength = 0 ;
+    FreeExtendedPrecomputedRange() ;
+    if (GetExtendedPrecomputedRangeSpace(width) == 0)
+      return false ;
+    if (LOAD_VAR(fp, fileWidth) != 1 || LOAD_VAR(fp, n) != 1 || LOAD_VAR(fp, firstISA) != 1
+        || LOAD_VAR(fp, checksum) != 1 || LOAD_VAR(fp, elemLength) != 1
+        || fileWidth != width || n != _n || firstISA != _firstISA 
+        || checksum != GetExtendedPrecomputedRangeChecksum() || elemLength != Utils::Log2Ceil(_n + 1))
+      return false ;
+
+    size_t size = 1ull << (_plainAlphabetBits * width) ;
+    _extPrecomputedRange.Malloc(elemLength, 2 * size) ;
+    size_t words = Utils::BitsToWords((size_t)elemLength * 2 * size) ;
+    if (LOAD_ARR(fp, (WORD *)_extPrecomputedRange.GetData(), words) != words)
+    {
+      FreeExtendedPrecomputedRange() ;
+      return false ;
+    }
+    _extPrecomputeWidth = width ;
+    _extPrecomputeSize = size ;
+    return true ;
   }
 
   void InitAuxData(struct _FMBuilderParam &builderParam)
@@ -243,8 +693,27 @@ public:
     _auxData.sampleSize = builderParam.sampleSize ;
     _auxData.sampleStrategy = builderParam.sampleStrategy ;
     //_auxData.sampledSA = builderParam.sampledSA ;
-    _auxData.sampledSA.InitFromArray(0, builderParam.sampledSA, _auxData.sampleSize) ;
-    free(builderParam.sampledSA) ;
+    size_t i ;
+    int sampledSABits = 1 ;
+    for (i = 0 ; i < _auxData.sampleSize ; ++i)
+    {
+      int bitCounts = Utils::CountBits(builderParam.sampledSA[i]) ;
+      if (bitCounts > sampledSABits)
+        sampledSABits = bitCounts ;
+    }
+    _auxData.sampledSA.Malloc(sampledSABits, _auxData.sampleSize) ;
+    for (i = 0 ; i < _auxData.sampleSize ; ++i)
+      _auxData.sampledSA.Write64(i, builderParam.sampledSA[i]) ;
+    builderParam.sampledSA.Free() ;
+    if (_auxData.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+    {
+      // The bit and its rank are tested together for each LF step when locating
+      _auxData.sampledRows.SetSelectSpeed(DS_SELECT_SPEED_NO) ;
+      _auxData.sampledRows.SetRankLayout(BITVECTOR_RANK_LAYOUT_INTERLEAVED) ;
+      _auxData.sampledRows.Init(builderParam.sampledRows, _auxData.n) ;
+      free(builderParam.sampledRows) ;
+      builderParam.sampledRows = NULL ;
+    }
     
     _auxData.precomputeWidth = builderParam.precomputeWidth ;
     _auxData.precomputeSize = builderParam.precomputeSize ;
@@ -258,16 +727,15 @@ public:
 
     if (builderParam.selectedSA.size() > 0)
     {
-      _auxData.selectedSAFilter = Utils::MallocByBits(DIV_CEIL(_auxData.n, 
-            _auxData.selectedSAFilterSampleRate)) ; 
-      
-      _auxData.selectedSA = builderParam.selectedSA ;
-      for (std::map<size_t, size_t>::iterator iter = _auxData.selectedSA.begin() ;
-                    iter != _auxData.selectedSA.end(); ++iter)
+      std::vector<size_t> rows ;
+      std::vector<size_t> values ;
+      for (std::map<size_t, size_t>::iterator iter = builderParam.selectedSA.begin() ;
+                    iter != builderParam.selectedSA.end(); ++iter)
       {
-        Utils::BitSet(_auxData.selectedSAFilter, 
-            iter->first / _auxData.selectedSAFilterSampleRate) ;
+        rows.push_back(iter->first) ;
+        values.push_back(iter->second) ;
       }
+      _auxData.InitSelectedSA(rows.data(), values.data(), rows.size()) ;
     }
   }
 
@@ -287,10 +755,13 @@ public:
     _n = n ;
     _firstISA = firstISA ;
     _lastChr = alphabetMapping[ BWT.Read(firstISA) ] ;
+    _lastChrCode = BWT.Read(firstISA) ;
+    CheckFixedAlphabet() ;
     InitAuxData(builderParam) ;
 
     // L list
     _BWT.SetAlphabet(_alphabets) ;
+    _BWT.SetThreadCnt(builderParam.threadCnt) ;
     _BWT.Init(BWT, n, alphabetMapping) ;
     if (_auxData.printLog)
       _BWT.PrintStats() ;
@@ -298,10 +769,7 @@ public:
     // F list
     _plainAlphabetPartialSum = (size_t *)calloc(alphabetSize + 1,
         sizeof(*_plainAlphabetPartialSum)) ;
-    for (i = 0 ; i < n ; ++i)
-    {
-      ++_plainAlphabetPartialSum[BWT.Read(i)] ; 
-    }
+    CountAlphabet(BWT, n, alphabetSize, builderParam.threadCnt, _plainAlphabetPartialSum) ;
     for (i = 1 ; (int)i < alphabetSize ; ++i)
       _plainAlphabetPartialSum[i] += _plainAlphabetPartialSum[i - 1] ;
     for (i = alphabetSize ; i >= 1 ; --i)
@@ -311,60 +779,98 @@ public:
 
   size_t Rank(ALPHABET c, size_t p, int inclusive = 1)
   {
-    size_t ret = _BWT.Rank(c, p, inclusive) ;
-    // Since we do not use $, the last character in the original string 
-    //   will be moved to the _firstISA instead of the first position
-    //   We need to move this back
-    // Potential future refactoring: appending an A to the end of the string
-    if (c == _lastChr && (p < _firstISA || (!inclusive && p == _firstISA)))
-      ++ret ;
-    return ret ;
+    return RankCode(c, AlphabetOps::Encode(_plainAlphabetCoder, c), p, inclusive) ;
   }
 
   void BackwardExtend(ALPHABET c, size_t sp, size_t ep, 
       size_t &nextSp, size_t &nextEp)
   {
-    size_t offset = _plainAlphabetPartialSum[ _plainAlphabetCoder.Encode(c) ] ; 
+    WORD code = AlphabetOps::Encode(_plainAlphabetCoder, c) ;
+    size_t offset = _plainAlphabetPartialSum[code] ; 
+    if (sp == ep)
+    {
+      // The range stays non-empty only if BWT[sp]==c, 
+      //   and then the rank comes with the access.
+      ALPHABET spc ;
+      size_t rank ;
+      if (AlphabetOps::AccessAndRank(_BWT, _plainAlphabetCoder, sp, spc, rank) == code)
+      {
+        nextSp = offset + rank - 1 + LastChrRankAdjustment(code, sp, /*inclusive=*/0) ;
+        nextEp = nextSp ;
+        return ;
+      }
+    }
     //printf("%c: %d %d %d. %d %d\n", c, offset, sp, ep, _BWT.Rank(c, sp, 0),
     //    _BWT.Rank(c, ep)) ;
     // Need minus 1 here because the return of Rank is 1-based.
-    nextSp = offset + Rank(c, sp, /*inclusive=*/0) + 1 - 1 ;
-    
     // TODO: Fix a potential issue of underflow.
     //       Now it is handled by out side
+    if (sp != ep && sp > 0)
+    {
+      // The ranks of sp and ep are from one traversal of BWT.
+      // The rank of sp is non-inclusive, which is the inclusive rank of sp-1.
+      size_t rankSp, rankEp ;
+      AlphabetOps::RankPair(_BWT, c, code, sp - 1, ep, rankSp, rankEp) ;
+      nextSp = offset + rankSp + LastChrRankAdjustment(code, sp, /*inclusive=*/0) ;
+      nextEp = offset + rankEp + LastChrRankAdjustment(code, ep, 1) - 1 ;
+      return ;
+    }
+
+    nextSp = offset + RankCode(c, code, sp, /*inclusive=*/0) + 1 - 1 ;
     if (sp != ep)
-      nextEp = offset + Rank(c, ep) - 1 ;
+      nextEp = offset + RankCode(c, code, ep, 1) - 1 ;
     else
-      nextEp = nextSp + ((_BWT.Access(ep) == c) ? 0 : -1) ;
+      nextEp = nextSp - 1 ;
   }
 
   // This one is essentially LF mapping 
   size_t BackwardExtend(ALPHABET c, size_t p)
   {
-    size_t offset = _plainAlphabetPartialSum[ _plainAlphabetCoder.Encode(c) ] ;
-    return offset + Rank(c, p) - 1 ;
+    WORD code = AlphabetOps::Encode(_plainAlphabetCoder, c) ;
+    return _plainAlphabetPartialSum[code] + RankCode(c, code, p, 1) - 1 ;
   }
 
   // m - length of s
   // Return the [sp, ep] through the option, and the length of matched prefix in size_t
+  COMPACTDS_TARGET_CLONES
   size_t BackwardSearch(char *s, size_t m, size_t &sp, size_t &ep)
   {
     size_t i ;
     if (m < _auxData.precomputeWidth)
       return 0 ;
 
+    // Only use the extended table when it has the range, otherwise the search 
+    //   below finds the exact matched length.
+    if (_extPrecomputeWidth > 0 && m >= _extPrecomputeWidth)
+    {
+      WORD initW = 0 ;
+      for (i = 0 ; i < _extPrecomputeWidth ; ++i)
+      {
+        if (!AlphabetOps::IsIn(_alphabets, s[m - 1 - i]))
+          break ;
+        initW = (initW << _plainAlphabetBits) | AlphabetOps::Encode(_plainAlphabetCoder, s[m - 1 - i]) ;
+      }
+      size_t len = 0 ;
+      if (i == _extPrecomputeWidth && (len = _extPrecomputedRange.Read(2 * initW + 1)) > 0)
+      {
+        sp = _extPrecomputedRange.Read(2 * initW) ;
+        ep = sp + len - 1 ;
+        return ExtendMatch(s, m, _extPrecomputeWidth, sp, ep) ;
+      }
+    }
+
     if (_auxData.precomputeWidth > 0)
     {
       WORD initW = 0 ;
       for (i = 0 ; i < _auxData.precomputeWidth ; ++i)
       {
-        if (!_alphabets.IsIn(s[m - 1 - i]))
+        if (!AlphabetOps::IsIn(_alphabets, s[m - 1 - i]))
         {
           sp = 1 ;
           ep = 0 ;
           return i ;
         }
-        initW = (initW << _plainAlphabetBits) | (_plainAlphabetCoder.Encode(s[m - 1 - i])) ;
+        initW = (initW << _plainAlphabetBits) | AlphabetOps::Encode(_plainAlphabetCoder, s[m - 1 - i]) ;
       }
       
       if (_auxData.precomputedRange[initW].second == 0)
@@ -382,12 +888,27 @@ public:
       ep = _n - 1 ;
     }
 
-    size_t l = _auxData.precomputeWidth ; 
+    return ExtendMatch(s, m, _auxData.precomputeWidth, sp, ep) ;
+  }
+
+  // Continue the backward search when the suffix of s with length l
+  //   is already matched and its range is [sp, ep].
+  // Return the length of matched prefix and the range through the option
+  COMPACTDS_TARGET_CLONES
+  size_t BackwardSearchFrom(char *s, size_t m, size_t l, size_t &sp, size_t &ep)
+  {
+    return ExtendMatch(s, m, l, sp, ep) ;
+  }
+
+  // The search loop shared by BackwardSearch and BackwardSearchFrom, 
+  //   not cloned itself so it is inlined into the caller's variant.
+  size_t ExtendMatch(char *s, size_t m, size_t l, size_t &sp, size_t &ep)
+  {
     size_t nextSp = sp ;
     size_t nextEp = ep ;
     while (l < m)
     {
-      if (!_alphabets.IsIn(s[m - 1 - l]))
+      if (!AlphabetOps::IsIn(_alphabets, s[m - 1 - l]))
         break ;
       BackwardExtend(s[m - 1 - l], sp, ep, nextSp, nextEp) ;
       if ( nextSp > nextEp || nextEp > _n)
@@ -399,24 +920,71 @@ public:
     return l ;
   }
 
+  // The LCP length marked by the semiLcp bits, 0 if the bits are not built
+  size_t GetMaxLcp()
+  {
+    return _auxData.maxLcp ;
+  }
+
+  // Expand [sp, ep] to the range of the rows sharing the first maxLcp
+  //   characters with them, i.e. the range of the length-maxLcp prefix of
+  //   the pattern for [sp, ep]. The pattern should be longer than maxLcp.
+  // Row i shares maxLcp characters with row i-1 iff its semiLcp bits are set,
+  //   so we look for the closest unset bits around [sp, ep].
+  void ExpandRangeByLcp(size_t &sp, size_t &ep)
+  {
+    const WORD *G = _auxData.semiLcpGreater ;
+    const WORD *E = _auxData.semiLcpEqual ;
+    size_t wi = sp >> WORDBITS_WIDTH ;
+    WORD w = ~(G[wi] | E[wi]) & MASK_WCHECK((int)(sp & (WORDBITS - 1)) + 1) ;
+    while (w == 0) // bit 0 is never set, so this stops at the first word
+    {
+      --wi ;
+      w = ~(G[wi] | E[wi]) ;
+    }
+    sp = (wi << WORDBITS_WIDTH) + WORDBITS - 1 - Utils::CountLeadingZeros(w) ;
+
+    const size_t wordCnt = Utils::BitsToWords(_n) ;
+    wi = (ep + 1) >> WORDBITS_WIDTH ;
+    if (wi >= wordCnt)
+      return ;
+    w = ~(G[wi] | E[wi]) & ~MASK((ep + 1) & (WORDBITS - 1)) ;
+    while (w == 0 && wi + 1 < wordCnt)
+    {
+      ++wi ;
+      w = ~(G[wi] | E[wi]) ;
+    }
+    if (w == 0)
+      ep = _n - 1 ;
+    else
+      ep = MIN((wi << WORDBITS_WIDTH) + Utils::CountTrailingZeros(w), _n) - 1 ;
+  }
+
   // @return: the value of the sampled SA for BWT[i]
   //          l is the offset between 
+  COMPACTDS_TARGET_CLONES
   size_t BackwardToSampledSA(size_t i, size_t &l)
   {
     l = 0 ;
     size_t ret = 0 ;
     while (!GetSampledSA(i, ret))
     {
-      i = BackwardExtend( _BWT.Access(i), i) ;
+      i = LF(i) ;
       ++l ;
     }
     return ret ;
   }
 
+  // return ISA[0]
+  size_t GetFirstISA()
+  {
+    return _firstISA ;
+  }
+
   // return ISA[n - 1]
   size_t GetLastISA()
   {
-    return _plainAlphabetPartialSum[ _plainAlphabetCoder.Encode(_lastChr) ] ;
+    return _plainAlphabetPartialSum[_lastChrCode] ;
   }
 
   // Calculate the values for SA[sp..ep]
@@ -435,6 +1003,147 @@ public:
     }
   }
 
+  // Get the BackwardToSampledSA values for the rows (sorted, no duplicates)
+  //   through one pass of LF mapping over the whole text,
+  //   which is faster than searching from each row when rows are dense.
+  // The offsets to the sampled rows are not reported.
+  void BackwardToSampledSAForRows(const std::vector<size_t> &rows, std::vector<size_t> &values)
+  {
+    size_t i, j ;
+    WORD *isInRows = Utils::MallocByBits(_n) ;
+    for (i = 0 ; i < rows.size() ; ++i)
+      Utils::BitSet(isInRows, rows[i]) ;
+    values.resize(rows.size()) ;
+
+    std::vector<size_t> pending ;
+    size_t p = GetLastISA() ;
+    // Visit the rows from SA[p]=n-1 to SA[p]=0
+    for (i = 0 ; i < _n ; ++i)
+    {
+      if (Utils::BitRead(isInRows, p))
+        pending.push_back(p) ;
+
+      size_t sa ;
+      if (pending.size() > 0 && GetSampledSA(p, sa))
+      {
+        for (j = 0 ; j < pending.size() ; ++j)
+          values[ std::lower_bound(rows.begin(), rows.end(), pending[j]) - rows.begin() ] = sa ;
+        pending.clear() ;
+      }
+
+      if (i + 1 < _n)
+        p = LF(p) ;
+    }
+    free(isInRows) ;
+  }
+
+  // Get the rows of the text positions p with (p + shift) % rate == 0 
+  //   through one pass of LF mapping over the whole text. 
+  // rows: sorted rows
+  void GetRowsForTextPositions(size_t rate, size_t shift, std::vector<size_t> &rows)
+  {
+    size_t i ;
+    rows.clear() ;
+    size_t p = GetLastISA() ;
+    for (i = 0 ; i < _n ; ++i)
+    {
+      if ((_n - 1 - i + shift) % rate == 0)
+        rows.push_back(p) ;
+      if (i + 1 < _n)
+        p = LF(p) ;
+    }
+    std::sort(rows.begin(), rows.end()) ;
+  }
+
+  // Compute the BWT for the text G+T, where T is the text of current index.
+  // Like bwte, the suffixes of T keep their relative order, and
+  //   we only need to sort the suffixes of G and insert them.
+  // G: the text to prepend, plain coded with the same alphabet list
+  // m: length of G
+  // builderParam: provides the parameters to sort the suffixes of G
+  // BWT: the BWT of G+T
+  // firstISA: ISA[0] of G+T
+  // newRows: newRows[i] is the row of suffix G[i..]+T in the new BWT. Should be allocated with size m.
+  void PrependText(const FixedSizeElemArray &G, size_t m, struct _FMBuilderParam &builderParam,
+      FixedSizeElemArray &BWT, size_t &firstISA, size_t *newRows)
+  {
+    size_t i, k ;
+    const int alphabetSize = _plainAlphabetCoder.GetSize() ;
+
+    // g[i]: the number of the suffixes of T that are smaller than G[i..]+T
+    size_t *g = (size_t *)malloc(sizeof(size_t) * (m + 1)) ;
+    g[m] = _firstISA ;
+    for (i = m ; i > 0 ; --i)
+    {
+      WORD code = G.Read(i - 1) ;
+      ALPHABET c = _plainAlphabetCoder.Decode(code, _plainAlphabetBits) ;
+      if (g[i] > 0)
+        g[i - 1] = _plainAlphabetPartialSum[code] + Rank(c, g[i] - 1) ;
+      else // the suffix of T consisting of the last character only
+        g[i - 1] = _plainAlphabetPartialSum[code] + (c == _lastChr ? 1 : 0) ;
+    }
+
+    // The order of G[i..]+T is determined by G[i..] and whether the suffix right
+    //   after the end of G is greater than T, so we augment each character with
+    //   whether the next suffix is greater than T and append a terminator larger
+    //   than any character.
+    const int augmentedAlphabetSize = 2 * alphabetSize + 1 ;
+    FixedSizeElemArray augmentedG ;
+    augmentedG.Malloc(Utils::Log2Ceil(augmentedAlphabetSize), m + 1) ;
+    for (i = 0 ; i < m ; ++i)
+      augmentedG.Write(i, 2 * G.Read(i) + ((i + 1 < m && g[i + 1] > _firstISA) ? 1 : 0)) ;
+    augmentedG.Write(m, augmentedAlphabetSize - 1) ;
+
+    size_t *sa = (size_t *)malloc(sizeof(size_t) * (m + 1)) ;
+    SuffixArrayGenerator saGenerator ;
+    saGenerator.SetThreadCnt(builderParam.threadCnt) ;
+    size_t cutCnt = saGenerator.Init(augmentedG, m + 1, builderParam.saBlockSize,
+        builderParam.saDcv, augmentedAlphabetSize) ;
+    size_t saFilled = 0 ;
+    for (k = 0 ; k < cutCnt ; ++k)
+    {
+      std::vector< std::vector<size_t> > pos ;
+      saGenerator.GetChunksPositions(augmentedG, m + 1, k, k, 0, m, pos) ;
+      saGenerator.SortSuffixByPos(augmentedG, m + 1, pos[0].data(), pos[0].size(), sa + saFilled) ;
+      saFilled += pos[0].size() ;
+    }
+    saGenerator.Free() ;
+    augmentedG.Free() ;
+
+    // Merge. The suffix of the terminator is the last one in sa.
+    BWT.Malloc(Utils::Log2Ceil(alphabetSize), _n + m) ;
+    size_t r = 0 ; // the row in the current BWT
+    size_t p = 0 ; // the row in the new BWT
+    for (k = 0 ; k <= m ; ++k)
+    {
+      size_t nextG = (k < m) ? g[sa[k]] : _n ;
+      for ( ; r < nextG ; ++r, ++p)
+      {
+        if (r == _firstISA)
+          BWT.Write(p, G.Read(m - 1)) ;
+        else
+          BWT.Write(p, _plainAlphabetCoder.Encode(_BWT.Access(r))) ;
+      }
+
+      if (k < m)
+      {
+        i = sa[k] ;
+        newRows[i] = p ;
+        if (i > 0)
+          BWT.Write(p, G.Read(i - 1)) ;
+        else
+        {
+          BWT.Write(p, _plainAlphabetCoder.Encode(_lastChr)) ;
+          firstISA = p ;
+        }
+        ++p ;
+      }
+    }
+
+    free(sa) ;
+    free(g) ;
+  }
+
   size_t GetSize()
   {
     return _n ;
@@ -450,7 +1159,11 @@ public:
     Utils::PrintLog("FM-index space usage (bytes):") ;
     Utils::PrintLog("BWT: %llu", _BWT.GetSpace()) ;
     Utils::PrintLog("sampledSA: %llu", _auxData.sampledSA.GetSpace()) ;
+    if (_auxData.sampleStrategy == FM_SAMPLE_STRATEGY_TEXT)
+      Utils::PrintLog("sampledRows: %llu", _auxData.sampledRows.GetSpace()) ;
     Utils::PrintLog("precomputedRange: %llu", _auxData.precomputeSize * sizeof(*_auxData.precomputedRange)) ;
+    if (_extPrecomputeWidth > 0)
+      Utils::PrintLog("extendedPrecomputedRange: %llu", _extPrecomputedRange.GetSpace()) ;
   }
 
   void Save(FILE *fp)
@@ -470,7 +1183,8 @@ public:
     _auxData.Save(fp) ;
   }
 
-  void Load(FILE *fp)
+  // loadSampleRate: see _FMIndexAuxData::Load
+  void Load(FILE *fp, int loadSampleRate = 0)
   {
     Free() ;
 
@@ -487,8 +1201,10 @@ public:
     _plainAlphabetPartialSum = (size_t *)calloc(alphabetSize + 1,
         sizeof(*_plainAlphabetPartialSum)) ;
     LOAD_ARR(fp, _plainAlphabetPartialSum, alphabetSize + 1) ;
+    _lastChrCode = _plainAlphabetCoder.Encode(_lastChr) ;
+    CheckFixedAlphabet() ;
 
-    _auxData.Load(fp) ; 
+    _auxData.Load(fp, loadSampleRate) ; 
   }
 } ;
 }
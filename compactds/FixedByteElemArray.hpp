@@ -0,0 +1,169 @@
+#ifndef _MOURISL_COMPACTDS_FIXEDBYTEELEM_ARRAY
+#define _MOURISL_COMPACTDS_FIXEDBYTEELEM_ARRAY
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Utils.hpp"
+
+/*
+ * The class for the array where each element takes a fixed number of bytes,
+ * e.g. the 5-byte (40-bit) suffix array positions for texts shorter than 2^40.
+ * Compared to FixedSizeElemArray, an element never straddles bits of its neighbors,
+ * so a read is a single unaligned word load and a write only touches
+ * the bytes of that element. Therefore threads can write different elements concurrently.
+ * The buffer is padded by a word so the read of the last element stays in bound.
+ * Assume little-endian.
+ */
+
+namespace compactds {
+class FixedByteElemArray
+{
+private:
+  uint8_t *_B ;
+  int _l ; // number of bytes for each element
+  WORD _mask ;
+  size_t _n ;
+  size_t _capacity ; // in elements
+
+  void Realloc(size_t capacity)
+  {
+    _capacity = capacity ;
+    _B = (uint8_t *)realloc(_B, _capacity * _l + WORDBYTES) ;
+  }
+public:
+  FixedByteElemArray()
+  {
+    _B = NULL ;
+    _l = 0 ;
+    _mask = 0 ;
+    _n = 0 ;
+    _capacity = 0 ;
+  }
+
+  ~FixedByteElemArray()
+  {
+    Free() ;
+  }
+
+  // The number of bytes to hold the values in [0, maxValue].
+  // We only use 5 or 8 bytes to keep the read/write simple.
+  static int GetElemLengthForValue(size_t maxValue)
+  {
+    if (maxValue < (1ull<<40))
+      return 5 ;
+    return 8 ;
+  }
+
+  // Allocate the memory for n elements, where each element takes l bytes
+  void Malloc(int l, size_t n)
+  {
+    Free() ;
+    _l = l ;
+    _mask = (l >= WORDBYTES) ? (~0ull) : ((1ull << (8 * l)) - 1) ;
+    _n = n ;
+    Realloc(n) ;
+  }
+
+  void Free()
+  {
+    if (_B != NULL)
+      free(_B) ;
+    _B = NULL ;
+    _n = 0 ;
+    _capacity = 0 ;
+  }
+
+  size_t Read(size_t i) const
+  {
+    WORD w ;
+    memcpy(&w, _B + i * _l, sizeof(w)) ;
+    return w & _mask ;
+  }
+
+  size_t operator[](size_t i) const
+  {
+    return Read(i) ;
+  }
+
+  void Write(size_t i, size_t x)
+  {
+    uint8_t *p = _B + i * _l ;
+    if (_l == 5)
+    {
+      uint32_t low = (uint32_t)x ;
+      memcpy(p, &low, 4) ;
+      p[4] = (uint8_t)(x >> 32) ;
+    }
+    else if (_l == 8)
+      memcpy(p, &x, 8) ;
+    else
+      memcpy(p, &x, _l) ;
+  }
+
+  void Swap(size_t i, size_t j)
+  {
+    size_t tmp = Read(i) ;
+    Write(i, Read(j)) ;
+    Write(j, tmp) ;
+  }
+
+  // Change the number of elements, keeping the content of the first min(n, newn) elements
+  void Resize(size_t newn)
+  {
+    if (newn > _capacity)
+      Realloc(newn) ;
+    _n = newn ;
+  }
+
+  // Reserve the space for m elements without changing current element
+  void Reserve(size_t m)
+  {
+    if (m > _capacity)
+      Realloc(m) ;
+  }
+
+  void PushBack(size_t x)
+  {
+    if (_n == _capacity)
+      Reserve(_capacity < 16 ? 16 : 2 * _capacity) ;
+    Write(_n, x) ;
+    ++_n ;
+  }
+
+  // Copy the elements of B to the position starting from i.
+  void CopyFrom(size_t i, const FixedByteElemArray &B)
+  {
+    memcpy(_B + i * _l, B._B, B._n * _l) ;
+  }
+
+  // Move the len elements starting from s to the beginning
+  void ShiftToFront(size_t s, size_t len)
+  {
+    memmove(_B, _B + s * _l, len * _l) ;
+  }
+
+  size_t GetSpace() const
+  {
+    return _capacity * _l + WORDBYTES + sizeof(*this) ;
+  }
+
+  int GetElemLength() const
+  {
+    return _l ;
+  }
+
+  size_t GetSize() const
+  {
+    return _n ;
+  }
+
+  const uint8_t *GetData() const
+  {
+    return _B ;
+  }
+} ;
+}
+
+#endif
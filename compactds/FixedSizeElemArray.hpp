@@ -166,6 +166,14 @@ public:
     return (i * _l) / WORDBITS ;
   }
   
+  // Whether the i-th element shares a word with the elements outside of [s, e).
+  // Used to tell which elements can be written by multiple threads safely.
+  bool IsElemSharingWord(size_t i, size_t s, size_t e) const
+  {
+    return (i * _l) / WORDBITS == (s * _l) / WORDBITS 
+      || ((i + 1) * _l - 1) / WORDBITS == (e * _l - 1) / WORDBITS ;
+  }
+  
   // Return num elements starting from i.
   // @return: bit packed _W[i].._W[i + num - 1]
   WORD PackRead(size_t i, size_t num) const
@@ -216,14 +224,9 @@ public:
         if (wa == wb)
           continue ;
 
-        int k ;
-        for (k = 0 ; k < block ; ++k)
-        {
-          WORD smalla = (wa >> (k * _l)) & MASK(_l) ;
-          WORD smallb = (wb >> (k * _l)) & MASK(_l) ;
-          if (smalla != smallb)
-            return ai + k - s ;
-        }
+        // The first element sits in the lowest bits, so the lowest set
+        // bit of the XOR tells the first mismatched element.
+        return ai + Utils::CountTrailingZeros(wa ^ wb) / _l - s ;
       }
     }
 
@@ -334,6 +337,33 @@ public:
     _W = Utils::MallocByBits(WORDBITS * _size) ;
     fread(_W, sizeof(_W[0]), Utils::BitsToWords(_n * _l), fp) ;
   }
+
+  // Load only the elements whose indexes are multiples of stride, 
+  //   reading the file by chunks so the whole array is never in memory.
+  // @return: the bytes saved compared to Load()
+  size_t LoadSubsampled(FILE *fp, size_t stride)
+  {
+    size_t i, j ;
+    size_t size, n ;
+    int l ;
+    LOAD_VAR(fp, size) ;
+    LOAD_VAR(fp, l) ;
+    LOAD_VAR(fp, n) ;
+    Malloc(l, DIV_CEIL(n, stride)) ;
+    
+    // The chunk has a multiple of WORDBITS elements, so it starts from a word boundary.
+    const size_t chunkElems = WORDBITS * 1024 ;
+    WORD *buffer = (WORD *)malloc(sizeof(WORD) * Utils::BitsToWords(chunkElems * l)) ;
+    for (i = 0 ; i < n ; i += chunkElems)
+    {
+      size_t cnt = MIN(chunkElems, n - i) ;
+      fread(buffer, sizeof(WORD), Utils::BitsToWords(cnt * l), fp) ;
+      for (j = (stride - i % stride) % stride ; j < cnt ; j += stride)
+        Write64((i + j) / stride, Utils::BitsRead(buffer, j * l, (j + 1) * l - 1)) ;
+    }
+    free(buffer) ;
+    return sizeof(WORD) * (size - _size) ;
+  }
 } ;
 }
 
@@ -0,0 +1,353 @@
+#ifndef _MOURISL_COMPACTDS_PREFIXFREE_PARSER
+#define _MOURISL_COMPACTDS_PREFIXFREE_PARSER
+
+#include <string.h>
+
+#include <vector>
+#include <string>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+
+#include "Utils.hpp"
+#include "FixedSizeElemArray.hpp"
+#include "FixedByteElemArray.hpp"
+
+// The class generating the suffix array in order through prefix-free parsing
+//   (Boucher et al. 2019, "Prefix-free parsing for building big BWTs").
+// The text is conceptually Y=$^w T $^w, and it is cut at every trigger string,
+//   the w-window whose Karp-Rabin hash is 0 mod p, into phrases overlapping by w characters.
+// Only the distinct phrases and the parse are sorted, so the work before
+//   outputting the suffix array depends on the number of distinct phrases
+//   instead of the text length for repetitive text.
+// $ is smaller than every character, so the order is the same as the suffix array
+//   of T where a suffix is smaller than its extensions.
+namespace compactds {
+
+// Compare two suffixes of the phrases, each represented as (phrase id, offset).
+struct _PrefixFreeParserSuffixCompare
+{
+  const unsigned char *dict ;
+  const size_t *dictOffset ;
+
+  int Compare(const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b) const
+  {
+    size_t lena = dictOffset[a.first + 1] - dictOffset[a.first] - a.second ;
+    size_t lenb = dictOffset[b.first + 1] - dictOffset[b.first] - b.second ;
+    int ret = memcmp(dict + dictOffset[a.first] + a.second, dict + dictOffset[b.first] + b.second,
+        MIN(lena, lenb)) ;
+    if (ret != 0)
+      return ret ;
+    if (lena == lenb)
+      return 0 ;
+    return lena < lenb ? -1 : 1 ;
+  }
+
+  bool operator()(const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b) const
+  {
+    return Compare(a, b) < 0 ;
+  }
+} ;
+
+// Compare two parse positions by (rank[i], rank[i+h])
+struct _PrefixFreeParserDoublingCompare
+{
+  const size_t *rank ;
+  size_t m ;
+  size_t h ;
+
+  bool operator()(size_t a, size_t b) const
+  {
+    if (rank[a] != rank[b])
+      return rank[a] < rank[b] ;
+    size_t ra = a + h < m ? rank[a + h] + 1 : 0 ;
+    size_t rb = b + h < m ? rank[b + h] + 1 : 0 ;
+    return ra < rb ;
+  }
+} ;
+
+class PrefixFreeParser
+{
+private:
+  int _w ; // window size for trigger strings
+  size_t _p ; // modulus for trigger strings
+  size_t _n ; // length of the text
+  size_t _phraseCnt ; // number of distinct phrases
+  size_t _parseLen ;
+
+  // Distinct phrases are concatenated, where characters are shifted by 1 and 0 is $.
+  std::vector<unsigned char> _dict ;
+  std::vector<size_t> _dictOffset ; // phrase i is in [_dictOffset[i], _dictOffset[i + 1])
+
+  // The occurrences of each phrase, ordered by the rank of the parse suffix after it.
+  // The occurrences of phrase i are in [_occOffset[i], _occOffset[i + 1])
+  std::vector<size_t> _occOffset ;
+  std::vector<size_t> _occStart ; // start position in Y
+  std::vector<size_t> _occRank ; // rank of the following parse suffix, 0 for the last phrase
+
+  // The phrase suffixes longer than w, sorted
+  std::vector< std::pair<size_t, size_t> > _suffixes ;
+
+  // States for GetNextSA. The suffixes in [_groupStart, _groupEnd) are identical
+  //   and their occurrences are merged by the rank of the following parse suffix
+  size_t _groupStart, _groupEnd ;
+  std::vector<size_t> _groupCursor ;
+  std::priority_queue< std::pair<size_t, size_t>, std::vector< std::pair<size_t, size_t> >,
+    std::greater< std::pair<size_t, size_t> > > _groupHeap ;
+  size_t _outputCnt ;
+
+  static const WORD KR_BASE = 256 ;
+  static const WORD KR_PRIME = 1999999973 ;
+
+  // The character in Y=$^w T $^w, shifted by 1.
+  int GetY(const FixedSizeElemArray &T, size_t i) const
+  {
+    if (i < (size_t)_w || i >= _n + _w)
+      return 0 ;
+    return T.Read(i - _w) + 1 ;
+  }
+
+  // Sort the suffixes of the parse with prefix doubling.
+  // parse: phrase ranks
+  // return: sa of the parse
+  static void SortParse(const std::vector<size_t> &parse, std::vector<size_t> &sa)
+  {
+    size_t i ;
+    size_t m = parse.size() ;
+    std::vector<size_t> rank(parse) ;
+    std::vector<size_t> newRank(m) ;
+    struct _PrefixFreeParserDoublingCompare cmp ;
+
+    sa.resize(m) ;
+    for (i = 0 ; i < m ; ++i)
+      sa[i] = i ;
+    cmp.rank = rank.data() ;
+    cmp.m = m ;
+    for (cmp.h = 1 ; ; cmp.h *= 2)
+    {
+      std::sort(sa.begin(), sa.end(), cmp) ;
+      newRank[sa[0]] = 0 ;
+      for (i = 1 ; i < m ; ++i)
+        newRank[sa[i]] = newRank[sa[i - 1]] + (cmp(sa[i - 1], sa[i]) ? 1 : 0) ;
+      rank.swap(newRank) ;
+      cmp.rank = rank.data() ;
+      if (rank[sa[m - 1]] == m - 1 || cmp.h >= m)
+        break ;
+    }
+  }
+
+  // Push the first occurrence of every suffix in the group to the heap.
+  void StartGroup()
+  {
+    size_t i ;
+    struct _PrefixFreeParserSuffixCompare cmp ;
+    cmp.dict = _dict.data() ;
+    cmp.dictOffset = _dictOffset.data() ;
+
+    _groupStart = _groupEnd ;
+    for (_groupEnd = _groupStart + 1 ; _groupEnd < _suffixes.size() ; ++_groupEnd)
+      if (cmp.Compare(_suffixes[_groupStart], _suffixes[_groupEnd]) != 0)
+        break ;
+
+    _groupCursor.resize(_groupEnd - _groupStart) ;
+    for (i = _groupStart ; i < _groupEnd ; ++i)
+    {
+      size_t pid = _suffixes[i].first ;
+      _groupCursor[i - _groupStart] = _occOffset[pid] ;
+      _groupHeap.push(std::pair<size_t, size_t>(_occRank[ _occOffset[pid] ], i - _groupStart)) ;
+    }
+  }
+
+public:
+  PrefixFreeParser()
+  {
+    _w = 10 ;
+    _p = 100 ;
+    _n = 0 ;
+    _phraseCnt = _parseLen = 0 ;
+    _groupStart = _groupEnd = 0 ;
+    _outputCnt = 0 ;
+  }
+
+  ~PrefixFreeParser() {}
+
+  size_t GetPhraseCount() const
+  {
+    return _phraseCnt ;
+  }
+
+  size_t GetParseLength() const
+  {
+    return _parseLen ;
+  }
+
+  // Parse the text and sort the dictionary and the parse
+  // w: window size for trigger strings
+  // p: a window is a trigger string if its hash is 0 mod p
+  void Init(const FixedSizeElemArray &T, size_t n, int w, size_t p)
+  {
+    size_t i, k ;
+    _w = w ;
+    _p = p ;
+    _n = n ;
+
+    // Parse. Windows containing $ are not triggers except $^w at the two ends.
+    std::unordered_map<std::string, size_t> phraseIds ;
+    std::vector<size_t> parse ; // phrase ids
+    std::vector<size_t> parseStart ; // start positions in Y
+    std::string phrase ;
+    size_t ylen = n + 2 * _w ;
+    WORD h = 0 ;
+    WORD highPower = 1 ; // KR_BASE^(w-1)
+    for (i = 1 ; i < (size_t)_w ; ++i)
+      highPower = highPower * KR_BASE % KR_PRIME ;
+
+    size_t prevTrigger = 0 ;
+    for (i = 0 ; i < ylen ; ++i)
+    {
+      if (i >= (size_t)_w) // remove Y[i - w]
+        h = (h + KR_PRIME - GetY(T, i - _w) * highPower % KR_PRIME) % KR_PRIME ;
+      h = (h * KR_BASE + GetY(T, i)) % KR_PRIME ;
+      if (i + 1 < (size_t)_w)
+        continue ;
+
+      size_t s = i + 1 - _w ; // window start
+      if ((s > 0 && s < (size_t)_w) || s > n + _w)
+        continue ;
+      if (s == n + _w || (s >= (size_t)_w && s <= n && h % _p == 0))
+      {
+        if (s == 0)
+          continue ;
+        phrase.clear() ;
+        for (k = prevTrigger ; k <= i ; ++k)
+          phrase.push_back((char)GetY(T, k)) ;
+
+        if (phraseIds.find(phrase) == phraseIds.end())
+        {
+          size_t id = phraseIds.size() ;
+          phraseIds[phrase] = id ;
+        }
+        parse.push_back(phraseIds[phrase]) ;
+        parseStart.push_back(prevTrigger) ;
+        prevTrigger = s ;
+      }
+    }
+    _phraseCnt = phraseIds.size() ;
+    _parseLen = parse.size() ;
+
+    // Put the dictionary in lexicographic order
+    std::vector< std::pair<std::string, size_t> > sortedPhrases ;
+    sortedPhrases.reserve(_phraseCnt) ;
+    for (std::unordered_map<std::string, size_t>::iterator iter = phraseIds.begin() ;
+        iter != phraseIds.end() ; ++iter)
+      sortedPhrases.push_back(*iter) ;
+    std::unordered_map<std::string, size_t>().swap(phraseIds) ;
+    std::sort(sortedPhrases.begin(), sortedPhrases.end()) ;
+
+    std::vector<size_t> idToRank(_phraseCnt) ;
+    _dictOffset.resize(_phraseCnt + 1) ;
+    _dictOffset[0] = 0 ;
+    for (i = 0 ; i < _phraseCnt ; ++i)
+    {
+      idToRank[ sortedPhrases[i].second ] = i ;
+      _dictOffset[i + 1] = _dictOffset[i] + sortedPhrases[i].first.size() ;
+    }
+    _dict.resize(_dictOffset[_phraseCnt]) ;
+    for (i = 0 ; i < _phraseCnt ; ++i)
+      memcpy(_dict.data() + _dictOffset[i], sortedPhrases[i].first.data(), sortedPhrases[i].first.size()) ;
+    std::vector< std::pair<std::string, size_t> >().swap(sortedPhrases) ;
+    for (i = 0 ; i < _parseLen ; ++i)
+      parse[i] = idToRank[ parse[i] ] ;
+    std::vector<size_t>().swap(idToRank) ;
+
+    // Sort the parse, and arrange the occurrences of each phrase by
+    //   the rank of its following parse suffix.
+    std::vector<size_t> parseSA ;
+    SortParse(parse, parseSA) ;
+    _occOffset.assign(_phraseCnt + 1, 0) ;
+    for (i = 0 ; i < _parseLen ; ++i)
+      ++_occOffset[ parse[i] + 1 ] ;
+    for (i = 1 ; i <= _phraseCnt ; ++i)
+      _occOffset[i] += _occOffset[i - 1] ;
+    _occStart.resize(_parseLen) ;
+    _occRank.resize(_parseLen) ;
+    std::vector<size_t> fill(_occOffset.begin(), _occOffset.end() - 1) ;
+
+    // The last phrase has the unique $^w suffix, so its rank only needs to be distinct.
+    k = parse[_parseLen - 1] ;
+    _occStart[ fill[k] ] = parseStart[_parseLen - 1] ;
+    _occRank[ fill[k] ] = 0 ;
+    ++fill[k] ;
+    for (i = 0 ; i < _parseLen ; ++i)
+    {
+      if (parseSA[i] == 0)
+        continue ;
+      size_t j = parseSA[i] - 1 ;
+      k = parse[j] ;
+      _occStart[ fill[k] ] = parseStart[j] ;
+      _occRank[ fill[k] ] = i + 1 ;
+      ++fill[k] ;
+    }
+
+    // Sort the phrase suffixes longer than w. A suffix starting in the leading $^w
+    //   or in the trailing w characters of a phrase does not correspond to a suffix of T.
+    size_t firstPhrase = parse[0] ;
+    for (i = 0 ; i < _phraseCnt ; ++i)
+    {
+      size_t len = _dictOffset[i + 1] - _dictOffset[i] ;
+      for (k = (i == firstPhrase ? _w : 0) ; k + _w < len ; ++k)
+        _suffixes.push_back(std::pair<size_t, size_t>(i, k)) ;
+    }
+    struct _PrefixFreeParserSuffixCompare cmp ;
+    cmp.dict = _dict.data() ;
+    cmp.dictOffset = _dictOffset.data() ;
+    std::sort(_suffixes.begin(), _suffixes.end(), cmp) ;
+
+    _groupStart = _groupEnd = 0 ;
+    _outputCnt = 0 ;
+  }
+
+  // Output the next at most size elements of the suffix array of T to sa, 
+  //   which has the space for size elements.
+  // return: the number of elements written. 0 when all the suffixes are output.
+  size_t GetNextSA(FixedByteElemArray &sa, size_t size)
+  {
+    size_t filled = 0 ;
+    while (filled < size)
+    {
+      if (_groupHeap.empty())
+      {
+        if (_groupEnd >= _suffixes.size())
+          break ;
+        StartGroup() ;
+      }
+
+      std::pair<size_t, size_t> top = _groupHeap.top() ;
+      _groupHeap.pop() ;
+      size_t gi = top.second ;
+      const std::pair<size_t, size_t> &suffix = _suffixes[_groupStart + gi] ;
+      sa.Write(filled, _occStart[ _groupCursor[gi] ] + suffix.second - _w) ;
+      ++filled ;
+
+      ++_groupCursor[gi] ;
+      if (_groupCursor[gi] < _occOffset[suffix.first + 1])
+        _groupHeap.push(std::pair<size_t, size_t>(_occRank[ _groupCursor[gi] ], gi)) ;
+    }
+    _outputCnt += filled ;
+    return filled ;
+  }
+
+  // Release the memory
+  void Free()
+  {
+    std::vector<unsigned char>().swap(_dict) ;
+    std::vector<size_t>().swap(_dictOffset) ;
+    std::vector<size_t>().swap(_occOffset) ;
+    std::vector<size_t>().swap(_occStart) ;
+    std::vector<size_t>().swap(_occRank) ;
+    std::vector< std::pair<size_t, size_t> >().swap(_suffixes) ;
+  }
+} ;
+}
+
+#endif
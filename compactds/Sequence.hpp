@@ -12,8 +12,9 @@ protected:
   size_t _space ;
   Alphabet _alphabets ;
   size_t _n ; // sequence length
+  int _threadCnt ; // the number of threads for construction
 public:
-  Sequence() {_space = 0 ; _n = 0 ;}
+  Sequence() {_space = 0 ; _n = 0 ; _threadCnt = 1 ;}
   ~Sequence() {}
 
   void SetAlphabet(const Alphabet &a)
@@ -21,6 +22,11 @@ public:
     _alphabets = a ;  
   }
 
+  void SetThreadCnt(int threadCnt)
+  {
+    _threadCnt = threadCnt ;
+  }
+
   virtual void Save(FILE *fp)
   {
     SAVE_VAR(fp, _space) ;
@@ -47,6 +53,23 @@ public:
   virtual ALPHABET Access(size_t i) const = 0 ;
   virtual size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const = 0 ;
   virtual size_t Select(ALPHABET c, size_t i) const = 0 ;
+  
+  // Return the ranks of c in [0..i] and [0..j] through ri and rj, i <= j.
+  // The sequence could override it to share the traversal of the two positions.
+  virtual void RankPair(ALPHABET c, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    ri = Rank(c, i) ;
+    rj = Rank(c, j) ;
+  }
+
+  // Return the alphabet c at position i, and the rank of c in [0..i] through rank.
+  // The sequence could override it to reuse the traversal of Access for the rank. 
+  virtual ALPHABET AccessAndRank(size_t i, size_t &rank) const
+  {
+    ALPHABET c = Access(i) ;
+    rank = Rank(c, i) ;
+    return c ;
+  }
   virtual void PrintStats() = 0 ;
 } ;
 }
@@ -45,6 +45,27 @@ public:
     _missingReplace = c ;
   }
 
+  // @return: number of chars Compact would add for rawseq
+  size_t CompactLength(const char *rawseq) const
+  {
+    size_t i ;
+    size_t ret = 0 ;
+    if (_missingReplace != '\0')
+      return strlen(rawseq) ;
+    for (i = 0 ; rawseq[i] ; ++i)
+    {
+      char c = rawseq[i] ;
+      if (_capitalize)
+      {
+        if (c >= 'a' && c <= 'z')
+          c = c - 'a' + 'A' ;
+      }
+      if (_alphabets.IsIn(c))
+        ++ret ;
+    }
+    return ret ;
+  }
+
   // @return: number of chars added to seq
   size_t Compact(const char *rawseq, FixedSizeElemArray &seq) 
   {
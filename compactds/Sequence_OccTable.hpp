@@ -0,0 +1,287 @@
+#ifndef _MOURISL_COMPACTDS_SEQUENCE_OCCTABLE
+#define _MOURISL_COMPACTDS_SEQUENCE_OCCTABLE
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "Utils.hpp"
+#include "Sequence.hpp"
+
+// The sequence for the alphabets of at most 4 characters, optimized for Rank speed.
+// The sequence is split into blocks of 128 characters, and each block takes one 64-byte
+//   cache line: the count of each character before the block (4 words), followed by
+//   the 2-bit codes of the 128 characters (4 words).
+// So Rank is one cache line access plus a few popcounts, at the cost of 4 bits per character.
+// The characters are represented by their plain codes in the alphabet.
+namespace compactds {
+class Sequence_OccTable ;
+
+struct _sequence_occtable_threadArg
+{
+  int tid ;
+  int threadCnt ;
+  Sequence_OccTable *seq ;
+
+  const FixedSizeElemArray *S ;
+  size_t blockFrom, blockTo ; // [blockFrom, blockTo)
+  bool fill ; // false: only count the characters in the blocks; true: fill the blocks
+  size_t count[4] ; // the total counts, or the counts before blockFrom when filling
+} ;
+
+class Sequence_OccTable: public Sequence
+{
+private:
+  WORD *_B ; // the blocks, aligned to the cache line
+  size_t _blockCnt ;
+
+  static const int BLOCK_WORDS = 8 ;
+  static const int BLOCK_CHARS = 128 ;
+  static const int BLOCK_CHARS_WIDTH = 7 ;
+  static const int CHARS_PER_WORD = 32 ;
+
+  void AllocateBlocks(size_t blockCnt)
+  {
+    void *p = NULL ;
+    if (posix_memalign(&p, BLOCK_WORDS * sizeof(WORD),
+          sizeof(WORD) * BLOCK_WORDS * (blockCnt > 0 ? blockCnt : 1)) != 0)
+    {
+      Utils::PrintLog("Failed to allocate the memory for the occurrence table.") ;
+      exit(1) ;
+    }
+    _B = (WORD *)p ;
+    _blockCnt = blockCnt ;
+    _space = sizeof(WORD) * BLOCK_WORDS * blockCnt ;
+  }
+
+  // Count the elements equal to code in the first cnt (0..32) elements of the packed word w
+  static int CountInWord(WORD w, WORD code, int cnt)
+  {
+    WORD x = w ^ (code * 0x5555555555555555ull) ; // the matched elements become 00
+    x = ~(x | (x >> 1)) & 0x5555555555555555ull ;
+    return Utils::Popcount(x & MASK_WCHECK(2 * cnt)) ;
+  }
+
+  // Count the characters in, or fill the blocks [blockFrom, blockTo).
+  // count: the counts before blockFrom, updated to the counts at blockTo
+  void ProcessBlocks(const FixedSizeElemArray &S, size_t blockFrom, size_t blockTo, bool fill, size_t *count)
+  {
+    size_t bi ;
+    int j, k ;
+    const int l = S.GetElemLength() ;
+    for (bi = blockFrom ; bi < blockTo ; ++bi)
+    {
+      WORD *block = _B + bi * BLOCK_WORDS ;
+      if (fill)
+      {
+        for (k = 0 ; k < 4 ; ++k)
+          block[k] = count[k] ;
+      }
+
+      for (j = 0 ; j < BLOCK_CHARS / CHARS_PER_WORD ; ++j)
+      {
+        size_t s = bi * BLOCK_CHARS + j * CHARS_PER_WORD ;
+        int cnt = (s >= _n) ? 0 : MIN(_n - s, (size_t)CHARS_PER_WORD) ;
+        WORD w = 0 ;
+        if (l == 2)
+        {
+          if (cnt > 0)
+            w = S.PackRead(s, cnt) ;
+        }
+        else
+        {
+          for (k = 0 ; k < cnt ; ++k)
+            w |= (S.Read(s + k) << (2 * k)) ;
+        }
+
+        if (fill)
+          block[4 + j] = w ;
+        for (k = 0 ; k < 4 ; ++k)
+          count[k] += CountInWord(w, k, cnt) ;
+      }
+    }
+  }
+
+  static void *ProcessBlocks_Thread(void *arg)
+  {
+    struct _sequence_occtable_threadArg *pArg = (struct _sequence_occtable_threadArg *)arg ;
+    pArg->seq->ProcessBlocks(*(pArg->S), pArg->blockFrom, pArg->blockTo, pArg->fill, pArg->count) ;
+    pthread_exit(NULL) ;
+  }
+
+  void RunThreads(void *(*func)(void *), struct _sequence_occtable_threadArg *args)
+  {
+    int i ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * _threadCnt) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, func, (void *)(args + i)) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    free(threads) ;
+  }
+
+public:
+  Sequence_OccTable()
+  {
+    _B = NULL ;
+    _blockCnt = 0 ;
+  }
+
+  ~Sequence_OccTable()
+  {
+    Free() ;
+  }
+
+  void Free()
+  {
+    if (_B != NULL)
+    {
+      free(_B) ;
+      _B = NULL ;
+    }
+    _blockCnt = 0 ;
+    _n = 0 ;
+  }
+
+  size_t GetSpace()
+  {
+    return _space + _alphabets.GetSpace() - sizeof(_alphabets) + sizeof(*this) ;
+  }
+
+  void Init(const FixedSizeElemArray &S, size_t sequenceLength, const ALPHABET *alphabetMap)
+  {
+    int t, k ;
+    Free() ;
+    if (_alphabets.GetSize() == 0)
+      _alphabets.InitFromList(alphabetMap, strlen(alphabetMap)) ;
+    if (_alphabets.GetSize() > 4)
+    {
+      Utils::PrintLog("Sequence_OccTable only supports the alphabets with at most 4 characters.") ;
+      exit(1) ;
+    }
+
+    _n = sequenceLength ;
+    AllocateBlocks(DIV_CEIL(_n, BLOCK_CHARS)) ;
+
+    size_t count[4] = {0, 0, 0, 0} ;
+    if (_threadCnt <= 1)
+    {
+      ProcessBlocks(S, 0, _blockCnt, true, count) ;
+      return ;
+    }
+
+    // Count the characters in each thread's blocks first to get
+    //   the counts before each portion, then fill the blocks.
+    struct _sequence_occtable_threadArg *args = new struct _sequence_occtable_threadArg[_threadCnt] ;
+    size_t rangeSize = DIV_CEIL(_blockCnt, _threadCnt) ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+    {
+      args[t].tid = t ;
+      args[t].threadCnt = _threadCnt ;
+      args[t].seq = this ;
+      args[t].S = &S ;
+      args[t].blockFrom = MIN(rangeSize * t, _blockCnt) ;
+      args[t].blockTo = MIN(rangeSize * (t + 1), _blockCnt) ;
+      args[t].fill = false ;
+      memset(args[t].count, 0, sizeof(args[t].count)) ;
+    }
+    RunThreads(ProcessBlocks_Thread, args) ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+    {
+      for (k = 0 ; k < 4 ; ++k)
+      {
+        size_t tmp = args[t].count[k] ;
+        args[t].count[k] = count[k] ;
+        count[k] += tmp ;
+      }
+      args[t].fill = true ;
+    }
+    RunThreads(ProcessBlocks_Thread, args) ;
+    delete[] args ;
+  }
+
+  // Access and Rank for the plain code, L has to be 2.
+  // The template is for the same interface as the other sequences specialized for Alphabet_DNA.
+  template <int L>
+  WORD AccessCode(size_t i) const
+  {
+    const WORD *chars = _B + (i >> BLOCK_CHARS_WIDTH) * BLOCK_WORDS + 4 ;
+    return (chars[(i & (BLOCK_CHARS - 1)) / CHARS_PER_WORD] >> (2 * (i & (CHARS_PER_WORD - 1)))) & 3 ;
+  }
+
+  template <int L>
+  size_t RankCode(WORD code, size_t i, int inclusive = 1) const
+  {
+    if (!inclusive)
+    {
+      if (i == 0)
+        return 0 ;
+      --i ;
+    }
+    const WORD *block = _B + (i >> BLOCK_CHARS_WIDTH) * BLOCK_WORDS ;
+    const int offset = i & (BLOCK_CHARS - 1) ;
+    const int wi = offset / CHARS_PER_WORD ;
+    size_t ret = block[code] ;
+    int j ;
+    for (j = 0 ; j < wi ; ++j)
+      ret += CountInWord(block[4 + j], code, CHARS_PER_WORD) ;
+    ret += CountInWord(block[4 + wi], code, (offset & (CHARS_PER_WORD - 1)) + 1) ;
+    return ret ;
+  }
+
+  // The two positions in the same block share the cache line
+  template <int L>
+  void RankCodePair(WORD code, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    ri = RankCode<L>(code, i) ;
+    rj = RankCode<L>(code, j) ;
+  }
+
+  template <int L>
+  WORD AccessCodeAndRank(size_t i, size_t &rank) const
+  {
+    WORD code = AccessCode<L>(i) ;
+    rank = RankCode<L>(code, i) ;
+    return code ;
+  }
+
+  ALPHABET Access(size_t i) const
+  {
+    return _alphabets.Decode(AccessCode<2>(i), 2) ;
+  }
+
+  size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const
+  {
+    return RankCode<2>(_alphabets.Encode(c), i, inclusive) ;
+  }
+
+  size_t Select(ALPHABET c, size_t i) const
+  {
+    return 0 ;
+  }
+
+  void PrintStats()
+  {
+    Utils::PrintLog("Sequence_OccTable: total_length: %lu blocks: %lu", _n, _blockCnt) ;
+  }
+
+  void Save(FILE *fp)
+  {
+    Sequence::Save(fp) ;
+    SAVE_VAR(fp, _blockCnt) ;
+    fwrite(_B, sizeof(WORD), BLOCK_WORDS * _blockCnt, fp) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+
+    Sequence::Load(fp) ;
+    size_t blockCnt ;
+    LOAD_VAR(fp, blockCnt) ;
+    AllocateBlocks(blockCnt) ;
+    fread(_B, sizeof(WORD), BLOCK_WORDS * _blockCnt, fp) ;
+  }
+} ;
+}
+
+#endif
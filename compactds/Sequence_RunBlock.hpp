@@ -2,13 +2,44 @@
 #define _MOURISL_COMPACTDS_SEQUENCE_HOMOPOLYMER
 
 #include <math.h>
+#include <pthread.h>
+
+#include <vector>
 
 #include "Sequence.hpp"
 #include "Sequence_WaveletTree.hpp"
+#include "Sequence_WaveletMatrix.hpp"
 
 // Split the original sequence into fixed-length blocks,
-//   compress the single-run block by reducing it to one character
+//   compress the single-run block by reducing it to one character.
+// SeqClass: the sequence for the plain blocks and the run blocks, 
+//   Sequence_WaveletTree or Sequence_WaveletMatrix.
 namespace compactds {
+template <class SeqClass>
+class Sequence_RunBlock ;
+
+template <class SeqClass>
+struct _sequence_runblock_threadArg
+{
+  int tid ;
+  int threadCnt ;
+  Sequence_RunBlock<SeqClass> *seq ;
+
+  const FixedSizeElemArray *S ;
+  WORD *B ; // block indicator
+  size_t blockFrom, blockTo ; // [blockFrom, blockTo), blockFrom is a multiple of WORDBITS
+  
+  size_t plainCnt ; // number of elements in plain blocks 
+  size_t runBlockCnt ; // number of run blocks
+
+  int k ; // which type of blocks to extract
+  FixedSizeElemArray *tmpS ;
+  size_t outFrom, outTo ; // the range to write in tmpS 
+  // The elements sharing the words with other threads, written after the threads finish.
+  std::vector< std::pair<size_t, WORD> > shared ;
+} ;
+
+template <class SeqClass = Sequence_WaveletTree<Bitvector_Plain> >
 class Sequence_RunBlock: public Sequence
 {
 private:
@@ -16,8 +47,8 @@ private:
   size_t _blockCnt ;
   Bitvector_Plain _useRunBlock ; // 0-plain sequence, 1-homo polymer sequence 
   //size_t **_alphabetBlockPartialSum ;
-  Sequence_WaveletTree<Bitvector_Plain> _waveletSeq ;
-  Sequence_WaveletTree<Bitvector_Plain> _runBlockSeq ;
+  SeqClass _waveletSeq ;
+  SeqClass _runBlockSeq ;
 
   // Variables and functions related to automatic block size estimation
   size_t _blockSizeInferLength ; // use this amount of numbers to infer block size
@@ -100,6 +131,87 @@ private:
     return bestTag ;
   }
 
+  // Whether the block starting at i is a run block 
+  bool IsRunBlock(const FixedSizeElemArray &S, size_t i) const
+  {
+    size_t j ;
+    int prevc = S.Read(i) ;
+    for (j = 1 ; j < _b && i + j < _n ; ++j)
+    {
+      int c = S.Read(i + j) ;
+      if (c != prevc)
+        return false ;
+    }
+    return true ;
+  }
+
+  static void *ClassifyBlocks_Thread(void *arg)
+  {
+    struct _sequence_runblock_threadArg<SeqClass> *pArg = (struct _sequence_runblock_threadArg<SeqClass> *)arg ;
+    const Sequence_RunBlock &seq = *(pArg->seq) ;
+    size_t bi ;
+    pArg->plainCnt = 0 ;
+    pArg->runBlockCnt = 0 ;
+    for (bi = pArg->blockFrom ; bi < pArg->blockTo ; ++bi)
+    {
+      size_t i = bi * seq._b ;
+      if (seq.IsRunBlock(*(pArg->S), i))
+      {
+        Utils::BitSet(pArg->B, bi) ;
+        ++pArg->runBlockCnt ;
+      }
+      else
+        pArg->plainCnt += MIN(seq._b, seq._n - i) ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  static void *ExtractBlocks_Thread(void *arg)
+  {
+    struct _sequence_runblock_threadArg<SeqClass> *pArg = (struct _sequence_runblock_threadArg<SeqClass> *)arg ;
+    const Sequence_RunBlock &seq = *(pArg->seq) ;
+    const FixedSizeElemArray &S = *(pArg->S) ;
+    FixedSizeElemArray &tmpS = *(pArg->tmpS) ;
+    size_t bi, j ;
+    size_t size = pArg->outFrom ;
+    pArg->shared.clear() ;
+    for (bi = pArg->blockFrom ; bi < pArg->blockTo ; ++bi)
+    {
+      if (Utils::BitRead(pArg->B, bi) != pArg->k)
+        continue ;
+      size_t i = bi * seq._b ;
+      size_t len = (pArg->k == 0) ? MIN(seq._b, seq._n - i) : 1 ;
+      for (j = 0 ; j < len ; ++j, ++size)
+      {
+        if (tmpS.IsElemSharingWord(size, pArg->outFrom, pArg->outTo))
+          pArg->shared.push_back( std::pair<size_t, WORD>(size, S.Read(i + j)) ) ;
+        else
+          tmpS.Write(size, S.Read(i + j)) ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+  
+  // Return the type of block bi, and the number of the blocks of this type in [0..bi] through ranki
+  int GetBlockTypeAndRank(size_t bi, size_t &ranki) const
+  {
+    if (_b < _n)
+      return _useRunBlock.AccessAndRank(bi, ranki) ;
+    ranki = 1 ;
+    return _useRunBlock.Access(bi) ;
+  }
+
+  void RunThreads(void *(*func)(void *), struct _sequence_runblock_threadArg<SeqClass> *args)
+  {
+    int i ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * _threadCnt) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, func, (void *)(args + i)) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    free(threads) ;
+  }
+
 public:
   Sequence_RunBlock() 
   {
@@ -168,27 +280,39 @@ public:
     _blockCnt = DIV_CEIL(_n, _b) ;
     
     WORD *B = Utils::MallocByBits(_blockCnt) ; // block indicator 
-
-    for (i = 0 ; i < _n ; i += _b)
+    
+    struct _sequence_runblock_threadArg<SeqClass> *args = NULL ;
+    if (_threadCnt > 1 && _blockCnt >= (size_t)_threadCnt * WORDBITS)
     {
-      int prevc = S.Read(i) ;
-      size_t rcnt = 1 ;
-      for (j = 1 ; j < _b && i + j < _n ; ++j)
+      // Each thread handles the blocks in a range aligned to WORDBITS,
+      //   so the bits of B set by the threads are in different words.
+      int t ;
+      size_t rangeSize = DIV_CEIL(DIV_CEIL(_blockCnt, WORDBITS), _threadCnt) * WORDBITS ;
+      args = new struct _sequence_runblock_threadArg<SeqClass>[_threadCnt] ;
+      for (t = 0 ; t < _threadCnt ; ++t)
       {
-        int c = S.Read(i + j) ;
-        if (c != prevc)
-        {
-          ++rcnt ;
-          prevc = c ;
-          break ;
-        }
+        args[t].tid = t ;
+        args[t].threadCnt = _threadCnt ;
+        args[t].seq = this ;
+        args[t].S = &S ;
+        args[t].B = B ;
+        args[t].blockFrom = MIN(rangeSize * t, _blockCnt) ;
+        args[t].blockTo = MIN(rangeSize * (t + 1), _blockCnt) ;
       }
-      if (rcnt == 1)
+      RunThreads(ClassifyBlocks_Thread, args) ;
+    }
+    else
+    {
+      for (i = 0 ; i < _n ; i += _b)
       {
-        Utils::BitSet(B, i / _b) ;
+        if (IsRunBlock(S, i))
+          Utils::BitSet(B, i / _b) ;
       }
     }
+    // No select is needed, so the bits and rank counters are interleaved for faster rank.
     _useRunBlock.SetSelectSpeed(DS_SELECT_SPEED_NO) ;
+    _useRunBlock.SetRankLayout(BITVECTOR_RANK_LAYOUT_INTERLEAVED) ;
+    _useRunBlock.SetThreadCnt(_threadCnt) ;
     _useRunBlock.Init(B, _blockCnt) ;
     
     // Split the sequence into two parts
@@ -198,52 +322,73 @@ public:
     for ( k = 0 ; k <= 1 ; ++k)
     {
       size_t size = 0 ; 
-      size_t elemPerWord = DIV_CEIL(WORDBITS, alphabetBits) ; // each word can hold this number of elements  
-      WORD w = 0 ; // w holding tempoary elements that will be write into tmpS in chunk
-      size_t wElem = 0 ; // How many element w is holding now
-      for (i = 0 ; i < _n ; i += _b)
+      if (args != NULL)
+      {
+        int t ;
+        for (t = 0 ; t < _threadCnt ; ++t)
+        {
+          args[t].k = k ;
+          args[t].tmpS = &tmpS ;
+          args[t].outFrom = size ;
+          size += (k == 0 ? args[t].plainCnt : args[t].runBlockCnt) ;
+          args[t].outTo = size ;
+        }
+        RunThreads(ExtractBlocks_Thread, args) ;
+        for (t = 0 ; t < _threadCnt ; ++t)
+        {
+          for (i = 0 ; i < args[t].shared.size() ; ++i)
+            tmpS.Write(args[t].shared[i].first, args[t].shared[i].second) ;
+        }
+      }
+      else
       {
-        if (Utils::BitRead(B, i / _b) != k)
-          continue ;
-        if (k == 0)
+        size_t elemPerWord = WORDBITS / alphabetBits ; // each word can hold this number of elements  
+        WORD w = 0 ; // w holding tempoary elements that will be write into tmpS in chunk
+        size_t wElem = 0 ; // How many element w is holding now
+        for (i = 0 ; i < _n ; i += _b)
         {
-          for (j = 0 ; j < _b && i + j < _n ; ++j)
+          if (Utils::BitRead(B, i / _b) != k)
+            continue ;
+          if (k == 0)
+          {
+            for (j = 0 ; j < _b && i + j < _n ; ++j)
+            {
+              w |= (S.Read(i + j) << (wElem * alphabetBits)) ;
+              ++wElem ;
+              if (wElem >= elemPerWord)
+              {
+                tmpS.PackWrite(size, w, wElem) ;
+                size += wElem ;
+              
+                w = 0 ;
+                wElem = 0 ;
+              }
+            }
+          }
+          else
           {
-            w |= (S.Read(i + j) << (wElem * alphabetBits)) ;
+            w |= (S.Read(i) << (wElem * alphabetBits)) ;
             ++wElem ;
             if (wElem >= elemPerWord)
             {
               tmpS.PackWrite(size, w, wElem) ;
               size += wElem ;
-              
+
               w = 0 ;
               wElem = 0 ;
             }
           }
         }
-        else
+
+        if (wElem > 0)
         {
-          w |= (S.Read(i) << (wElem * alphabetBits)) ;
-          ++wElem ;
-          if (wElem >= elemPerWord)
-          {
-            tmpS.PackWrite(size, w, wElem) ;
-            size += wElem ;
+          tmpS.PackWrite(size, w, wElem) ;
+          size += wElem ;
 
-            w = 0 ;
-            wElem = 0 ;
-          }
+          w = 0 ;
+          wElem = 0 ;
         }
       }
-
-      if (wElem > 0)
-      {
-        tmpS.PackWrite(size, w, wElem) ;
-        size += wElem ;
-
-        w = 0 ;
-        wElem = 0 ;
-      }
       
       tmpS.SetSize(size) ;
       //printf("%d %d\n", _b, size) ;
@@ -252,6 +397,8 @@ public:
         if (size > 0)
         {
           _waveletSeq.SetSelectSpeed( DS_SELECT_SPEED_NO ) ;
+          _waveletSeq.SetRankLayout( BITVECTOR_RANK_LAYOUT_INTERLEAVED ) ;
+          _waveletSeq.SetThreadCnt(_threadCnt) ;
           _waveletSeq.Init(tmpS, size, alphabetMap) ;
         }
       }
@@ -260,6 +407,8 @@ public:
         if (size > 0)
         {
           _runBlockSeq.SetSelectSpeed( DS_SELECT_SPEED_NO ) ;
+          _runBlockSeq.SetRankLayout( BITVECTOR_RANK_LAYOUT_INTERLEAVED ) ;
+          _runBlockSeq.SetThreadCnt(_threadCnt) ;
           _runBlockSeq.Init(tmpS, size, alphabetMap) ;
         }
       }
@@ -270,6 +419,8 @@ public:
     //printf("%d %d %d\n", sizeof(*this), sizeof(_waveletSeq), sizeof(_runBlockSeq)) ;
 
     free(B) ;
+    if (args != NULL)
+      delete[] args ;
   }
 
   ALPHABET Access(size_t i) const 
@@ -300,9 +451,8 @@ public:
     }
 
     size_t bi = i / _b ;
-    int type = _useRunBlock.Access(bi) ;
-    //size_t ranki = _useRunBlock.Rank(type, bi) ;
-    size_t ranki = _b < _n ?  _useRunBlock.Rank(type, bi) : 1 ;
+    size_t ranki ;
+    int type = GetBlockTypeAndRank(bi, ranki) ;
     size_t otherRanki = (bi + 1) - ranki ;
      
     size_t ret = 0 ;
@@ -330,6 +480,162 @@ public:
     return ret ;
   }
 
+  // Access and Rank for the plain code of the compile-time length L, e.g. Alphabet_DNA.
+  // Same as Access and Rank, without the alphabet mapping.
+  template <int L>
+  WORD AccessCode(size_t i) const
+  {
+    size_t bi = i / _b ;
+    int type = _useRunBlock.Access(bi) ;
+    if (type == 0)
+    {
+      size_t r = _useRunBlock.Rank(1, bi) ;
+      i -= _b * r ;
+      return _waveletSeq.template AccessCode<L>(i) ;
+    }
+    else
+    {
+      size_t r = _useRunBlock.Rank(0, bi) ;
+      i -= _b * r ;
+      return _runBlockSeq.template AccessCode<L>(i/_b) ;
+    }
+  }
+
+  template <int L>
+  size_t RankCode(WORD code, size_t i, int inclusive = 1) const
+  {
+    if (!inclusive)
+    {
+      if (i == 0)
+        return 0 ;
+      --i ;
+    }
+
+    size_t bi = i / _b ;
+    size_t ranki ;
+    int type = GetBlockTypeAndRank(bi, ranki) ;
+    size_t otherRanki = (bi + 1) - ranki ;
+
+    size_t ret = 0 ;
+    if (type == 0)
+      ret = _waveletSeq.template RankCode<L>(code, (ranki - 1) * _b + i % _b) ;
+    else
+    {
+      bool inRun = true ;
+      size_t rbRank = _runBlockSeq.template RankAndTestCode<L>(code, ranki - 1, inRun) ;
+      if (inRun)
+        ret = (rbRank - 1) * _b + i % _b + 1;
+      else
+        ret = rbRank * _b ;
+    }
+
+    if (otherRanki == 0)
+      return ret ;
+    if (type == 0)
+      ret += _runBlockSeq.template RankCode<L>(code, otherRanki - 1) * _b ;
+    else
+      ret += _waveletSeq.template RankCode<L>(code, otherRanki * _b - 1) ;
+
+    return ret ;
+  }
+
+  // The ranks of code in [0..i] and [0..j] through ri and rj, i <= j.
+  // When i and j are in the same block, which is common deep into a backward search,
+  //   the block lookup and the count from the blocks of the other type are shared.
+  template <int L>
+  void RankCodePair(WORD code, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    size_t bi = i / _b ;
+    if (j / _b != bi)
+    {
+      ri = RankCode<L>(code, i) ;
+      rj = RankCode<L>(code, j) ;
+      return ;
+    }
+    
+    size_t ranki ;
+    int type = GetBlockTypeAndRank(bi, ranki) ;
+    size_t otherRanki = (bi + 1) - ranki ;
+    
+    size_t otherCnt = 0 ; // the count from the blocks of the other type
+    if (type == 0)
+    {
+      size_t offset = (ranki - 1) * _b ;
+      _waveletSeq.template RankCodePair<L>(code, offset + i % _b, offset + j % _b, ri, rj) ;
+      if (otherRanki > 0)
+        otherCnt = _runBlockSeq.template RankCode<L>(code, otherRanki - 1) * _b ;
+    }
+    else
+    {
+      bool inRun = true ;
+      size_t rbRank = _runBlockSeq.template RankAndTestCode<L>(code, ranki - 1, inRun) ;
+      if (inRun)
+      {
+        ri = (rbRank - 1) * _b + i % _b + 1 ;
+        rj = (rbRank - 1) * _b + j % _b + 1 ;
+      }
+      else
+        ri = rj = rbRank * _b ;
+      if (otherRanki > 0)
+        otherCnt = _waveletSeq.template RankCode<L>(code, otherRanki * _b - 1) ;
+    }
+    ri += otherCnt ;
+    rj += otherCnt ;
+  }
+
+  // Return: the alphabet at position i, and its rank in [0..i] through rank.
+  // The part of the rank from the blocks of the same type comes with the access.
+  ALPHABET AccessAndRank(size_t i, size_t &rank) const
+  {
+    size_t bi = i / _b ;
+    size_t ranki ;
+    int type = GetBlockTypeAndRank(bi, ranki) ;
+    size_t otherRanki = (bi + 1) - ranki ;
+
+    ALPHABET c ;
+    if (type == 0)
+    {
+      c = _waveletSeq.AccessAndRank((ranki - 1) * _b + i % _b, rank) ;
+      if (otherRanki > 0)
+        rank += _runBlockSeq.Rank(c, otherRanki - 1) * _b ;
+    }
+    else
+    {
+      size_t rbRank ;
+      c = _runBlockSeq.AccessAndRank(ranki - 1, rbRank) ;
+      rank = (rbRank - 1) * _b + i % _b + 1 ;
+      if (otherRanki > 0)
+        rank += _waveletSeq.Rank(c, otherRanki * _b - 1) ;
+    }
+    return c ;
+  }
+
+  template <int L>
+  WORD AccessCodeAndRank(size_t i, size_t &rank) const
+  {
+    size_t bi = i / _b ;
+    size_t ranki ;
+    int type = GetBlockTypeAndRank(bi, ranki) ;
+    size_t otherRanki = (bi + 1) - ranki ;
+
+    WORD code ;
+    if (type == 0)
+    {
+      code = _waveletSeq.template AccessCodeAndRank<L>((ranki - 1) * _b + i % _b, rank) ;
+      if (otherRanki > 0)
+        rank += _runBlockSeq.template RankCode<L>(code, otherRanki - 1) * _b ;
+    }
+    else
+    {
+      size_t rbRank ;
+      code = _runBlockSeq.template AccessCodeAndRank<L>(ranki - 1, rbRank) ;
+      rank = (rbRank - 1) * _b + i % _b + 1 ;
+      if (otherRanki > 0)
+        rank += _waveletSeq.template RankCode<L>(code, otherRanki * _b - 1) ;
+    }
+    return code ;
+  }
+
   size_t Select(ALPHABET c, size_t i) const
   {
     return 0 ;
@@ -345,7 +651,7 @@ public:
     S.Malloc(alphabetBit, _n) ;
     for (i = 0 ; i < _n ; i += _b)
     {
-      size_t elemPerWord = DIV_CEIL(WORDBITS, alphabetBit) ; // each word can hold this number of elements  
+      size_t elemPerWord = WORDBITS / alphabetBit ; // each word can hold this number of elements  
       WORD w = 0 ;
       if (_useRunBlock.Access(i / _b) == 1)
       {
@@ -0,0 +1,376 @@
+#ifndef _MOURISL_COMPACTDS_SEQUENCE_WAVELETMATRIX
+#define _MOURISL_COMPACTDS_SEQUENCE_WAVELETMATRIX
+
+#include "Utils.hpp"
+#include "Sequence.hpp"
+
+#include <string.h>
+
+#include "Bitvector_Plain.hpp"
+
+// The wavelet matrix for the plain (fixed-length) alphabet coding.
+// Level l holds the l-th bit (from the most significant side) of the codes of all the elements,
+//   where the elements are stably sorted by their first l bits in reversed order (0s before 1s).
+// All the levels are concatenated into one bitvector of length L*n, so the queries
+//   go through one contiguous rank structure instead of the node pointers of the wavelet tree.
+// Each level records its number of 0s, and the starting position of each code after
+//   the last level is precomputed, so a rank query takes one bitvector rank per level.
+namespace compactds {
+template <class BvClass = Bitvector_Plain>
+class Sequence_WaveletMatrix: public Sequence
+{
+private:
+  static const int MAX_LEVEL = sizeof(ALPHABET) * 8 ;
+
+  BvClass _B ; // the concatenated levels, with one extra 0 bit at the end
+  int _L ; // the number of levels, the code length
+  size_t _zeroCnt[MAX_LEVEL] ; // the number of 0s in each level
+  size_t _onesBefore[MAX_LEVEL] ; // the number of 1s in the levels before
+  size_t _codeStart[1 << MAX_LEVEL] ; // the starting position of each code after the last level
+  int _selectSpeed ;
+  int _rankLayout ;
+
+  // The number of 1s in [0, i) of the level
+  size_t LevelRank1(int level, size_t i) const
+  {
+    return _B.Rank1(level * _n + i, /*inclusive=*/0) - _onesBefore[level] ;
+  }
+
+  // Map position e in the level to the next level, by the bit b.
+  // r1 is the number of 1s in [0, e) of the level.
+  size_t NextLevelPosition(int level, int b, size_t e, size_t r1) const
+  {
+    return b ? _zeroCnt[level] + r1 : e - r1 ;
+  }
+
+  // Return the code of length len at position i, and its position after the last level through p
+  WORD AccessCodeAndPosition(int len, size_t i, size_t &p) const
+  {
+    int level ;
+    WORD code = 0 ;
+    p = i ;
+    for (level = 0 ; level < len ; ++level)
+    {
+      size_t r ;
+      int b = _B.AccessAndRank(level * _n + p, r) ;
+      // r is inclusive, so p's own bit is counted and needs -1.
+      if (b)
+        p = _zeroCnt[level] + (r - _onesBefore[level]) - 1 ;
+      else
+        p = r - (level * _n - _onesBefore[level]) - 1 ;
+      code = (code << 1) | b ;
+    }
+    return code ;
+  }
+
+  // Return the number of code in [0, e)
+  size_t RankCodeWithLen(WORD code, int len, size_t e) const
+  {
+    int level ;
+    for (level = 0 ; level < len ; ++level)
+    {
+      int b = (code >> (len - level - 1)) & 1 ;
+      e = NextLevelPosition(level, b, e, LevelRank1(level, e)) ;
+    }
+    return e - _codeStart[code] ;
+  }
+
+  // The ranks of code in [0..i] and [0..j] (i <= j) from one pass over the levels
+  void RankPairWithLen(WORD code, int len, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    int level ;
+    size_t ei = i + 1 ;
+    size_t ej = j + 1 ;
+    for (level = 0 ; level < len ; ++level)
+    {
+      int b = (code >> (len - level - 1)) & 1 ;
+      size_t gi = level * _n + ei ;
+      size_t gj = level * _n + ej ;
+      size_t r1i, r1j ;
+      if (gi > 0)
+        _B.RankPair(1, gi - 1, gj - 1, r1i, r1j) ;
+      else
+      {
+        r1i = 0 ;
+        r1j = _B.Rank1(gj, /*inclusive=*/0) ;
+      }
+      ei = NextLevelPosition(level, b, ei, r1i - _onesBefore[level]) ;
+      ej = NextLevelPosition(level, b, ej, r1j - _onesBefore[level]) ;
+    }
+    ri = ei - _codeStart[code] ;
+    rj = ej - _codeStart[code] ;
+  }
+
+  // Return the number of code in [0..i], and test whether the element i is code through isC
+  size_t RankAndTestCodeWithLen(WORD code, int len, size_t i, bool &isC) const
+  {
+    int level ;
+    size_t e = i + 1 ;
+    isC = true ;
+    for (level = 0 ; level < len ; ++level)
+    {
+      int b = (code >> (len - level - 1)) & 1 ;
+      size_t g = level * _n + e ;
+      size_t r1 ;
+      if (isC)
+      {
+        // The element i is the last one in [0, e) as long as its bits match code so far.
+        size_t r ;
+        int a = _B.AccessAndRank(g - 1, r) ;
+        r1 = a ? r : g - r ;
+        if (a != b)
+          isC = false ;
+      }
+      else
+        r1 = _B.Rank1(g, /*inclusive=*/0) ;
+      e = NextLevelPosition(level, b, e, r1 - _onesBefore[level]) ;
+    }
+    return e - _codeStart[code] ;
+  }
+
+public:
+  Sequence_WaveletMatrix()
+  {
+    _L = 0 ;
+    memset(_zeroCnt, 0, sizeof(_zeroCnt)) ;
+    memset(_onesBefore, 0, sizeof(_onesBefore)) ;
+    memset(_codeStart, 0, sizeof(_codeStart)) ;
+    _selectSpeed = BITVECTOR_DEFAULT_SELECT_SPEED ;
+    _rankLayout = BITVECTOR_RANK_LAYOUT_SEPARATE ;
+  }
+
+  ~Sequence_WaveletMatrix() {Free() ;}
+
+  void Free()
+  {
+    _B.Free() ;
+    _L = 0 ;
+  }
+
+  void SetSelectSpeed(int speed)
+  {
+    _selectSpeed = speed ;
+  }
+
+  void SetRankLayout(int layout)
+  {
+    _rankLayout = layout ;
+  }
+
+  size_t GetSpace() {return _space + _alphabets.GetSpace() - sizeof(_alphabets) + sizeof(*this) ;}
+
+  void Init(const FixedSizeElemArray &S, size_t sequenceLength, const ALPHABET *alphabetMap)
+  {
+    size_t i ;
+    int level ;
+    Free() ;
+    _space = 0 ;
+    _n = sequenceLength ;
+
+    if (_alphabets.GetSize() == 0)
+      _alphabets.InitFromList(alphabetMap, strlen(alphabetMap)) ;
+
+    size_t alphabetSize = _alphabets.GetSize() ;
+    _L = _alphabets.GetLongestCodeLength() ;
+    WORD *codes = (WORD *)malloc(sizeof(WORD) * alphabetSize) ;
+    for (i = 0 ; i < alphabetSize ; ++i)
+    {
+      int l = 0 ;
+      codes[i] = _alphabets.Encode(alphabetMap[i], l) ;
+      if (l != _L)
+      {
+        Utils::PrintLog("Sequence_WaveletMatrix requires the fixed-length alphabet coding.") ;
+        exit(1) ;
+      }
+    }
+
+    // The codes in the order of the current level, and the buffer for the next level
+    FixedSizeElemArray buffer[2] ;
+    FixedSizeElemArray *cur = &buffer[0] ;
+    FixedSizeElemArray *next = &buffer[1] ;
+    if (_L > 0)
+    {
+      cur->Malloc(_L, _n) ;
+      next->Malloc(_L, _n) ;
+      for (i = 0 ; i < _n ; ++i)
+        cur->Write(i, codes[S.Read(i)]) ;
+    }
+    free(codes) ;
+
+    WORD *B = Utils::MallocByBits(_L * _n + 1) ;
+    size_t onesBefore = 0 ;
+    for (level = 0 ; level < _L ; ++level)
+    {
+      const int shift = _L - level - 1 ;
+      size_t onecnt = 0 ;
+      for (i = 0 ; i < _n ; ++i)
+      {
+        if ((cur->Read(i) >> shift) & 1)
+        {
+          Utils::BitSet(B, level * _n + i) ;
+          ++onecnt ;
+        }
+      }
+      _zeroCnt[level] = _n - onecnt ;
+      _onesBefore[level] = onesBefore ;
+      onesBefore += onecnt ;
+
+      if (level == _L - 1)
+        break ;
+      // Stable partition by the bit for the next level
+      size_t zi = 0 ;
+      size_t oi = _zeroCnt[level] ;
+      for (i = 0 ; i < _n ; ++i)
+      {
+        WORD c = cur->Read(i) ;
+        if ((c >> shift) & 1)
+          next->Write(oi++, c) ;
+        else
+          next->Write(zi++, c) ;
+      }
+      FixedSizeElemArray *tmp = cur ;
+      cur = next ;
+      next = tmp ;
+    }
+
+    _B.SetSelectSpeed(_selectSpeed) ;
+    _B.SetRankLayout(_rankLayout) ;
+    _B.SetThreadCnt(_threadCnt) ;
+    _B.Init(B, _L * _n + 1) ;
+    free(B) ;
+    _space += _B.GetSpace() - sizeof(_B) ;
+
+    // The starting position of a code only depends on the code itself.
+    WORD code ;
+    for (code = 0 ; code < (1ull << _L) ; ++code)
+    {
+      size_t s = 0 ;
+      for (level = 0 ; level < _L ; ++level)
+      {
+        int b = (code >> (_L - level - 1)) & 1 ;
+        s = NextLevelPosition(level, b, s, LevelRank1(level, s)) ;
+      }
+      _codeStart[code] = s ;
+    }
+  }
+
+  // Return: the alphabet at position i.
+  ALPHABET Access(size_t i) const
+  {
+    size_t p ;
+    return _alphabets.Decode(AccessCodeAndPosition(_L, i, p), _L) ;
+  }
+
+  // Return: the alphabet at position i, and its rank in [0..i] through rank.
+  ALPHABET AccessAndRank(size_t i, size_t &rank) const
+  {
+    size_t p ;
+    WORD code = AccessCodeAndPosition(_L, i, p) ;
+    rank = p - _codeStart[code] + 1 ;
+    return _alphabets.Decode(code, _L) ;
+  }
+
+  // Return: the number of alphabet c's in [0..i]
+  size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const
+  {
+    return RankCodeWithLen(_alphabets.Encode(c), _L, i + inclusive) ;
+  }
+
+  // Return: the ranks of c in [0..i] and [0..j] through ri and rj, i <= j
+  void RankPair(ALPHABET c, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    RankPairWithLen(_alphabets.Encode(c), _L, i, j, ri, rj) ;
+  }
+
+  // Return: rank of c in [0..i] (inclusive),
+  //  also test whether T[i]==c, return through isC
+  size_t RankAndTest(ALPHABET c, size_t i, bool &isC) const
+  {
+    return RankAndTestCodeWithLen(_alphabets.Encode(c), _L, i, isC) ;
+  }
+
+  // The code-based queries with the same interface as Sequence_WaveletTree,
+  //   L should be the same as the number of levels.
+  template <int L>
+  WORD AccessCode(size_t i) const
+  {
+    size_t p ;
+    return AccessCodeAndPosition(L, i, p) ;
+  }
+
+  template <int L>
+  WORD AccessCodeAndRank(size_t i, size_t &rank) const
+  {
+    size_t p ;
+    WORD code = AccessCodeAndPosition(L, i, p) ;
+    rank = p - _codeStart[code] + 1 ;
+    return code ;
+  }
+
+  // Return: the number of code's in [0..i]
+  template <int L>
+  size_t RankCode(WORD code, size_t i) const
+  {
+    return RankCodeWithLen(code, L, i + 1) ;
+  }
+
+  template <int L>
+  void RankCodePair(WORD code, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    RankPairWithLen(code, L, i, j, ri, rj) ;
+  }
+
+  template <int L>
+  size_t RankAndTestCode(WORD code, size_t i, bool &isC) const
+  {
+    return RankAndTestCodeWithLen(code, L, i, isC) ;
+  }
+
+  // return: the index of the ith (1-based) c
+  size_t Select(ALPHABET c, size_t i) const
+  {
+    int level ;
+    WORD code = _alphabets.Encode(c) ;
+    size_t p = _codeStart[code] + i - 1 ;
+    for (level = _L - 1 ; level >= 0 ; --level)
+    {
+      int b = (code >> (_L - level - 1)) & 1 ;
+      if (b)
+        p = _B.Select(1, _onesBefore[level] + p - _zeroCnt[level] + 1) - level * _n ;
+      else
+        p = _B.Select(0, level * _n - _onesBefore[level] + p + 1) - level * _n ;
+    }
+    return p ;
+  }
+
+  void Save(FILE *fp)
+  {
+    Sequence::Save(fp) ;
+    SAVE_VAR(fp, _L) ;
+    SAVE_VAR(fp, _selectSpeed) ;
+    SAVE_ARR(fp, _zeroCnt, _L) ;
+    SAVE_ARR(fp, _onesBefore, _L) ;
+    SAVE_ARR(fp, _codeStart, 1 << _L) ;
+    _B.Save(fp) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+    Sequence::Load(fp) ;
+    LOAD_VAR(fp, _L) ;
+    LOAD_VAR(fp, _selectSpeed) ;
+    LOAD_ARR(fp, _zeroCnt, _L) ;
+    LOAD_ARR(fp, _onesBefore, _L) ;
+    LOAD_ARR(fp, _codeStart, 1 << _L) ;
+    _B.Load(fp) ;
+  }
+
+  void PrintStats()
+  {
+    Utils::PrintLog("Sequence_WaveletMatrix: total_length: %lu levels: %d", _n, _L) ;
+  }
+} ;
+}
+
+#endif
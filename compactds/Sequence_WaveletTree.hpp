@@ -5,6 +5,9 @@
 #include "Sequence.hpp"
 
 #include <string.h>
+#include <pthread.h>
+
+#include <vector>
 
 #include "Bitvector_Plain.hpp"
 #include "Bitvector_RunLength.hpp"
@@ -35,6 +38,95 @@ struct _sequence_wavelettree_node
   }
 } ;
 
+template <class BvClass>
+class Sequence_WaveletTree ;
+
+template <class BvClass>
+struct _sequence_wavelettree_threadArg
+{
+  int tid ;
+  int threadCnt ;
+  Sequence_WaveletTree<BvClass> *tree ;
+
+  const FixedSizeElemArray *S ;
+  const ALPHABET *alphabetMap ;
+  int pos ;
+  WORD *v ;
+  size_t from, to ; // [from, to) on S, from is a multiple of WORDBITS
+
+  uint64_t onecnt ;
+  int maxPosToRight ;
+  
+  bool byWord ; // use the word-parallel construction
+  
+  FixedSizeElemArray *left, *right ;
+  size_t leftFrom, leftTo, rightFrom, rightTo ; // the ranges to write in left and right
+  // The elements sharing the words with other threads, written after the threads finish.
+  std::vector< std::pair<size_t, WORD> > leftShared, rightShared ; 
+} ;
+
+// Append packed elements to a FixedSizeElemArray, and write them a word at a time.
+// The elements in the words shared with other threads are held in "shared" if it is not NULL.
+// Assumes the element length divides the word size.
+struct _sequence_wavelettree_packedWriter
+{
+  FixedSizeElemArray *A ;
+  int l ; // element length
+  int elemPerWord ;
+  size_t from, to ; // the range to write in A
+  std::vector< std::pair<size_t, WORD> > *shared ;
+
+  WORD w ; // elements not written yet 
+  size_t wStart ; // the index of the first element in w 
+  int wElem ; 
+
+  void Init(FixedSizeElemArray *inA, size_t inFrom, size_t inTo, std::vector< std::pair<size_t, WORD> > *inShared)
+  {
+    A = inA ;
+    l = A->GetElemLength() ;
+    elemPerWord = WORDBITS / l ;
+    from = inFrom ;
+    to = inTo ;
+    shared = inShared ;
+    w = 0 ;
+    wStart = from ;
+    wElem = 0 ;
+  }
+
+  void Flush()
+  {
+    if (wElem == 0)
+      return ;
+    if (shared != NULL && A->IsElemSharingWord(wStart, from, to))
+    {
+      int i ;
+      for (i = 0 ; i < wElem ; ++i)
+        shared->push_back( std::pair<size_t, WORD>(wStart + i, (w >> (i * l)) & MASK(l)) ) ;
+    }
+    else
+      A->PackWrite(wStart, w, wElem) ;
+    wStart += wElem ;
+    w = 0 ;
+    wElem = 0 ;
+  }
+
+  // Append m elements packed in x
+  void Append(WORD x, int m)
+  {
+    while (m > 0)
+    {
+      int room = elemPerWord - (wStart + wElem) % elemPerWord ;
+      int take = (room < m) ? room : m ;
+      w |= (x & MASK_WCHECK(take * l)) << (wElem * l) ;
+      x = (take * l < WORDBITS) ? (x >> (take * l)) : 0 ;
+      wElem += take ;
+      m -= take ;
+      if ((wStart + wElem) % elemPerWord == 0)
+        Flush() ;
+    }
+  }
+} ;
+
 // The implementation of wavelet tree in either
 // perfect balanced or huffman shape,
 // depending on the choice of alphabet.
@@ -45,18 +137,20 @@ private:
   struct _sequence_wavelettree_node<BvClass> *_T ; 
   int _tNodeCnt ;
   int _selectSpeed ;
+  int _rankLayout ; // the rank layout of the node bitvectors, which is saved by the bitvectors
 
   // Based on the pos-th bits (0-index, count from leftside)
+  // Only consider the elements in [from, to).
   // maxPosToRight: record the maximum distance from pos to right side. 
   // return: the number of 1s
-  uint64_t ConvertSequenceToBits(const FixedSizeElemArray &S, const ALPHABET *alphabetMap, int pos, WORD *v, int &maxPosToRight)
+  uint64_t ConvertSequenceToBits(const FixedSizeElemArray &S, const ALPHABET *alphabetMap, int pos, WORD *v, 
+      size_t from, size_t to, int &maxPosToRight) const
   {
     size_t i ;
-    size_t n = S.GetSize() ;
     uint64_t ret = 0;
     maxPosToRight = 0 ;
 
-    for (i = 0 ; i < n ; ++i)
+    for (i = from ; i < to ; ++i)
     { 
       int codeLen = 0 ;
       int b = _alphabets.Encode( alphabetMap[S.Read(i)], codeLen ) ;
@@ -72,36 +166,166 @@ private:
   }
   
   // Assume left and right's memory has been allocated.
-  void SplitSequence(const FixedSizeElemArray &orig, WORD *v,
-      FixedSizeElemArray &left, FixedSizeElemArray &right)
+  // Split the elements in orig[from, to) to left[leftFrom, leftTo) and right[rightFrom, rightTo).
+  // leftShared, rightShared: if not NULL, hold the elements whose words are shared with other threads 
+  //   instead of writing them directly.
+  void SplitSequence(const FixedSizeElemArray &orig, const WORD *v, size_t from, size_t to, 
+      FixedSizeElemArray &left, size_t leftFrom, size_t leftTo, 
+      FixedSizeElemArray &right, size_t rightFrom, size_t rightTo,
+      std::vector< std::pair<size_t, WORD> > *leftShared, 
+      std::vector< std::pair<size_t, WORD> > *rightShared) const
   {
     size_t i ;
-    size_t len = orig.GetSize() ;
-   
-    size_t leftLen = 0 ;
-    size_t rightLen = 0 ;
-    for (i = 0 ; i < len ; ++i)
+    size_t leftLen = leftFrom ;
+    size_t rightLen = rightFrom ;
+
+    for (i = from ; i < to ; ++i)
     {
       if (!Utils::BitRead(v, i))
       {
-        left.Write(leftLen, orig.Read(i)) ; 
+        if (leftShared != NULL && left.IsElemSharingWord(leftLen, leftFrom, leftTo))
+          leftShared->push_back( std::pair<size_t, WORD>(leftLen, orig.Read(i)) ) ;
+        else
+          left.Write(leftLen, orig.Read(i)) ; 
         ++leftLen ;
       }
       else
       {
-        right.Write(rightLen, orig.Read(i)) ;
+        if (rightShared != NULL && right.IsElemSharingWord(rightLen, rightFrom, rightTo))
+          rightShared->push_back( std::pair<size_t, WORD>(rightLen, orig.Read(i)) ) ;
+        else
+          right.Write(rightLen, orig.Read(i)) ;
         ++rightLen ;
       }
     }
   }
 
+  // Whether every element of S is its own fixed-length code and no element crosses word boundary,
+  //   so each level can be built a word at a time. It is the case for the small plain alphabets like DNA.
+  bool IsWordParallelApplicable(const FixedSizeElemArray &S, const ALPHABET *alphabetMap) const
+  {
+    int l = S.GetElemLength() ;
+    if (l <= 0 || l > 8 || WORDBITS % l != 0)
+      return false ;
+    size_t i ;
+    size_t alphabetSize = _alphabets.GetSize() ;
+    if (alphabetSize > (1ull << l))
+      return false ;
+    for (i = 0 ; i < alphabetSize ; ++i)
+    {
+      int codeLen = 0 ;
+      if (_alphabets.Encode(alphabetMap[i], codeLen) != i || codeLen != l)
+        return false ;
+    }
+    return true ;
+  }
+
+  // The word-parallel version of ConvertSequenceToBits. 
+  // from should be a multiple of WORDBITS. 
+  uint64_t ConvertSequenceToBitsByWord(const FixedSizeElemArray &S, int pos, WORD *v, 
+      size_t from, size_t to, int &maxPosToRight) const
+  {
+    size_t i ;
+    uint64_t ret = 0 ;
+    const int l = S.GetElemLength() ;
+    const int elemPerWord = WORDBITS / l ;
+    const int shift = l - pos - 1 ; 
+    WORD strideMask = 0 ; // the lowest bit of each element
+    for (i = 0 ; i < (size_t)elemPerWord ; ++i)
+      strideMask |= (1ull << (i * l)) ;
+
+    maxPosToRight = (from < to) ? l - pos : 0 ;
+    for (i = from ; i < to ; i += elemPerWord)
+    {
+      int cnt = (to - i < (size_t)elemPerWord) ? (to - i) : elemPerWord ;
+      WORD x = S.PackRead(i, cnt) ;
+      WORD bits = Utils::BitsExtract(x >> shift, strideMask & MASK_WCHECK(cnt * l)) ;
+      v[i >> WORDBITS_WIDTH] |= (bits << (i & (WORDBITS - 1))) ;
+      ret += Utils::Popcount(bits) ;
+    }
+    return ret ;
+  }
+
+  // The word-parallel version of SplitSequence.
+  // from should be a multiple of WORDBITS. 
+  void SplitSequenceByWord(const FixedSizeElemArray &orig, const WORD *v, size_t from, size_t to, 
+      FixedSizeElemArray &left, size_t leftFrom, size_t leftTo, 
+      FixedSizeElemArray &right, size_t rightFrom, size_t rightTo,
+      std::vector< std::pair<size_t, WORD> > *leftShared, 
+      std::vector< std::pair<size_t, WORD> > *rightShared) const
+  {
+    size_t i ;
+    const int l = orig.GetElemLength() ;
+    const int elemPerWord = WORDBITS / l ;
+    WORD strideMask = 0 ;
+    for (i = 0 ; i < (size_t)elemPerWord ; ++i)
+      strideMask |= (1ull << (i * l)) ;
+    
+    struct _sequence_wavelettree_packedWriter leftWriter, rightWriter ;
+    leftWriter.Init(&left, leftFrom, leftTo, leftShared) ;
+    rightWriter.Init(&right, rightFrom, rightTo, rightShared) ;
+    for (i = from ; i < to ; i += elemPerWord)
+    {
+      int cnt = (to - i < (size_t)elemPerWord) ? (to - i) : elemPerWord ;
+      WORD x = orig.PackRead(i, cnt) ;
+      WORD bits = (v[i >> WORDBITS_WIDTH] >> (i & (WORDBITS - 1))) & MASK_WCHECK(cnt) ;
+      // Expand each bit to the whole element
+      WORD rightMask = Utils::BitsDeposit(bits, strideMask) * MASK(l) ;
+      WORD leftMask = ~rightMask & MASK_WCHECK(cnt * l) ;
+      int rightCnt = Utils::Popcount(bits) ;
+
+      leftWriter.Append(Utils::BitsExtract(x, leftMask), cnt - rightCnt) ;
+      rightWriter.Append(Utils::BitsExtract(x, rightMask), rightCnt) ;
+    }
+    leftWriter.Flush() ;
+    rightWriter.Flush() ;
+  }
+
+  static void *ConvertSequenceToBits_Thread(void *arg)
+  {
+    struct _sequence_wavelettree_threadArg<BvClass> *pArg = (struct _sequence_wavelettree_threadArg<BvClass> *)arg ;
+    if (pArg->byWord)
+      pArg->onecnt = pArg->tree->ConvertSequenceToBitsByWord(*(pArg->S), pArg->pos, pArg->v, 
+          pArg->from, pArg->to, pArg->maxPosToRight) ;
+    else
+      pArg->onecnt = pArg->tree->ConvertSequenceToBits(*(pArg->S), pArg->alphabetMap, pArg->pos, pArg->v, 
+          pArg->from, pArg->to, pArg->maxPosToRight) ;
+    pthread_exit(NULL) ;
+  }
+  
+  static void *SplitSequence_Thread(void *arg)
+  {
+    struct _sequence_wavelettree_threadArg<BvClass> *pArg = (struct _sequence_wavelettree_threadArg<BvClass> *)arg ;
+    if (pArg->byWord)
+      pArg->tree->SplitSequenceByWord(*(pArg->S), pArg->v, pArg->from, pArg->to,
+          *(pArg->left), pArg->leftFrom, pArg->leftTo, *(pArg->right), pArg->rightFrom, pArg->rightTo, 
+          &(pArg->leftShared), &(pArg->rightShared)) ;
+    else
+      pArg->tree->SplitSequence(*(pArg->S), pArg->v, pArg->from, pArg->to,
+          *(pArg->left), pArg->leftFrom, pArg->leftTo, *(pArg->right), pArg->rightFrom, pArg->rightTo, 
+          &(pArg->leftShared), &(pArg->rightShared)) ;
+    pthread_exit(NULL) ;
+  }
+
+  void RunThreads(void *(*func)(void *), struct _sequence_wavelettree_threadArg<BvClass> *args)
+  {
+    int i ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * _threadCnt) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, func, (void *)(args + i)) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    free(threads) ;
+  }
+
   // The recursive function that construct the tree.
   // Assumes that the leaf node always has the brother.
   // depth: how many bits has been processed so far
   // tused: the number of wavelet tree node used so far
   // bufferv: preallcoated memory to holding temporary bit array
+  // byWord: whether to use the word-parallel construction
   // return: node id (index in T)
-  int BuildTree(const FixedSizeElemArray &S, const ALPHABET *alphabetMap, int depth, WORD prefix, WORD *bufferv)
+  int BuildTree(const FixedSizeElemArray &S, const ALPHABET *alphabetMap, int depth, WORD prefix, WORD *bufferv, bool byWord)
   {
     size_t len = S.GetSize() ;
     int ti = _tNodeCnt ;
@@ -109,8 +333,46 @@ private:
     int remainingBits ;
     
     memset(bufferv, 0, Utils::BitsToWordBytes(len)) ;
-    uint64_t onecnt = ConvertSequenceToBits(S, alphabetMap, depth, bufferv, remainingBits) ;
+    uint64_t onecnt = 0 ;
+    
+    struct _sequence_wavelettree_threadArg<BvClass> *args = NULL ;
+    if (_threadCnt > 1 && len >= (size_t)_threadCnt * WORDBITS)
+    {
+      // Each thread handles a range aligned to WORDBITS, 
+      //   so the bits of v set by the threads are in different words.
+      int i ;
+      size_t blockSize = DIV_CEIL(DIV_CEIL(len, WORDBITS), _threadCnt) * WORDBITS ;
+      args = new struct _sequence_wavelettree_threadArg<BvClass>[_threadCnt] ;
+      for (i = 0 ; i < _threadCnt ; ++i)
+      {
+        args[i].tid = i ;
+        args[i].threadCnt = _threadCnt ;
+        args[i].tree = this ;
+        args[i].S = &S ;
+        args[i].alphabetMap = alphabetMap ;
+        args[i].pos = depth ;
+        args[i].v = bufferv ;
+        args[i].byWord = byWord ;
+        args[i].from = MIN(blockSize * i, len) ;
+        args[i].to = MIN(blockSize * (i + 1), len) ;
+      }
+      RunThreads(ConvertSequenceToBits_Thread, args) ;
+      remainingBits = 0 ;
+      for (i = 0 ; i < _threadCnt ; ++i)
+      {
+        onecnt += args[i].onecnt ;
+        if (args[i].maxPosToRight > remainingBits)
+          remainingBits = args[i].maxPosToRight ;
+      }
+    }
+    else if (byWord)
+      onecnt = ConvertSequenceToBitsByWord(S, depth, bufferv, 0, len, remainingBits) ;
+    else
+      onecnt = ConvertSequenceToBits(S, alphabetMap, depth, bufferv, 0, len, remainingBits) ;
+    
     _T[ti].v.SetSelectSpeed(_selectSpeed) ;
+    _T[ti].v.SetRankLayout(_rankLayout) ;
+    _T[ti].v.SetThreadCnt(_threadCnt) ;
     _T[ti].v.Init(bufferv, len) ;
     _space += _T[ti].v.GetSpace() - sizeof(_T[ti].v) ;
     _T[ti].prefix = prefix ;
@@ -119,19 +381,76 @@ private:
     {
       // Reach leaf.
       _T[ti].children[0] = _T[ti].children[1] = -1 ;
+      if (args != NULL)
+        delete[] args ;
       return ti ;
     }
     FixedSizeElemArray leftS, rightS ; // the memory should be automatically released
     leftS.Malloc(S.GetElemLength(), len - onecnt) ;
     rightS.Malloc(S.GetElemLength(), onecnt) ;
-    SplitSequence(S, bufferv, leftS, rightS) ;
+    if (args != NULL)
+    {
+      int i ;
+      size_t leftFrom = 0 ;
+      size_t rightFrom = 0 ;
+      for (i = 0 ; i < _threadCnt ; ++i)
+      {
+        args[i].left = &leftS ;
+        args[i].right = &rightS ;
+        args[i].leftFrom = leftFrom ;
+        args[i].rightFrom = rightFrom ;
+        leftFrom += (args[i].to - args[i].from) - args[i].onecnt ;
+        rightFrom += args[i].onecnt ;
+        args[i].leftTo = leftFrom ;
+        args[i].rightTo = rightFrom ;
+      }
+      RunThreads(SplitSequence_Thread, args) ;
+      for (i = 0 ; i < _threadCnt ; ++i)
+      {
+        size_t j ;
+        for (j = 0 ; j < args[i].leftShared.size() ; ++j)
+          leftS.Write(args[i].leftShared[j].first, args[i].leftShared[j].second) ;
+        for (j = 0 ; j < args[i].rightShared.size() ; ++j)
+          rightS.Write(args[i].rightShared[j].first, args[i].rightShared[j].second) ;
+      }
+      delete[] args ;
+    }
+    else if (byWord)
+      SplitSequenceByWord(S, bufferv, 0, len, leftS, 0, len - onecnt, rightS, 0, onecnt, NULL, NULL) ;
+    else
+      SplitSequence(S, bufferv, 0, len, leftS, 0, len - onecnt, rightS, 0, onecnt, NULL, NULL) ;
 
-    _T[ti].children[0] = BuildTree(leftS, alphabetMap, depth + 1, prefix << 1, bufferv) ;
-    _T[ti].children[1] = BuildTree(rightS, alphabetMap, depth + 1, (prefix << 1) | 1ull, bufferv) ;
+    _T[ti].children[0] = BuildTree(leftS, alphabetMap, depth + 1, prefix << 1, bufferv, byWord) ;
+    _T[ti].children[1] = BuildTree(rightS, alphabetMap, depth + 1, (prefix << 1) | 1ull, bufferv, byWord) ;
 
     return ti ;
   }
   
+  // The ranks of the code with length l in [0..i] and [0..j] (i <= j).
+  // The two positions go through the same nodes, so each node is visited once.
+  void RankPairWithCode(WORD code, int l, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    int depth ;
+    int ti = 0 ;
+    bool hasI = true ; // whether [0..i] is non-empty in the current node, ri stays 0 otherwise
+    ri = rj = 0 ;
+    for (depth = 0 ; depth < l ; ++depth)
+    {
+      int b = (code >> (l - depth - 1)) & 1 ;
+      if (hasI)
+        _T[ti].v.RankPair(b, i, j, ri, rj) ;
+      else
+        rj = RankInNode(ti, b, j) ;
+      
+      if (rj == 0 || depth == l - 1)
+        break ;
+      hasI = (ri > 0) ;
+      i = ri - 1 ;
+      j = rj - 1 ;
+      ti = _T[ti].children[b] ;
+    }
+  }
+
   int AccessInNode(int ti, size_t i) const
   {
     return _T[ti].v.Access(i) ;
@@ -170,6 +489,7 @@ public:
   {
     _tNodeCnt = 0 ;
     _selectSpeed = BITVECTOR_DEFAULT_SELECT_SPEED ;
+    _rankLayout = BITVECTOR_RANK_LAYOUT_SEPARATE ;
   }
 
   ~Sequence_WaveletTree() {Free() ;}
@@ -189,6 +509,11 @@ public:
     _selectSpeed = speed ;
   }
 
+  void SetRankLayout(int layout)
+  {
+    _rankLayout = layout ;
+  }
+
   size_t GetSpace() {return _space + _alphabets.GetSpace() - sizeof(_alphabets) + sizeof(this) ;} 
   
   // We compactly represent the input sequence as fixed-size element array in a plain fashion
@@ -206,7 +531,7 @@ public:
     _space += sizeof(*_T) * (_alphabets.GetAlphabetCapacity() - 1) ;
     
     WORD *bufferv = Utils::MallocByBits(sequenceLength) ; 
-    BuildTree(S, alphabetMap, 0, 0, bufferv) ;
+    BuildTree(S, alphabetMap, 0, 0, bufferv, IsWordParallelApplicable(S, alphabetMap)) ;
     free(bufferv) ;
   }
 
@@ -230,6 +555,24 @@ public:
     return _alphabets.Decode(code, l) ;
   }
 
+  // Return: the alphabet at position i, and its rank in [0..i] through rank.
+  // The rank in the leaf's parent node is the rank in the sequence, 
+  //   so this costs the same as Access.
+  ALPHABET AccessAndRank(size_t i, size_t &rank) const 
+  {
+    int l = 0 ;
+    WORD code = 0 ;
+    int ti = 0 ;
+    for (l = 0 ; ti != -1 ; ++l)
+    {
+      int b = _T[ti].v.AccessAndRank(i, rank) ;
+      code = (code << 1) | b ;
+      i = rank - 1 ;
+      ti = _T[ti].children[b] ;
+    }
+    return _alphabets.Decode(code, l) ;
+  }
+
   // Return: the number of alphabet c's in [0..i]  
   size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const 
   {
@@ -262,6 +605,14 @@ public:
     return i ;
   }
 
+  // Return: the ranks of c in [0..i] and [0..j] through ri and rj, i <= j
+  void RankPair(ALPHABET c, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    int l = 0 ;
+    WORD code = _alphabets.Encode(c, l) ;
+    RankPairWithCode(code, l, i, j, ri, rj) ;
+  }
+
   // Return: rank of c in [0..i] (inclusive), 
   //  also test whether T[i]==c, return through isC
   size_t RankAndTest(ALPHABET c, size_t i, bool &isC) const
@@ -291,6 +642,89 @@ public:
     return i ;
   }
 
+  // The Access, Rank and RankAndTest for the plain code of a fixed length L,
+  //   e.g. Alphabet_DNA. L is known at compile time, so the loop over
+  //   the tree levels can be unrolled. The code is used directly without the alphabet mapping.
+  template <int L>
+  WORD AccessCode(size_t i) const
+  {
+    int depth ;
+    WORD code = 0 ;
+    int ti = 0 ;
+    for (depth = 0 ; depth < L ; ++depth)
+    {
+      int b = AccessInNode(ti, i) ;
+      code = (code << 1) | b ;
+      if (depth == L - 1)
+        break ;
+      i = RankInNode(ti, b, i) - 1 ;
+      ti = _T[ti].children[b] ;
+    }
+    return code ;
+  }
+
+  template <int L>
+  WORD AccessCodeAndRank(size_t i, size_t &rank) const
+  {
+    int depth ;
+    WORD code = 0 ;
+    int ti = 0 ;
+    for (depth = 0 ; depth < L ; ++depth)
+    {
+      int b = _T[ti].v.AccessAndRank(i, rank) ;
+      code = (code << 1) | b ;
+      if (depth == L - 1)
+        break ;
+      i = rank - 1 ;
+      ti = _T[ti].children[b] ;
+    }
+    return code ;
+  }
+
+  // Return: the number of code's in [0..i]
+  template <int L>
+  size_t RankCode(WORD code, size_t i) const
+  {
+    int depth ;
+    int ti = 0 ;
+    for (depth = 0 ; depth < L ; ++depth)
+    {
+      int b = (code >> (L - depth - 1)) & 1 ;
+      i = RankInNode(ti, b, i) ;
+      if (i == 0 || depth == L - 1)
+        break ;
+      --i ;
+      ti = _T[ti].children[b] ;
+    }
+    return i ;
+  }
+
+  template <int L>
+  void RankCodePair(WORD code, size_t i, size_t j, size_t &ri, size_t &rj) const
+  {
+    RankPairWithCode(code, L, i, j, ri, rj) ;
+  }
+
+  template <int L>
+  size_t RankAndTestCode(WORD code, size_t i, bool &isC) const
+  {
+    int depth ;
+    int ti = 0 ;
+    isC = true ;
+    for (depth = 0 ; depth < L ; ++depth)
+    {
+      int b = (code >> (L - depth - 1)) & 1 ;
+      if (isC && b != AccessInNode(ti, i))
+        isC = false ;
+      i = RankInNode(ti, b, i) ;
+      if (i == 0 || depth == L - 1)
+        break ;
+      --i ;
+      ti = _T[ti].children[b] ;
+    }
+    return i ;
+  }
+
   // return: the index of the ith (1-based) c 
   size_t Select(ALPHABET c, size_t i) const 
   {
@@ -3,18 +3,52 @@
 
 #include <vector>
 
+#include <pthread.h>
+
 #include "FixedSizeElemArray.hpp"
+#include "FixedByteElemArray.hpp"
 #include "DifferenceCover.hpp"
 
 // The class handle the generation of suffix array by chunks
 // The chunk creation is based the sampled difference cover (Algorithm 11.9 from the textbook is commented out)
 namespace compactds {
+class SuffixArrayGenerator ;
+
+// The argument for the threads sorting the difference cover.
+// The meaning of from/to depends on the stage: range on sa, buckets or L.
+struct _SAGeneratorDCSortThreadArg
+{
+  int tid ;
+  int threadCnt ;
+
+  SuffixArrayGenerator *saGenerator ;
+  const FixedSizeElemArray *T ;
+  size_t n ;
+
+  size_t *sa ;
+  size_t *rank ;
+  size_t *buffer ; // holding bucket keys, group start flags or new ranks 
+  size_t *target ; // the scatter destination for bucketing
+  size_t *L ;
+  
+  size_t from, to ; // [from, to)
+  size_t offset ; // the position on sa for L[from] 
+  size_t h ;
+
+  int bucketWidth ; // number of characters in the bucket key
+  size_t *bucketCounts ; // this thread's bucket counts, later the write positions 
+  size_t *bucketStart ; 
+
+  std::vector<size_t> newL ; // the new runs from this thread's portion of L 
+} ;
+
 class SuffixArrayGenerator
 {
 private:
   size_t _n ;
   size_t _space ;
   size_t _alphabetSize ;
+  int _threadCnt ; // threads used for sorting the difference cover
   
   // The variables relate to generate the boundaries/_cuts 
   size_t _b ;
@@ -235,6 +269,20 @@ private:
     tmp = a ; a = b ; b = tmp ;
   }
 
+  // The suffix sorting below works on both the plain array and the 
+  //   byte-packed array, the element swap is the only difference.
+  static void SwapSA(size_t *sa, size_t i, size_t j)
+  {
+    size_t tmp = sa[i] ;
+    sa[i] = sa[j] ;
+    sa[j] = tmp ;
+  }
+
+  static void SwapSA(FixedByteElemArray &sa, size_t i, size_t j)
+  {
+    sa.Swap(i, j) ;
+  }
+
   // Compare T[a:] and T[b:] directly with DC, which assumes their first
   //  v prefix are matched
   // @return: sign(T[a:]-T[b:])
@@ -261,12 +309,13 @@ private:
   }
 
   // Use difference cover to quick sort the SA. We don't need to pass T now  
-  void QSortWithDC(size_t *sa, size_t m, size_t s, size_t e, size_t n)
+  template <class SAType>
+  void QSortWithDC(SAType &sa, size_t m, size_t s, size_t e, size_t n)
   {
     if (s >= e)
       return ;
     // Partition
-    Swap(sa[s], sa[(s + e)/2]) ;
+    SwapSA(sa, s, (s + e)/2) ;
     size_t pivot = sa[s] ; // pivot is the median element
     size_t pi, pj ; // partiation indexes
     pi = s + 1; // pi points to the current process element
@@ -279,11 +328,11 @@ private:
         ++pi ;
       else
       {
-        Swap(sa[pi], sa[pj - 1]) ;
+        SwapSA(sa, pi, pj - 1) ;
         --pj ;
       }
     }
-    Swap(sa[s], sa[pi - 1]) ;
+    SwapSA(sa, s, pi - 1) ;
     if (pi > 2)
       QSortWithDC(sa, m, s, pi - 2, n) ;
     QSortWithDC(sa, m, pi, e, n) ;
@@ -387,7 +436,8 @@ private:
   // s, e: the range for sa
   // d: the preifx already matched in T[s..e], kind of as depth.
   // dcStrategy: how to use the difference cover. 0-no _dc, 1-use _dc, 2-return when reach _dcv
-  void MultikeyQSort(const FixedSizeElemArray &T, size_t n, size_t *sa, size_t m, size_t s, size_t e, size_t d, int dcStrategy, size_t *alphabetCounts)
+  template <class SAType>
+  void MultikeyQSort(const FixedSizeElemArray &T, size_t n, SAType &sa, size_t m, size_t s, size_t e, size_t d, int dcStrategy, size_t *alphabetCounts)
   {
     if (s >= e)
       return ;
@@ -408,7 +458,9 @@ private:
     // Find pivot
     size_t pivot = 0 ;
     
-    // quick check whether every suffix is the same using blocks
+    // quick check whether every suffix is the same using blocks.
+    // The shortest common prefix within the block is found by XOR, 
+    //   so we can also skip the partially shared characters.
     const int alphabetBits = T.GetElemLength() ;
     const int block = WORDBITS / alphabetBits ;
     while (1)
@@ -417,6 +469,7 @@ private:
         break ;
       bool passEnd = false ; // any suffix pass the end of the T
       WORD foundw = 0 ;
+      int minMatch = block ; // the shortest shared prefix in this block
       if (sa[s] + d + block - 1 < n)
         foundw = T.PackRead(sa[s] + d, block) ;
       else
@@ -430,7 +483,15 @@ private:
           {
             WORD w = T.PackRead(sa[i] + d, block) ;
             if (w != foundw)
-              break ;
+            {
+              int match = Utils::CountTrailingZeros(w ^ foundw) / alphabetBits ;
+              if (match < minMatch)
+              {
+                minMatch = match ;
+                if (minMatch == 0)
+                  break ;
+              }
+            }
           }
           else
           {
@@ -440,10 +501,20 @@ private:
           }
         }
       }
-      if (!passEnd && i > e)
+      if (!passEnd && minMatch == block)
         d += block ;
       else
+      {
+        if (!passEnd && minMatch > 0)
+        {
+          // Do not step over the difference cover boundary, where the
+          //   character-wise search below would stop.
+          if (dcStrategy != 0 && d + minMatch > (size_t)_dc.GetV())
+            minMatch = _dc.GetV() - d ;
+          d += minMatch ;
+        }
         break ;
+      }
     }
 
     // Real search
@@ -510,12 +581,12 @@ private:
 
       if (comparePivot == -1)
       {
-        Swap(sa[pi], sa[pj]) ;
+        SwapSA(sa, pi, pj) ;
         ++pi ; ++pj ;
       }
       else if (comparePivot == 1)
       {
-        Swap(sa[pj], sa[pk]) ;
+        SwapSA(sa, pj, pk) ;
         if (pk == 0)
           break ;
         --pk ;
@@ -650,27 +721,69 @@ private:
     size_t *L ; // length for single-ton runs (negative), and length for a h-group (k-group here)
     size_t maxRank ; // distinct ranks
     size_t sizeL ; // length of L, number of runs
+    size_t *tmpSwap ;
     int v = _dc.GetV() ;
 
     sa = (size_t *)malloc(sizeof(size_t) * _dcSize) ;
     rank = (size_t *)malloc(sizeof(size_t) * _dcSize) ;
     nextBuffer = (size_t *)malloc(sizeof(size_t) * _dcSize) ;
     L = (size_t *)malloc(sizeof(size_t) * _dcSize) ;
+    
+    struct _SAGeneratorDCSortThreadArg *args = NULL ;
+    if (_threadCnt > 1)
+    {
+      args = new struct _SAGeneratorDCSortThreadArg[_threadCnt] ;
+      for (i = 0 ; i < (size_t)_threadCnt ; ++i)
+      {
+        args[i].tid = i ;
+        args[i].threadCnt = _threadCnt ;
+        args[i].saGenerator = this ;
+        args[i].T = &T ;
+        args[i].n = n ;
+        args[i].rank = rank ;
+      }
+    }
 
     // Sort by their first v characters
     //Utils::PrintLog("SA sort start") ;
     _dc.GetDiffCoverList(n, sa) ;
-    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
-    MultikeyQSort(T, n, sa, _dcSize, 0, _dcSize - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
-    free(alphabetCounts) ; 
+    if (_threadCnt > 1)
+    {
+      // The sorted list is put in L's memory 
+      tmpSwap = ParallelSortDCPrefix(T, n, sa, nextBuffer, L, args) ;
+      L = sa ;
+      sa = tmpSwap ;
+    }
+    else
+    {
+      size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
+      MultikeyQSort(T, n, sa, _dcSize, 0, _dcSize - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
+      free(alphabetCounts) ; 
+    }
     //Utils::PrintLog("SA sort MultikeyQSort finishes") ;
 
     // Initialization
+    if (_threadCnt > 1)
+    {
+      // nextBuffer[i]=1 marks the start of a group
+      size_t segLen = DIV_CEIL(_dcSize, _threadCnt) ;
+      for (i = 0 ; i < (size_t)_threadCnt ; ++i)
+      {
+        args[i].sa = sa ;
+        args[i].buffer = nextBuffer ;
+        args[i].from = MIN(segLen * i, _dcSize) ;
+        args[i].to = MIN(segLen * (i + 1), _dcSize) ;
+        args[i].h = v ;
+      }
+      RunDCSortThreads(DCGroupStart_Thread, args) ;
+    }
+
     size_t count = 0 ;
     sizeL = 0 ;
     for (i = 0 ; i <= _dcSize ; ++i)
     {
-      if (i == _dcSize || (i > 0 && T.SubrangeCompare( sa[i - 1], sa[i - 1] + v - 1, T, sa[i], sa[i] + v - 1)))
+      if (i == _dcSize || (i > 0 && (_threadCnt > 1 ? nextBuffer[i] != 0 :
+              T.SubrangeCompare( sa[i - 1], sa[i - 1] + v - 1, T, sa[i], sa[i] + v - 1) != 0)))
       {
         if (count == 1) // previous element is a singleton
         {
@@ -697,28 +810,33 @@ private:
     
     maxRank = 0 ;
     size_t offset = 0 ;
-    for (i = 0 ; i < sizeL ; ++i)
+    if (_threadCnt > 1)
+      RunDCSortThreads(DCInitRank_Thread, args) ;
+    else
     {
-      int64_t liValue = (int64_t)L[i] ;
-      if (liValue < 0)
+      for (i = 0 ; i < sizeL ; ++i)
       {
-        for (j = offset ; j < offset + (size_t)(-liValue) ; ++j)
+        int64_t liValue = (int64_t)L[i] ;
+        if (liValue < 0)
         {
-          size_t dcj = _dc.CompactIndex( sa[j] ) ; 
-          rank[dcj] = maxRank ;
-          ++maxRank ;
+          for (j = offset ; j < offset + (size_t)(-liValue) ; ++j)
+          {
+            size_t dcj = _dc.CompactIndex( sa[j] ) ; 
+            rank[dcj] = maxRank ;
+            ++maxRank ;
+          }
+          offset = j ;
         }
-        offset = j ;
-      }
-      else
-      {
-        maxRank += L[i] ;
-        for (j = offset ; j < offset + L[i] ; ++j)
+        else
         {
-          size_t dcj = _dc.CompactIndex( sa[j] ) ; 
-          rank[dcj] = maxRank - 1 ;
+          maxRank += L[i] ;
+          for (j = offset ; j < offset + L[i] ; ++j)
+          {
+            size_t dcj = _dc.CompactIndex( sa[j] ) ; 
+            rank[dcj] = maxRank - 1 ;
+          }
+          offset = j ; 
         }
-        offset = j ; 
       }
     }
 
@@ -731,100 +849,133 @@ private:
       }*/
 
     // Sorting difference cover using Larsson-Sadakane algorithm 
-    size_t *tmpSwap ;
     for (k = v ; k < n /*&& maxRank < _dcSize - 1*/ ; k <<= 1)
     {
-      offset = 0 ;
-      for (i = 0 ; i < sizeL ; ++i)
+      size_t newSizeL = 0 ;
+      if (_threadCnt > 1)
       {
-        int64_t liValue = (int64_t)L[i] ;
-        if (liValue < 0)
+        // The h-groups are independent, so each thread handles a portion of L
+        PartitionLSRuns(L, sizeL, args) ;
+        for (i = 0 ; i < (size_t)_threadCnt ; ++i)
         {
-          offset += (size_t)(-liValue) ;
+          args[i].sa = sa ;
+          args[i].buffer = nextBuffer ;
+          args[i].L = L ;
+          args[i].h = k ;
         }
-        else
-        {
-          MultikeyQSortForLSandDC(sa, rank, n, offset, offset + L[i] - 1,
-              k, nextBuffer) ;
+        RunDCSortThreads(DCRefineGroups_Thread, args) ;
+        RunDCSortThreads(DCCopyRank_Thread, args) ;
+        RunDCSortThreads(DCUpdateRuns_Thread, args) ;
 
-          offset += L[i] ;
+        for (i = 0 ; i < (size_t)_threadCnt ; ++i)
+        {
+          std::vector<size_t> &newL = args[i].newL ;
+          for (j = 0 ; j < newL.size() ; ++j)
+          {
+            if ((int64_t)newL[j] < 0 && newSizeL > 0 && (int64_t)nextBuffer[newSizeL - 1] < 0)
+              nextBuffer[newSizeL - 1] = (size_t)((int64_t)nextBuffer[newSizeL - 1] + (int64_t)newL[j]) ;
+            else
+            {
+              nextBuffer[newSizeL] = newL[j] ;
+              ++newSizeL ;
+            }
+          }
+          std::vector<size_t>().swap(newL) ;
         }
       }
-
-      // Copy the updated rank back from the buffer
-      offset = 0 ;
-      for (i = 0 ; i < sizeL ; ++i)
+      else
       {
-        int64_t liValue = (int64_t)L[i] ;
-        if (liValue < 0)
-        {
-          offset += (size_t)(-liValue) ;
-        }
-        else
+        offset = 0 ;
+        for (i = 0 ; i < sizeL ; ++i)
         {
-          for (j = offset ; j < offset + L[i] ; ++j)
+          int64_t liValue = (int64_t)L[i] ;
+          if (liValue < 0)
+          {
+            offset += (size_t)(-liValue) ;
+          }
+          else
           {
-            size_t dcj = _dc.CompactIndex(sa[j]) ;
-            rank[dcj] = nextBuffer[dcj] ;
+            MultikeyQSortForLSandDC(sa, rank, n, offset, offset + L[i] - 1,
+                k, nextBuffer) ;
+
+            offset += L[i] ;
           }
-          offset += L[i] ;
         }
-      }
 
-      // Update L to nextbuffer, and then swap the points
-      size_t newSizeL = 0 ;
-      offset = 0 ;
-      for (i = 0 ; i < sizeL ; ++i) 
-      {
-        int64_t liValue = (int64_t)L[i] ;
-        if (liValue < 0)
+        // Copy the updated rank back from the buffer
+        offset = 0 ;
+        for (i = 0 ; i < sizeL ; ++i)
         {
-          offset += (size_t)(-liValue) ;
-          if (newSizeL == 0 || (int64_t)nextBuffer[ newSizeL - 1] > 0)
+          int64_t liValue = (int64_t)L[i] ;
+          if (liValue < 0)
           {
-            nextBuffer[ newSizeL ] = (size_t)(liValue) ;
-            ++newSizeL ;
+            offset += (size_t)(-liValue) ;
           }
-          else // This happens when the last run in the previous 2k-group is singleton run
+          else
           {
-            nextBuffer[ newSizeL - 1] = (size_t)((int64_t)nextBuffer[newSizeL-1] + liValue) ;
+            for (j = offset ; j < offset + L[i] ; ++j)
+            {
+              size_t dcj = _dc.CompactIndex(sa[j]) ;
+              rank[dcj] = nextBuffer[dcj] ;
+            }
+            offset += L[i] ;
           }
         }
-        else
+
+        // Update L to nextbuffer, and then swap the points
+        offset = 0 ;
+        for (i = 0 ; i < sizeL ; ++i) 
         {
-          size_t count = 1 ;
-          for (j = offset + 1 ; j <= offset + liValue ; ++j)
+          int64_t liValue = (int64_t)L[i] ;
+          if (liValue < 0)
           {
-            if (j != offset + liValue 
-                && rank[ _dc.CompactIndex(sa[j]) ] == rank[ _dc.CompactIndex(sa[j - 1]) ])
+            offset += (size_t)(-liValue) ;
+            if (newSizeL == 0 || (int64_t)nextBuffer[ newSizeL - 1] > 0)
+            {
+              nextBuffer[ newSizeL ] = (size_t)(liValue) ;
+              ++newSizeL ;
+            }
+            else // This happens when the last run in the previous 2k-group is singleton run
             {
-              ++count ;
+              nextBuffer[ newSizeL - 1] = (size_t)((int64_t)nextBuffer[newSizeL-1] + liValue) ;
             }
-            else // entering a new 2k-group, or end of the current k-group 
+          }
+          else
+          {
+            size_t count = 1 ;
+            for (j = offset + 1 ; j <= offset + liValue ; ++j)
             {
-              if (count > 1)
+              if (j != offset + liValue 
+                  && rank[ _dc.CompactIndex(sa[j]) ] == rank[ _dc.CompactIndex(sa[j - 1]) ])
               {
-                nextBuffer[ newSizeL ] = count ;
-                ++newSizeL ;
-                count = 1 ;
+                ++count ;
               }
-              else // singleton
+              else // entering a new 2k-group, or end of the current k-group 
               {
-                if (newSizeL == 0 || (int64_t)nextBuffer[ newSizeL - 1] > 0)
+                if (count > 1)
                 {
-                  nextBuffer[ newSizeL ] = (size_t)(-1ll) ;
+                  nextBuffer[ newSizeL ] = count ;
                   ++newSizeL ;
+                  count = 1 ;
                 }
-                else // This happens when the last run in the previous 2k-group is singleton run
+                else // singleton
                 {
-                  nextBuffer[ newSizeL - 1] = (size_t)((int64_t)nextBuffer[newSizeL-1] - 1ll) ;
+                  if (newSizeL == 0 || (int64_t)nextBuffer[ newSizeL - 1] > 0)
+                  {
+                    nextBuffer[ newSizeL ] = (size_t)(-1ll) ;
+                    ++newSizeL ;
+                  }
+                  else // This happens when the last run in the previous 2k-group is singleton run
+                  {
+                    nextBuffer[ newSizeL - 1] = (size_t)((int64_t)nextBuffer[newSizeL-1] - 1ll) ;
+                  }
+                  //count = 1, not need to reset it again
                 }
-                //count = 1, not need to reset it again
               }
             }
-          }
 
-          offset += liValue ;
+            offset += liValue ;
+          }
         }
       }
 
@@ -839,15 +990,315 @@ private:
 
     free(nextBuffer) ;
     free(L) ;
+    if (args != NULL)
+      delete[] args ;
 
     _dcISA = rank ;
     return sa ;
   }
+
+  // Functions for sorting difference cover in parallel ============================================  
+  // The first w characters of T[i...] packed as the radix bucket key.
+  // The characters passing the end of T are treated as 0, 
+  //   and the later multikey qsort within the bucket will put the shorter suffix in front.
+  static WORD GetPrefixBucketKey(const FixedSizeElemArray &T, size_t n, size_t i, int w)
+  {
+    int k ;
+    const int alphabetBits = T.GetElemLength() ;
+    WORD key = 0 ;
+    for (k = 0 ; k < w ; ++k)
+      key = (key << alphabetBits) | (i + k < n ? T.Read(i + k) : 0) ;
+    return key ;
+  }
+
+  static void *DCBucketCount_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    size_t i ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      WORD key = GetPrefixBucketKey(*(pArg->T), pArg->n, pArg->sa[i], pArg->bucketWidth) ;
+      pArg->buffer[i] = key ;
+      ++pArg->bucketCounts[key] ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  static void *DCBucketScatter_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    size_t i ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      pArg->target[ pArg->bucketCounts[ pArg->buffer[i] ] ] = pArg->sa[i] ;
+      ++pArg->bucketCounts[ pArg->buffer[i] ] ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Sort the suffixes in the buckets [from, to) by their first v characters
+  static void *DCBucketSort_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    SuffixArrayGenerator &saGenerator = *(pArg->saGenerator) ;
+    size_t b ;
+    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (saGenerator._alphabetSize + 1)) ;
+    for (b = pArg->from ; b < pArg->to ; ++b)
+    {
+      if (pArg->bucketStart[b + 1] - pArg->bucketStart[b] <= 1)
+        continue ;
+      saGenerator.MultikeyQSort(*(pArg->T), pArg->n, pArg->sa, saGenerator._dcSize,
+          pArg->bucketStart[b], pArg->bucketStart[b + 1] - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
+    }
+    free(alphabetCounts) ;
+    pthread_exit(NULL) ;
+  }
+
+  // Mark buffer[i]=1 if sa[i] starts a new group (v-prefix differs from sa[i-1])
+  static void *DCGroupStart_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    const FixedSizeElemArray &T = *(pArg->T) ;
+    size_t *sa = pArg->sa ;
+    size_t i ;
+    size_t v = pArg->h ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      if (i == 0 || T.SubrangeCompare(sa[i - 1], sa[i - 1] + v - 1, T, sa[i], sa[i] + v - 1))
+        pArg->buffer[i] = 1 ;
+      else
+        pArg->buffer[i] = 0 ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // LS rank is the last position of the group, so each thread 
+  //   can assign the rank in its range with the group start flags.
+  static void *DCInitRank_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    SuffixArrayGenerator &saGenerator = *(pArg->saGenerator) ;
+    size_t i ;
+    size_t groupEnd ;
+    if (pArg->from >= pArg->to)
+      pthread_exit(NULL) ;
+    for (i = pArg->to ; i < saGenerator._dcSize && pArg->buffer[i] == 0 ; ++i)
+      ;
+    groupEnd = i - 1 ;
+    for (i = pArg->to ; i > pArg->from ; )
+    {
+      --i ;
+      pArg->rank[ saGenerator._dc.CompactIndex(pArg->sa[i]) ] = groupEnd ;
+      if (pArg->buffer[i])
+        groupEnd = i - 1 ;
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Sort the h-groups in L[from..to), the new ranks are stored in buffer 
+  static void *DCRefineGroups_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    SuffixArrayGenerator &saGenerator = *(pArg->saGenerator) ;
+    size_t i ;
+    size_t offset = pArg->offset ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      int64_t liValue = (int64_t)pArg->L[i] ;
+      if (liValue < 0)
+        offset += (size_t)(-liValue) ;
+      else
+      {
+        saGenerator.MultikeyQSortForLSandDC(pArg->sa, pArg->rank, pArg->n, offset, offset + liValue - 1,
+            pArg->h, pArg->buffer) ;
+        offset += liValue ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Copy the new ranks of the h-groups in L[from..to) back to rank
+  static void *DCCopyRank_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    SuffixArrayGenerator &saGenerator = *(pArg->saGenerator) ;
+    size_t i, j ;
+    size_t offset = pArg->offset ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      int64_t liValue = (int64_t)pArg->L[i] ;
+      if (liValue < 0)
+        offset += (size_t)(-liValue) ;
+      else
+      {
+        for (j = offset ; j < offset + liValue ; ++j)
+        {
+          size_t dcj = saGenerator._dc.CompactIndex(pArg->sa[j]) ;
+          pArg->rank[dcj] = pArg->buffer[dcj] ;
+        }
+        offset += liValue ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Add a run to L, merging adjacent singleton runs 
+  static void AppendLSRun(std::vector<size_t> &L, int64_t liValue)
+  {
+    if (liValue < 0 && L.size() > 0 && (int64_t)L.back() < 0)
+      L.back() = (size_t)((int64_t)L.back() + liValue) ;
+    else
+      L.push_back((size_t)liValue) ;
+  }
+
+  // Split the runs in L[from..to) into 2h-groups, the same as the serial version
+  static void *DCUpdateRuns_Thread(void *arg)
+  {
+    struct _SAGeneratorDCSortThreadArg *pArg = (struct _SAGeneratorDCSortThreadArg *)arg ;
+    SuffixArrayGenerator &saGenerator = *(pArg->saGenerator) ;
+    size_t i, j ;
+    size_t offset = pArg->offset ;
+    const size_t *sa = pArg->sa ;
+    std::vector<size_t> &newL = pArg->newL ;
+    newL.clear() ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      int64_t liValue = (int64_t)pArg->L[i] ;
+      if (liValue < 0)
+      {
+        offset += (size_t)(-liValue) ;
+        AppendLSRun(newL, liValue) ;
+      }
+      else
+      {
+        size_t count = 1 ;
+        for (j = offset + 1 ; j <= offset + liValue ; ++j)
+        {
+          if (j != offset + liValue 
+              && pArg->rank[ saGenerator._dc.CompactIndex(sa[j]) ] == pArg->rank[ saGenerator._dc.CompactIndex(sa[j - 1]) ])
+            ++count ;
+          else
+          {
+            AppendLSRun(newL, count > 1 ? (int64_t)count : -1ll) ;
+            count = 1 ;
+          }
+        }
+        offset += liValue ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Split L[0..sizeL) into threadCnt contiguous ranges with similar number of suffixes
+  void PartitionLSRuns(const size_t *L, size_t sizeL, struct _SAGeneratorDCSortThreadArg *args)
+  {
+    size_t i ;
+    int t = 0 ;
+    size_t offset = 0 ;
+    args[0].from = 0 ;
+    args[0].offset = 0 ;
+    for (i = 0 ; i < sizeL ; ++i)
+    {
+      int64_t liValue = (int64_t)L[i] ;
+      offset += (liValue < 0) ? (size_t)(-liValue) : (size_t)liValue ;
+      if (t < _threadCnt - 1 && offset >= DIV_CEIL(_dcSize, _threadCnt) * (t + 1))
+      {
+        args[t].to = i + 1 ;
+        ++t ;
+        args[t].from = i + 1 ;
+        args[t].offset = offset ;
+      }
+    }
+    args[t].to = sizeL ;
+    for (++t ; t < _threadCnt ; ++t)
+    {
+      args[t].from = args[t].to = sizeL ;
+      args[t].offset = _dcSize ;
+    }
+  }
+
+  void RunDCSortThreads(void *(*func)(void *), struct _SAGeneratorDCSortThreadArg *args)
+  {
+    int t ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(*threads) * _threadCnt) ;
+    pthread_attr_t attr ;
+    pthread_attr_init( &attr ) ;
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE ) ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+      pthread_create(&threads[t], &attr, func, (void *)(args + t)) ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+      pthread_join(threads[t], NULL) ;
+    pthread_attr_destroy(&attr) ;
+    free(threads) ;
+  }
+
+  // Sort the difference cover list sa by their first v characters with multiple threads:
+  //   radix bucketing on the first few characters, then sort the buckets independently.
+  // buffer and target are the preallocated memories of _dcSize, 
+  // @return: the sorted list, which is either sa or target 
+  size_t *ParallelSortDCPrefix(const FixedSizeElemArray &T, size_t n, size_t *sa, size_t *buffer, size_t *target, struct _SAGeneratorDCSortThreadArg *args)
+  {
+    int t ;
+    size_t b ;
+    const int alphabetBits = T.GetElemLength() ;
+    int bucketWidth = 16 / alphabetBits ; // use at most 2^16 buckets 
+    if (bucketWidth < 1)
+      bucketWidth = 1 ;
+    const size_t bucketCnt = 1ull << (alphabetBits * bucketWidth) ;
+    size_t *bucketStart = (size_t *)malloc(sizeof(size_t) * (bucketCnt + 1)) ;
+    
+    size_t segLen = DIV_CEIL(_dcSize, _threadCnt) ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+    {
+      args[t].sa = sa ;
+      args[t].buffer = buffer ;
+      args[t].target = target ;
+      args[t].from = MIN(segLen * t, _dcSize) ;
+      args[t].to = MIN(segLen * (t + 1), _dcSize) ;
+      args[t].bucketWidth = bucketWidth ;
+      args[t].bucketCounts = (size_t *)calloc(bucketCnt, sizeof(size_t)) ;
+      args[t].bucketStart = bucketStart ;
+    }
+    RunDCSortThreads(DCBucketCount_Thread, args) ;
+
+    // Convert the counts to the write positions. 
+    size_t psum = 0 ;
+    for (b = 0 ; b < bucketCnt ; ++b)
+    {
+      bucketStart[b] = psum ;
+      for (t = 0 ; t < _threadCnt ; ++t)
+      {
+        size_t tmp = args[t].bucketCounts[b] ;
+        args[t].bucketCounts[b] = psum ;
+        psum += tmp ;
+      }
+    }
+    bucketStart[bucketCnt] = psum ;
+    RunDCSortThreads(DCBucketScatter_Thread, args) ;
+    
+    // Distribute the buckets to threads by their sizes
+    b = 0 ;
+    for (t = 0 ; t < _threadCnt ; ++t)
+    {
+      free(args[t].bucketCounts) ;
+      args[t].bucketCounts = NULL ;
+      args[t].sa = target ;
+      args[t].from = b ;
+      while (b < bucketCnt && (t == _threadCnt - 1 || bucketStart[b] < segLen * (t + 1)))
+        ++b ;
+      args[t].to = b ;
+    }
+    RunDCSortThreads(DCBucketSort_Thread, args) ;
+
+    free(bucketStart) ;
+    return target ;
+  }
 public:
   SuffixArrayGenerator() 
   {
     _b = 1<<24 ;  // 2^24, 16MB block size by default 
     _n = _space = 0 ;
+    _threadCnt = 1 ;
     _cuts = NULL ;
     _dcISA = NULL ;
   }
@@ -870,10 +1321,15 @@ public:
         for (i = 0 ; i < _cutCnt ; ++i)
           free(_cutLCP[i]) ;
         free(_cutLCP) ;
+        _cutLCP = NULL ;
       }
+      _cuts = NULL ;
     }
     if (_dcISA != NULL)
+    {
       free(_dcISA) ;
+      _dcISA = NULL ;
+    }
   }
 
   size_t GetSpace()
@@ -881,6 +1337,12 @@ public:
     return _space + sizeof(*this) ;
   }
 
+  // The number of threads for sorting the difference cover in Init
+  void SetThreadCnt(int threadCnt)
+  {
+    _threadCnt = threadCnt > 0 ? threadCnt : 1 ;
+  }
+
   // Initialize the generator to obtain the _cuts
   // _dcv: difference cover period
   // @return: the number of _cuts
@@ -908,6 +1370,49 @@ public:
     return _cutCnt ;
   }
 
+  // Save the difference cover ranks and the cuts from Init, 
+  //   so the chunks can be generated again without sorting the difference cover.
+  void Save(FILE *fp)
+  {
+    size_t i ;
+    int dcv = _dc.GetV() ;
+    SAVE_VAR(fp, _n) ;
+    SAVE_VAR(fp, _b) ;
+    SAVE_VAR(fp, _alphabetSize) ;
+    SAVE_VAR(fp, dcv) ;
+    SAVE_VAR(fp, _dcSize) ;
+    fwrite(_dcISA, sizeof(_dcISA[0]), _dcSize, fp) ;
+    SAVE_VAR(fp, _cutCnt) ;
+    fwrite(_cuts, sizeof(_cuts[0]), _cutCnt + 1, fp) ;
+    for (i = 0 ; i < _cutCnt ; ++i)
+      fwrite(_cutLCP[i], sizeof(_cutLCP[i][0]), MIN(_n - _cuts[i], (size_t)dcv), fp) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    size_t i ;
+    int dcv ;
+    Free() ;
+    LOAD_VAR(fp, _n) ;
+    LOAD_VAR(fp, _b) ;
+    LOAD_VAR(fp, _alphabetSize) ;
+    LOAD_VAR(fp, dcv) ;
+    _dc.Init(dcv) ;
+    LOAD_VAR(fp, _dcSize) ;
+    _dcISA = (size_t *)malloc(sizeof(_dcISA[0]) * _dcSize) ;
+    fread(_dcISA, sizeof(_dcISA[0]), _dcSize, fp) ;
+    LOAD_VAR(fp, _cutCnt) ;
+    _cuts = (size_t *)malloc(sizeof(_cuts[0]) * (_cutCnt + 1)) ;
+    fread(_cuts, sizeof(_cuts[0]), _cutCnt + 1, fp) ;
+    _cutLCP = (size_t **)malloc(sizeof(*_cutLCP) * _cutCnt) ;
+    for (i = 0 ; i < _cutCnt ; ++i)
+    {
+      size_t len = MIN(_n - _cuts[i], (size_t)dcv) ;
+      _cutLCP[i] = (size_t *)malloc(sizeof(_cutLCP[i][0]) * len) ;
+      fread(_cutLCP[i], sizeof(_cutLCP[i][0]), len, fp) ;
+    }
+  }
+
   // Estimate how many chunks would be given b and dcv
   // b: user-specific rough block size
   static size_t EstimateChunkCount(size_t n, size_t b, int dcv)
@@ -918,6 +1423,24 @@ public:
     return DIV_CEIL(eDcSize, stride) ;
   }
 
+  // @return: the chunk in [from, to] holding suffix T[i..], or to + 1 if it is outside these chunks
+  size_t FindChunkOfPos(const FixedSizeElemArray &T, size_t n, size_t i, size_t from, size_t to, size_t *rightmosti, size_t *rightmostj)
+  {
+    size_t j ;
+    if ((from == 0 || CompareCutUsingCutLCP(T, n, i, from, rightmosti[from - from], rightmostj[from - from]) >= 0)
+        && (to == _cutCnt - 1 
+          || CompareCutUsingCutLCP(T, n, i, to + 1, rightmosti[to + 1 - from], rightmostj[to + 1 - from]) < 0))
+    {
+      for (j = from + 1 ; j <= to ; ++j)
+      {
+        if (CompareCutUsingCutLCP(T, n, i, j, rightmosti[j-from], rightmostj[j-from]) < 0)
+          break ;
+      }
+      return j - 1 ;
+    }
+    return to + 1 ;
+  }
+
   // Generate the from-th chunk to to-th chunk for T[s..e], both are inclusive
   // Each chunk is left close, right open for the cut.
   // The procedure utilized _cutLCP to expediate the search.
@@ -936,17 +1459,33 @@ public:
     size_t *rightmostj = (size_t *)calloc(to - from + 2, sizeof(size_t)) ;
     for (i = s ; i <= e ; ++i)
     {
-      if ((from == 0 || CompareCutUsingCutLCP(T, n, i, from, rightmosti[from - from], rightmostj[from - from]) >= 0)
-          && (to == _cutCnt - 1 
-              || CompareCutUsingCutLCP(T, n, i, to + 1, rightmosti[to + 1 - from], rightmostj[to + 1 - from]) < 0))
-      {
-        for (j = from + 1 ; j <= to ; ++j)
-        {
-          if (CompareCutUsingCutLCP(T, n, i, j, rightmosti[j-from], rightmostj[j-from]) < 0)
-            break ;
-        }
-        pos[(j-1) - from].push_back(i) ;
-      }
+      j = FindChunkOfPos(T, n, i, from, to, rightmosti, rightmostj) ;
+      if (j <= to)
+        pos[j - from].push_back(i) ;
+    }
+    free(rightmosti) ;
+    free(rightmostj) ;
+  }
+  
+  // The same as above, but the positions are stored in the byte-packed arrays 
+  //   pos[0..to-from], each element takes elemLength bytes.
+  void  GetChunksPositions(const FixedSizeElemArray &T, size_t n, size_t from, size_t to, size_t s, size_t e, int elemLength, FixedByteElemArray *pos)
+  {
+    size_t i, j ;
+    if (to >= _cutCnt)
+      to = _cutCnt - 1 ;
+    if (e >= n)
+      e = n - 1 ;
+    for (j = from ; j <= to ; ++j)
+      pos[j - from].Malloc(elemLength, 0) ;
+    
+    size_t *rightmosti = (size_t *)calloc(to - from + 2, sizeof(size_t)) ;
+    size_t *rightmostj = (size_t *)calloc(to - from + 2, sizeof(size_t)) ;
+    for (i = s ; i <= e ; ++i)
+    {
+      j = FindChunkOfPos(T, n, i, from, to, rightmosti, rightmostj) ;
+      if (j <= to)
+        pos[j - from].PushBack(i) ;
     }
     free(rightmosti) ;
     free(rightmostj) ;
@@ -965,6 +1504,16 @@ public:
     free(alphabetCounts) ;
   }
 
+  // Sort the first m positions in the byte-packed sa in place
+  void SortSuffixByPos(const FixedSizeElemArray &T, size_t n, FixedByteElemArray &sa, size_t m)
+  {
+    if (m == 0)
+      return ;
+    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
+    MultikeyQSort(T, n, sa, m, 0, m - 1, 0, /*dcStrategy=*/1, alphabetCounts) ;
+    free(alphabetCounts) ;
+  }
+
   // TODO: Functions relating to use disk to hold chunks
   // Output each chunk to prefix_{xxx}.chunk file
   void OutputChunksToFiles(char *prefix)
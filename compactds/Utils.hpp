@@ -6,10 +6,26 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <time.h>
+#include <sys/time.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 
+// The portable build (-DCOMPACTDS_RUNTIME_DISPATCH without -march=native) compiles the 
+//   FM index search entry points (e.g., BackwardSearch) for POPCNT and the baseline x86-64.
+//   The variant is picked by CPUID through GCC's ifunc resolver, once per search call. 
+// "flatten" inlines the whole call tree (BackwardExtend, the rank kernels, Popcount) into each
+//   variant, so the callees are compiled with POPCNT too instead of calling __popcountdi2.
+#if defined(COMPACTDS_RUNTIME_DISPATCH) && defined(__GNUC__) && defined(__x86_64__)
+  #define COMPACTDS_TARGET_CLONES __attribute__((target_clones("popcnt", "default"), flatten))
+#else
+  #define COMPACTDS_TARGET_CLONES
+#endif
+
+#ifdef __BMI2__
+  #include <immintrin.h>
+#endif
+
 namespace compactds {
 #define WORD_64 // comment this out if word size is 32
 
@@ -98,6 +114,58 @@ public:
     }*/
   }
 
+  // Count the number of trailing 0's in x. x should not be 0.
+  static int CountTrailingZeros(WORD x)
+  {
+#ifdef __GNUC__
+    return __builtin_ctzll(x) ;
+#else
+    return Popcount((x & -x) - 1) ;
+#endif
+  }
+
+  // Count the number of leading 0's in x. x should not be 0.
+  static int CountLeadingZeros(WORD x)
+  {
+#ifdef __GNUC__
+    return __builtin_clzll(x) ;
+#else
+    int ret = 0 ;
+    for ( ; !(x & (1ull << (WORDBITS - 1))) ; x <<= 1)
+      ++ret ;
+    return ret ;
+#endif
+  }
+
+  // Gather the bits of x at the 1's in mask to the low bits (pext)
+  static WORD BitsExtract(WORD x, WORD mask)
+  {
+#ifdef __BMI2__
+    return _pext_u64(x, mask) ;
+#else
+    WORD ret = 0 ;
+    int k = 0 ;
+    for ( ; mask ; mask &= (mask - 1), ++k)
+      if (x & mask & -mask)
+        ret |= (1ull << k) ;
+    return ret ;
+#endif
+  }
+
+  // Scatter the low bits of x to the 1's in mask (pdep)
+  static WORD BitsDeposit(WORD x, WORD mask)
+  {
+#ifdef __BMI2__
+    return _pdep_u64(x, mask) ;
+#else
+    WORD ret = 0 ;
+    for ( ; mask ; mask &= (mask - 1), x >>= 1)
+      if (x & 1)
+        ret |= (mask & -mask) ;
+    return ret ;
+#endif
+  }
+
   // Select the r-th (1-index) 1 in word x
   static int SelectInWord(WORD x, int r)
   {
@@ -118,7 +186,6 @@ public:
     //  each bit in a byte will be in its own byte of a 64bit integer
     s = (BITBLOCK_GZERO(((x >> b & 0xff) * l8 & 0x8040201008040201ull), l8, h8) >> 7) * l8 ;
     return b + (((BITBLOCK_LEQ(s, l * l8, h8) >> 7) * l8) >> 56) ;
-
   }
 
   // Compute ceil(log2(x)) without float computation
@@ -275,6 +342,21 @@ public:
     return ret ;
   }
 
+  // The reverse of SpaceStringToBytes, s should hold at least 16 chars
+  static void BytesToSpaceString(size_t bytes, char *s)
+  {
+    if (bytes >= 1000000000000ull)
+      sprintf(s, "%.2fT", bytes / 1e12) ;
+    else if (bytes >= 1000000000ull)
+      sprintf(s, "%.2fG", bytes / 1e9) ;
+    else if (bytes >= 1000000ull)
+      sprintf(s, "%.2fM", bytes / 1e6) ;
+    else if (bytes >= 1000ull)
+      sprintf(s, "%.2fK", bytes / 1e3) ;
+    else
+      sprintf(s, "%lu", bytes) ;
+  }
+
   // Deprive the path and extension from the file name
   // Further go one more extension if there is an extra extension 
   //  matching the given extraExtension string
@@ -337,6 +419,14 @@ public:
     return end - start + 1 ;
   }
 
+  // Wall-clock time in seconds
+  static double GetWallTime()
+  {
+    struct timeval tv ;
+    gettimeofday(&tv, NULL) ;
+    return tv.tv_sec + tv.tv_usec / 1000000.0 ;
+  }
+
   static void PrintLog( const char *fmt, ... )
   {
     va_list args ;
@@ -125,7 +125,7 @@ int main(int argc, char *argv[])
   }
 
   {
-    Sequence_RunBlock rbbwt ;
+    Sequence_RunBlock<> rbbwt ;
     //rbbwt.SetBlockSize(5) ;
     rbbwt.Init(BWT, n, abList) ;
     rbbwt.PrintStats() ;
@@ -3,11 +3,14 @@
 #include <time.h>
 #include <stdarg.h>
 
+#include <algorithm>
+
 #include "FixedSizeElemArray.hpp"
 #include "FractionBitElemArray.hpp"
 #include "VariableSizeElemArray_SampledPointers.hpp"
 #include "VariableSizeElemArray_DensePointers.hpp"
 #include "InterleavedFixedSizeElemArray.hpp"
+#include "FixedByteElemArray.hpp"
 
 #include "Bitvector_Plain.hpp"
 #include "Bitvector_Compressed.hpp"
@@ -16,9 +19,11 @@
 
 #include "Sequence_Plain.hpp"
 #include "Sequence_WaveletTree.hpp"
+#include "Sequence_WaveletMatrix.hpp"
 #include "Sequence_RunLength.hpp"
 #include "Sequence_Hybrid.hpp"
 #include "Sequence_RunBlock.hpp"
+#include "Sequence_OccTable.hpp"
 
 #include "PerfectHash.hpp"
 #include "PartialSum.hpp"
@@ -45,6 +50,12 @@
 
 #include "Tree_Labeled.hpp"
 
+#include "../Taxonomy.hpp"
+#include "../GenomeSketch.hpp"
+#include "../Builder.hpp"
+#include "../Classifier.hpp"
+#include "../Quantifier.hpp"
+
 using namespace compactds ; 
 
 void PrintLog( const char *fmt, ... )
@@ -61,6 +72,248 @@ void PrintLog( const char *fmt, ... )
 	fprintf( stderr, "[%s] %s\n", stime, buffer ) ;
 }
 
+// Fill s (and its letters in strs) with a random DNA text, where the later part
+//   copies the windows of the earlier text with 1% mutations, so many suffixes share long prefixes.
+void GenerateRepetitiveText(size_t n, const char *abList, char *strs, FixedSizeElemArray &s)
+{
+  size_t i = 0, j ;
+  s.Malloc(2, n) ;
+  for (i = 0 ; i < n && i < n / 4 ; ++i)
+    s.Write(i, rand() % 4) ;
+  while (i < n)
+  {
+    size_t len = 500 + rand() % 2000 ;
+    size_t from = rand() % (i - len / 4) ;
+    for (j = 0 ; j < len && i < n ; ++j, ++i)
+    {
+      if (rand() % 100 == 0 || from + j >= i)
+        s.Write(i, rand() % 4) ;
+      else
+        s.Write(i, s.Read(from + j)) ;
+    }
+  }
+  for (i = 0 ; i < n ; ++i)
+    strs[i] = abList[s.Read(i)] ;
+  strs[n] = '\0' ;
+}
+
+// Order the suffixes of a string, where the shorter suffix is smaller when it is a prefix of the other.
+struct _CompareSuffix
+{
+  const char *s ;
+  bool operator()(size_t a, size_t b) const
+  {
+    return strcmp(s + a, s + b) < 0 ;
+  }
+} ;
+
+// Return the number of the occurrences of p[0..m-1] in the FM index
+template <class FMIndexT>
+size_t CountOccurrences(FMIndexT &fmIndex, char *p, size_t m)
+{
+  size_t sp = 0, ep = 0 ;
+  size_t l = fmIndex.BackwardSearch(p, m, sp, ep) ;
+  if (l < m || sp > ep)
+    return 0 ;
+  return ep - sp + 1 ;
+}
+
+// Return the number of the mismatched Access and Rank of sequence t against the plain coded S,
+//   both from the alphabets and from the plain codes.
+// occ[4*i+c]: the number of code c in S[0..i]
+template <class SequenceT>
+size_t CountSequenceMismatch(const SequenceT &t, const FixedSizeElemArray &S, size_t n, 
+    const char *abList, const size_t *occ)
+{
+  size_t i ;
+  WORD c ;
+  size_t ret = 0 ;
+  for (i = 0 ; i < n ; ++i)
+  {
+    WORD code = S.Read(i) ;
+    if (t.Access(i) != abList[code] || t.template AccessCode<2>(i) != code)
+      ++ret ;
+    for (c = 0 ; c < 4 ; ++c)
+      if (t.Rank(abList[c], i) != occ[4 * i + c] || t.template RankCode<2>(c, i) != occ[4 * i + c])
+        ++ret ;
+  }
+  return ret ;
+}
+
+// Return the number of the mismatched AccessAndRank of sequence t, see CountSequenceMismatch
+template <class SequenceT>
+size_t CountAccessAndRankMismatch(const SequenceT &t, const FixedSizeElemArray &S, size_t n, 
+    const char *abList, const size_t *occ)
+{
+  size_t i ;
+  size_t ret = 0 ;
+  for (i = 0 ; i < n ; ++i)
+  {
+    WORD code = S.Read(i) ;
+    size_t rank = 0 ;
+    size_t codeRank = 0 ;
+    if (t.AccessAndRank(i, rank) != abList[code] || rank != occ[4 * i + code])
+      ++ret ;
+    if (t.template AccessCodeAndRank<2>(i, codeRank) != code || codeRank != occ[4 * i + code])
+      ++ret ;
+  }
+  return ret ;
+}
+
+// Return the number of the mismatched RankPair of sequence t on the positions near and far apart, 
+//   see CountSequenceMismatch
+template <class SequenceT>
+size_t CountRankPairMismatch(const SequenceT &t, const FixedSizeElemArray &S, size_t n, 
+    const char *abList, const size_t *occ)
+{
+  size_t i ;
+  WORD c ;
+  size_t ret = 0 ;
+  for (i = 0 ; i < n ; ++i)
+  {
+    size_t j = i + (i * 7919) % 1000 ;
+    if (j >= n)
+      j = n - 1 ;
+    for (c = 0 ; c < 4 ; ++c)
+    {
+      size_t ri = 0, rj = 0 ;
+      t.RankPair(abList[c], i, j, ri, rj) ;
+      if (ri != occ[4 * i + c] || rj != occ[4 * j + c])
+        ++ret ;
+      t.template RankCodePair<2>(c, i, j, ri, rj) ;
+      if (ri != occ[4 * i + c] || rj != occ[4 * j + c])
+        ++ret ;
+    }
+  }
+  return ret ;
+}
+
+// Return the number of the elements where a and b differ
+template <class A>
+size_t CountMismatch(const A &a, const A &b)
+{
+  size_t i ;
+  size_t ret = 0 ;
+  if (a.GetSize() != b.GetSize())
+    return a.GetSize() > b.GetSize() ? a.GetSize() : b.GetSize() ;
+  for (i = 0 ; i < a.GetSize() ; ++i)
+    if (a.Read(i) != b.Read(i))
+      ++ret ;
+  return ret ;
+}
+
+// Write the taxonomy of the test genomes seq0-seq3 to tmp_nodes.dmp, tmp_names.dmp and tmp_seqid.map.
+// seq0 and seq1 are in genus 445 and seq2 and seq3 are in genus 561, which go to different shards by genus.
+void WriteTestTaxonomy()
+{
+  FILE *fp = fopen("tmp_nodes.dmp", "w") ;
+  fprintf(fp, "1\t|\t1\t|\tno rank\t|\n"
+      "445\t|\t1\t|\tgenus\t|\n"
+      "446\t|\t445\t|\tspecies\t|\n"
+      "272624\t|\t446\t|\tstrain\t|\n"
+      "297246\t|\t446\t|\tstrain\t|\n"
+      "561\t|\t1\t|\tgenus\t|\n"
+      "562\t|\t561\t|\tspecies\t|\n"
+      "511145\t|\t562\t|\tstrain\t|\n") ;
+  fclose(fp) ;
+  fp = fopen("tmp_names.dmp", "w") ;
+  fprintf(fp, "1\t|\troot\t|\t\t|\tscientific name\t|\n") ;
+  fclose(fp) ;
+  fp = fopen("tmp_seqid.map", "w") ;
+  fprintf(fp, "seq0\t272624\nseq1\t297246\nseq2\t562\nseq3\t511145\n") ;
+  fclose(fp) ;
+}
+
+// Write the genomes [from, to) to the fasta file, named by their index. mode: the fopen mode 
+void WriteTestGenomes(const char *file, const std::vector<std::string> &genomes, size_t from, size_t to, 
+    const char *mode)
+{
+  size_t i ;
+  FILE *fp = fopen(file, mode) ;
+  for (i = from ; i < to ; ++i)
+    fprintf(fp, ">seq%d\n%s\n", (int)i, genomes[i].c_str()) ;
+  fclose(fp) ;
+}
+
+// Build the index of the genomes in file and save it to prefix, see WriteTestTaxonomy.
+// shardCnt>1: only build the shardId-th shard by genus.
+void BuildTestIndex(const char *file, const char *prefix, int shardCnt, int shardId, int sampleStrategy)
+{
+  ReadFiles refGenomeFile ;
+  refGenomeFile.AddReadFile((char *)file, false) ;
+  Builder builder ;
+  struct _FMBuilderParam param ;
+  param.sampleRate = 16 ;
+  param.sampleStrategy = sampleStrategy ;
+  if (shardCnt > 1)
+    builder.SetShard(shardCnt, shardId, "genus") ;
+  builder.Build(refGenomeFile, (char *)"tmp_nodes.dmp", (char *)"tmp_names.dmp", (char *)"tmp_seqid.map", 
+      false, 0, 0, param, "ACGT") ;
+  builder.Save(prefix) ;
+}
+
+// Remove the files of the index and taxonomy from WriteTestTaxonomy and BuildTestIndex
+void RemoveTestIndex(const char *prefix)
+{
+  int i ;
+  char fileName[1024] ;
+  for (i = 1 ; i <= 4 ; ++i)
+  {
+    sprintf(fileName, "%s.%d.cfr", prefix, i) ;
+    remove(fileName) ;
+  }
+}
+
+void RemoveTestTaxonomy()
+{
+  remove("tmp_nodes.dmp") ;
+  remove("tmp_names.dmp") ;
+  remove("tmp_seqid.map") ;
+}
+
+// Return the number of the fields where the classification results a and b differ.
+// The secondary score is not compared, see the "shard" case.
+size_t CountClassifierResultMismatch(const struct _classifierResult &a, const struct _classifierResult &b)
+{
+  size_t ret = 0 ;
+  if (a.score != b.score)
+    ++ret ;
+  if (a.hitLength != b.hitLength || a.queryLength != b.queryLength)
+    ++ret ;
+  std::vector<uint64_t> taxIdsA(a.taxIds), taxIdsB(b.taxIds) ;
+  std::sort(taxIdsA.begin(), taxIdsA.end()) ;
+  std::sort(taxIdsB.begin(), taxIdsB.end()) ;
+  if (taxIdsA != taxIdsB)
+    ++ret ;
+  std::vector<std::string> namesA(a.seqStrNames), namesB(b.seqStrNames) ;
+  std::sort(namesA.begin(), namesA.end()) ;
+  std::sort(namesB.begin(), namesB.end()) ;
+  if (namesA != namesB)
+    ++ret ;
+  return ret ;
+}
+
+// Return the number of the lines where the text files a and b differ
+size_t CountFileMismatch(const char *a, const char *b)
+{
+  char lineA[4096], lineB[4096] ;
+  size_t ret = 0 ;
+  FILE *fpA = fopen(a, "r") ;
+  FILE *fpB = fopen(b, "r") ;
+  while (1)
+  {
+    char *ra = fgets(lineA, sizeof(lineA), fpA) ;
+    char *rb = fgets(lineB, sizeof(lineB), fpB) ;
+    if (ra == NULL && rb == NULL)
+      break ;
+    if (ra == NULL || rb == NULL || strcmp(lineA, lineB))
+      ++ret ;
+  }
+  fclose(fpA) ;
+  fclose(fpB) ;
+  return ret ;
+}
+
 int main(int argc, char *argv[])
 {
   if (argc < 2)
@@ -146,6 +399,20 @@ int main(int argc, char *argv[])
       }
       printf("mismatch count: %d\n", mismatchCnt) ;
       printf("Space usage (bytes): %d\n", (int)fsea.GetSpace());
+
+      fp = fopen("tmp.out", "r") ;
+      fsea.LoadSubsampled(fp, 3) ;
+      fclose(fp) ;
+
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < len ; i += 3)
+      {
+        if (fsea.Read(i / 3) != array[i])
+        {
+          ++mismatchCnt ;
+        }
+      }
+      printf("subsampled load mismatch count: %d\n", mismatchCnt) ;
     }
     
     {
@@ -170,6 +437,48 @@ int main(int argc, char *argv[])
       printf("Space usage (bytes): %d\n", (int)fsea.GetSpace());
     }
 
+    {
+      // The values take more than 4 bytes, so the 5-byte elements are used.
+      FixedByteElemArray fbyea ;
+      size_t maxValue = (2ull << 35) + len ;
+      fbyea.Malloc(FixedByteElemArray::GetElemLengthForValue(maxValue), len) ;
+      for (i = 0 ; i < len ; ++i)
+        fbyea.Write(i, ((size_t)array[i] << 35) + i) ;
+      mismatchCnt = 0 ;
+      printf("\nFixed-byte element array:\n") ;
+      for (i = 0 ; i < len ; ++i)
+      {
+        if (fbyea.Read(i) != ((size_t)array[i] << 35) + i)
+          ++mismatchCnt ;
+      }
+      
+      // Swapping the neighbors shall not touch the other elements
+      for (i = 0 ; i + 1 < len ; i += 2)
+        fbyea.Swap(i, i + 1) ;
+      for (i = 0 ; i < len ; ++i)
+      {
+        size_t j = (i % 2 == 0 && i + 1 < len) ? i + 1 : ((i % 2 == 1) ? i - 1 : i) ;
+        if (fbyea.Read(i) != ((size_t)array[j] << 35) + j)
+          ++mismatchCnt ;
+      }
+      printf("mismatch count: %d\n", mismatchCnt) ;
+      printf("Space usage (bytes): %d\n", (int)fbyea.GetSpace());
+
+      FixedByteElemArray pushed ;
+      pushed.Malloc(fbyea.GetElemLength(), 0) ;
+      for (i = 0 ; i < len ; ++i)
+        pushed.PushBack(((size_t)array[i] << 35) + i) ;
+      pushed.ShiftToFront(len / 2, len - len / 2) ;
+      pushed.Resize(len - len / 2) ;
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < pushed.GetSize() ; ++i)
+      {
+        if (pushed.Read(i) != ((size_t)array[i + len / 2] << 35) + i + len / 2)
+          ++mismatchCnt ;
+      }
+      printf("push back and shift mismatch count: %d\n", mismatchCnt) ;
+    }
+
     FractionBitElemArray fbea ;
     fbea.InitFromArray(0, array, len) ;
     printf("\nFraction bits element array:\n") ;
@@ -373,7 +682,6 @@ int main(int argc, char *argv[])
 
       printf("Space usage (byptes): %d\n\n", (int)bvp.GetSpace()) ;
     }
-    
 
     // ------
     {
@@ -447,6 +755,19 @@ int main(int argc, char *argv[])
       }
       printf("Rank mismatch count: %d\n", mismatchCnt) ;
 
+      mismatchCnt = 0 ;
+      sum = 0 ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        size_t rank ;
+        int b = bvs.AccessAndRank(i, rank) ;
+        if (Utils::BitRead(B, i) == 1)
+          ++sum ;
+        if (b != Utils::BitRead(B, i) || rank != (b ? sum : i + 1 - sum))
+          ++mismatchCnt ;
+      }
+      printf("AccessAndRank mismatch count: %d\n", mismatchCnt) ;
+
       mismatchCnt = 0 ;
       k = 0 ;
       for (i = 0 ; i < n ; ++i)
@@ -715,7 +1036,7 @@ int main(int argc, char *argv[])
 
       printf("Space usage (byptes): %d\n\n", (int)t.GetSpace()) ;
     }
-   
+
     if (0)
     {
       printf("\nsave/load:\n") ;
@@ -939,7 +1260,7 @@ int main(int argc, char *argv[])
     }
     {
       printf("\nRunBlock:\n") ;
-      Sequence_RunBlock t ;
+      Sequence_RunBlock<> t ;
       //t.SetAlphabet(abCode) ;
       t.Init(S, n, abList ) ;
       
@@ -1184,13 +1505,15 @@ int main(int argc, char *argv[])
     FixedSizeElemArray BWT ;
     param.precomputeWidth = testLen > 10 ? 10 : testLen ;
     param.maxLcp = 17 ;
+    if (argc > 2 && !strcmp(argv[2], "text"))
+      param.sampleStrategy = FM_SAMPLE_STRATEGY_TEXT ;
     
     size_t firstISA = 0 ;
     param.selectedISA[0] = 0 ; 
     param.selectedISA[1] = 0 ; 
     FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
 
-    Sequence_RunBlock t ;
+    Sequence_RunBlock<> t ;
     t.Init(BWT, n, abList) ;
 
     //BWT.Print(stdout) ;
@@ -1213,7 +1536,7 @@ int main(int argc, char *argv[])
     
     FMIndex< Sequence_WaveletTree<Bitvector_Plain> > fmIndex ;
     //FMIndex< Sequence_Plain<Bitvector_Plain> > fmIndex ;
-    //FMIndex< Sequence_RunBlock > fmIndex ;
+    //FMIndex< Sequence_RunBlock<> > fmIndex ;
     fmIndex.Init(BWT, n, firstISA, 
         param,
         abList, strlen(abList)) ;
@@ -1875,6 +2198,974 @@ int main(int argc, char *argv[])
     }
     delete[] map ;
   }
+  else if (!strcmp(argv[1], "taxonomy"))
+  {
+    // Strain 272624 is under a subspecies, whose rank id is larger than species' and genus'.
+    // Species 600 is under a subgenus.
+    FILE *fp = fopen("tmp_nodes.dmp", "w") ;
+    fprintf(fp, "1\t|\t1\t|\tno rank\t|\n"
+        "445\t|\t1\t|\tgenus\t|\n"
+        "446\t|\t445\t|\tspecies\t|\n"
+        "91891\t|\t446\t|\tsubspecies\t|\n"
+        "272624\t|\t91891\t|\tstrain\t|\n"
+        "297246\t|\t446\t|\tstrain\t|\n"
+        "599\t|\t445\t|\tsubgenus\t|\n"
+        "600\t|\t599\t|\tspecies\t|\n") ;
+    fclose(fp) ;
+    fp = fopen("tmp_names.dmp", "w") ;
+    fprintf(fp, "1\t|\troot\t|\t\t|\tscientific name\t|\n") ;
+    fclose(fp) ;
+
+    Taxonomy taxonomy ;
+    taxonomy.Init("tmp_nodes.dmp", "tmp_names.dmp") ;
+    size_t species = taxonomy.CompactTaxId(446) ;
+    mismatchCnt = 0 ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(272624), RANK_SPECIES) != species)
+      ++mismatchCnt ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(297246), RANK_SPECIES) != species)
+      ++mismatchCnt ;
+    if (taxonomy.GetTaxIdAtAncestorRank(species, RANK_SPECIES) != species)
+      ++mismatchCnt ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(1), RANK_SPECIES) != taxonomy.GetNodeCount())
+      ++mismatchCnt ;
+    printf("Species ancestor mismatch count: %u\n", mismatchCnt) ;
+
+    // The shards by genus
+    size_t genus = taxonomy.CompactTaxId(445) ;
+    mismatchCnt = 0 ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(272624), RANK_GENUS) != genus)
+      ++mismatchCnt ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(297246), RANK_GENUS) != genus)
+      ++mismatchCnt ;
+    if (taxonomy.GetTaxIdAtAncestorRank(taxonomy.CompactTaxId(600), RANK_GENUS) != genus)
+      ++mismatchCnt ;
+    printf("Genus ancestor mismatch count: %u\n", mismatchCnt) ;
+    
+    remove("tmp_nodes.dmp") ;
+    remove("tmp_names.dmp") ;
+  }
+  else if (!strcmp(argv[1], "fmbuild"))
+  {
+    const size_t n = 50000 ;
+    char abList[] = "ACGT" ;
+    char *strs = (char *)malloc(n + 1) ;
+    FixedSizeElemArray s ;
+    srand(1) ;
+    GenerateRepetitiveText(n, abList, strs, s) ;
+
+    // The naive BWT from sorting the suffixes. BWT[i]=T[SA[i]-1], and the row of SA[i]=0 holds T[n-1].
+    size_t *sa = (size_t *)malloc(sizeof(size_t) * n) ;
+    for (i = 0 ; i < n ; ++i)
+      sa[i] = i ;
+    struct _CompareSuffix cmp ;
+    cmp.s = strs ;
+    std::sort(sa, sa + n, cmp) ;
+    FixedSizeElemArray naiveBWT ;
+    naiveBWT.Malloc(2, n) ;
+    size_t naiveFirstISA = 0 ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      naiveBWT.Write(i, s.Read((sa[i] + n - 1) % n)) ;
+      if (sa[i] == 0)
+        naiveFirstISA = i ;
+    }
+
+    // The serial build with several sorting rounds
+    struct _FMBuilderParam serialParam ;
+    serialParam.threadCnt = 1 ;
+    serialParam.saBlockSize = n / 8 ;
+    serialParam.saDcv = 256 ;
+    serialParam.printLog = false ;
+    FixedSizeElemArray serialBWT ;
+    size_t serialFirstISA = 0 ;
+    FMBuilder::Build(s, n, 4, serialBWT, serialFirstISA, serialParam) ;
+    mismatchCnt = CountMismatch(serialBWT, naiveBWT) + (serialFirstISA != naiveFirstISA ? 1 : 0) ;
+    for (i = 0 ; i < serialParam.sampledSA.GetSize() ; ++i)
+      if (serialParam.sampledSA.Read(i) != sa[i * serialParam.sampleRate])
+        ++mismatchCnt ;
+    printf("Serial build mismatch count: %u\n", mismatchCnt) ;
+
+    // The difference cover sample and the chunks are sorted by several threads.
+    {
+      struct _FMBuilderParam param ;
+      param.threadCnt = 4 ;
+      param.saBlockSize = n / 8 ;
+      param.saDcv = 256 ;
+      param.printLog = false ;
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+      mismatchCnt = CountMismatch(BWT, serialBWT) + CountMismatch(param.sampledSA, serialParam.sampledSA) 
+        + (firstISA != serialFirstISA ? 1 : 0) ;
+      printf("Parallel build mismatch count: %u\n", mismatchCnt) ;
+      param.Free() ;
+    }
+
+    // The suffix array from prefix-free parsing
+    {
+      struct _FMBuilderParam param ;
+      param.saBlockSize = n / 8 ;
+      param.pfpWindow = 10 ;
+      param.pfpModulus = 100 ;
+      param.printLog = false ;
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+      mismatchCnt = CountMismatch(BWT, serialBWT) + CountMismatch(param.sampledSA, serialParam.sampledSA) 
+        + (firstISA != serialFirstISA ? 1 : 0) ;
+      printf("Prefix-free parsing build mismatch count: %u\n", mismatchCnt) ;
+      param.Free() ;
+    }
+
+    // Checkpoint every sorting round, then resume from the state before the last round.
+    {
+      char checkpointPrefix[] = "tmp_ckpt" ;
+      struct _FMBuilderParam param ;
+      param.saBlockSize = n / 8 ;
+      param.saDcv = 256 ;
+      param.printLog = false ;
+      param.checkpointPrefix = checkpointPrefix ;
+      param.checkpointInterval = 0 ;
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+      param.Free() ;
+      
+      mismatchCnt = 0 ;
+      FILE *fp = fopen("tmp_ckpt.state.ckpt", "rb") ;
+      if (fp == NULL)
+        ++mismatchCnt ;
+      else
+        fclose(fp) ;
+
+      struct _FMBuilderParam resumeParam ;
+      resumeParam.saBlockSize = n / 8 ;
+      resumeParam.saDcv = 256 ;
+      resumeParam.printLog = false ;
+      resumeParam.checkpointPrefix = checkpointPrefix ;
+      resumeParam.checkpointInterval = 0 ;
+      resumeParam.resume = true ;
+      FixedSizeElemArray resumedBWT ;
+      firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, resumedBWT, firstISA, resumeParam) ;
+      mismatchCnt += CountMismatch(resumedBWT, serialBWT) + CountMismatch(resumeParam.sampledSA, serialParam.sampledSA) 
+        + (firstISA != serialFirstISA ? 1 : 0) ;
+      printf("Checkpoint and resume mismatch count: %u\n", mismatchCnt) ;
+      FMBuilder::RemoveCheckpoint(resumeParam) ;
+      resumeParam.Free() ;
+    }
+
+    // Prepend the first part of the text to the index of the rest.
+    {
+      const size_t m = n / 3 ;
+      FixedSizeElemArray G ;
+      FixedSizeElemArray T ;
+      G.Malloc(2, m) ;
+      T.Malloc(2, n - m) ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        if (i < m)
+          G.Write(i, s.Read(i)) ;
+        else
+          T.Write(i - m, s.Read(i)) ;
+      }
+
+      struct _FMBuilderParam param ;
+      param.saBlockSize = n / 8 ;
+      param.saDcv = 256 ;
+      param.printLog = false ;
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(T, n - m, 4, BWT, firstISA, param) ;
+      FMIndex< Sequence_RunBlock<> > fmIndex ;
+      fmIndex.Init(BWT, n - m, firstISA, param, abList, strlen(abList)) ;
+      
+      size_t *newRows = (size_t *)malloc(sizeof(size_t) * m) ;
+      FixedSizeElemArray mergedBWT ;
+      size_t mergedFirstISA = 0 ;
+      fmIndex.PrependText(G, m, param, mergedBWT, mergedFirstISA, newRows) ;
+      mismatchCnt = CountMismatch(mergedBWT, serialBWT) + (mergedFirstISA != serialFirstISA ? 1 : 0) ;
+      for (i = 0 ; i < n ; ++i)
+        if (sa[i] < m && newRows[sa[i]] != i)
+          ++mismatchCnt ;
+      printf("Prepend text mismatch count: %u\n", mismatchCnt) ;
+      free(newRows) ;
+    }
+
+    // Split the text into two shards. The pattern within a shard occurs as many times
+    //   in the whole text as in the two shards combined.
+    {
+      FMIndex< Sequence_RunBlock<> > fmIndices[3] ; // the two shards and the whole text
+      const size_t patternLen = 30 ;
+      int k ;
+      for (k = 0 ; k < 3 ; ++k)
+      {
+        size_t from = (k == 1) ? n / 2 : 0 ;
+        size_t len = (k == 0) ? n / 2 : (n - from) ;
+        FixedSizeElemArray T ;
+        T.Malloc(2, len) ;
+        for (i = 0 ; i < len ; ++i)
+          T.Write(i, s.Read(from + i)) ;
+
+        struct _FMBuilderParam param ;
+        param.saBlockSize = n / 8 ;
+        param.saDcv = 256 ;
+        param.printLog = false ;
+        FixedSizeElemArray BWT ;
+        size_t firstISA = 0 ;
+        FMBuilder::Build(T, len, 4, BWT, firstISA, param) ;
+        fmIndices[k].Init(BWT, len, firstISA, param, abList, strlen(abList)) ;
+      }
+
+      mismatchCnt = 0 ;
+      for (i = 0 ; i + patternLen <= n ; i += 97)
+      {
+        if (i < n / 2 && i + patternLen > n / 2)
+          continue ;
+        if (CountOccurrences(fmIndices[2], strs + i, patternLen) != 
+            CountOccurrences(fmIndices[0], strs + i, patternLen) 
+            + CountOccurrences(fmIndices[1], strs + i, patternLen))
+          ++mismatchCnt ;
+      }
+      printf("Sharded search mismatch count: %u\n", mismatchCnt) ;
+    }
+
+    serialParam.Free() ;
+    free(sa) ;
+    free(strs) ;
+  }
+  else if (!strcmp(argv[1], "rank9")) // the separate and the interleaved rank layouts
+  {
+    const size_t lengths[] = {1, 63, 64, 511, 512, 513, 1000, 100037, (1<<20) + 300} ;
+    const int densities[] = {2, 20} ; // a bit is set with probability 1/density
+    size_t li ;
+    int di ;
+    srand(1) ;
+    mismatchCnt = 0 ;
+    for (li = 0 ; li < sizeof(lengths) / sizeof(lengths[0]) ; ++li)
+    {
+      for (di = 0 ; di < 2 ; ++di)
+      {
+        size_t n = lengths[li] ;
+        WORD *B = Utils::MallocByBits(n) ;
+        for (i = 0 ; i < n ; ++i)
+          if (rand() % densities[di] == 0)
+            Utils::BitSet(B, i) ;
+
+        Bitvector_Plain separate ;
+        separate.Init(B, n) ;
+        
+        Bitvector_Plain interleaved ;
+        interleaved.SetSelectSpeed(DS_SELECT_SPEED_NO) ;
+        interleaved.SetRankLayout(BITVECTOR_RANK_LAYOUT_INTERLEAVED) ;
+        interleaved.Init(B, n) ;
+        FILE *fp = fopen("tmp.out", "w") ;
+        interleaved.Save(fp) ;
+        fclose(fp) ;
+        fp = fopen("tmp.out", "r") ;
+        interleaved.Load(fp) ;
+        fclose(fp) ;
+        if (interleaved.GetRankLayout() != BITVECTOR_RANK_LAYOUT_INTERLEAVED)
+          ++mismatchCnt ;
+
+        // The interleaved layout has no select, so it falls back to the separate one when select is requested.
+        Bitvector_Plain fallback ;
+        fallback.SetRankLayout(BITVECTOR_RANK_LAYOUT_INTERLEAVED) ;
+        fallback.Init(B, n) ;
+        if (fallback.GetRankLayout() != BITVECTOR_RANK_LAYOUT_SEPARATE)
+          ++mismatchCnt ;
+
+        size_t ones = 0 ;
+        for (i = 0 ; i < n ; ++i)
+        {
+          size_t rank, expectRank ;
+          size_t ri, rj, expectRi, expectRj ;
+          size_t j = i + (i * 7919) % 2000 ;
+          if (j >= n)
+            j = n - 1 ;
+          int b = interleaved.AccessAndRank(i, rank) ;
+          separate.AccessAndRank(i, expectRank) ;
+          if (b != separate.Access(i) || rank != expectRank 
+              || interleaved.Rank(1, i) != separate.Rank(1, i)
+              || interleaved.Rank(0, i) != separate.Rank(0, i)
+              || interleaved.Rank(1, i, 0) != separate.Rank(1, i, 0))
+            ++mismatchCnt ;
+          interleaved.RankPair(1, i, j, ri, rj) ;
+          separate.RankPair(1, i, j, expectRi, expectRj) ;
+          if (ri != expectRi || rj != expectRj)
+            ++mismatchCnt ;
+
+          if (Utils::BitRead(B, i))
+          {
+            ++ones ;
+            if (separate.Select(ones) != i || fallback.Select(ones) != i)
+              ++mismatchCnt ;
+          }
+        }
+        if (separate.Rank(1, n - 1) != ones)
+          ++mismatchCnt ;
+        free(B) ;
+      }
+    }
+    printf("Interleaved rank layout mismatch count: %u\n", mismatchCnt) ;
+  }
+  else if (!strcmp(argv[1], "sparse")) // the Elias-Fano bitvector against counting the bits
+  {
+    const size_t lengths[] = {1, 64, 1000, 100037} ;
+    const int densities[] = {2, 20, 500} ; // a bit is set with probability 1/density
+    size_t li ;
+    int di ;
+    srand(1) ;
+    unsigned int rankMismatchCnt = 0 ;
+    unsigned int accessAndRankMismatchCnt = 0 ;
+    unsigned int selectMismatchCnt = 0 ;
+    for (li = 0 ; li < sizeof(lengths) / sizeof(lengths[0]) ; ++li)
+    {
+      for (di = 0 ; di < 3 ; ++di)
+      {
+        size_t n = lengths[li] ;
+        WORD *B = Utils::MallocByBits(n) ;
+        for (i = 0 ; i < n ; ++i)
+          if (rand() % densities[di] == 0)
+            Utils::BitSet(B, i) ;
+        Bitvector_Sparse bvs ;
+        bvs.Init(B, n) ;
+
+        size_t ones = 0 ;
+        for (i = 0 ; i < n ; ++i)
+        {
+          int b = Utils::BitRead(B, i) ;
+          if (bvs.Rank1(i, 0) != ones)
+            ++rankMismatchCnt ;
+          ones += b ;
+          if (bvs.Access(i) != b || bvs.Rank1(i) != ones)
+            ++rankMismatchCnt ;
+          
+          size_t rank = 0 ;
+          if (bvs.AccessAndRank(i, rank) != b || rank != (b ? ones : i + 1 - ones))
+            ++accessAndRankMismatchCnt ;
+          if (b && bvs.Select(ones) != i)
+            ++selectMismatchCnt ;
+        }
+        free(B) ;
+      }
+    }
+    printf("Access and rank mismatch count: %u\n", rankMismatchCnt) ;
+    printf("AccessAndRank mismatch count: %u\n", accessAndRankMismatchCnt) ;
+    printf("Select mismatch count: %u\n", selectMismatchCnt) ;
+  }
+  else if (!strcmp(argv[1], "textsample")) // sample the SA by rows or by text positions
+  {
+    const size_t n = 50000 ;
+    char abList[] = "ACGT" ;
+    char *strs = (char *)malloc(n + 1) ;
+    FixedSizeElemArray s ;
+    srand(1) ;
+    GenerateRepetitiveText(n, abList, strs, s) ;
+    
+    size_t *sa = (size_t *)malloc(sizeof(size_t) * n) ;
+    for (i = 0 ; i < n ; ++i)
+      sa[i] = i ;
+    struct _CompareSuffix cmp ;
+    cmp.s = strs ;
+    std::sort(sa, sa + n, cmp) ;
+
+    const int sampleRate = 32 ;
+    std::vector<size_t> locatedSA[2] ;
+    size_t maxSteps[2] = {0, 0} ;
+    int k ;
+    for (k = 0 ; k < 2 ; ++k)
+    {
+      struct _FMBuilderParam param ;
+      param.saBlockSize = n / 8 ;
+      param.saDcv = 256 ;
+      param.sampleRate = sampleRate ;
+      param.printLog = false ;
+      if (k == 1)
+        param.sampleStrategy = FM_SAMPLE_STRATEGY_TEXT ;
+      // The selected SA like the genome boundaries
+      for (i = 1 ; i < 5 ; ++i)
+        param.selectedISA[i * n / 5 - 11] ;
+
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+      FMIndex< Sequence_RunBlock<> > fmIndex ;
+      fmIndex.Init(BWT, n, firstISA, param, abList, strlen(abList)) ;
+      fmIndex.LocateRange(0, n - 1, true, locatedSA[k]) ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        size_t l ;
+        fmIndex.BackwardToSampledSA(i, l) ;
+        if (l > maxSteps[k])
+          maxSteps[k] = l ;
+      }
+    }
+    
+    mismatchCnt = 0 ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      if (locatedSA[0][i] != sa[i] || locatedSA[1][i] != sa[i])
+        ++mismatchCnt ;
+    }
+    printf("Locate mismatch count: %u\n", mismatchCnt) ;
+    // Sampling by text positions bounds the LF steps by the sample rate.
+    printf("Max LF steps by rows: %lu; by text positions: %lu\n", maxSteps[0], maxSteps[1]) ;
+    printf("Text sampling bound violated: %d\n", maxSteps[1] >= (size_t)sampleRate ? 1 : 0) ;
+    
+    free(sa) ;
+    free(strs) ;
+  }
+  else if (!strcmp(argv[1], "ftab")) // the lookup table extended from the index's at loading
+  {
+    const size_t n = 50000 ;
+    char abList[] = "ACGT" ;
+    char *strs = (char *)malloc(n + 1) ;
+    FixedSizeElemArray s ;
+    srand(1) ;
+    GenerateRepetitiveText(n, abList, strs, s) ;
+    
+    struct _FMBuilderParam param ;
+    param.saBlockSize = n / 8 ;
+    param.saDcv = 256 ;
+    param.precomputeWidth = 4 ;
+    param.printLog = false ;
+    FixedSizeElemArray BWT ;
+    size_t firstISA = 0 ;
+    FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+    FMIndex< Sequence_RunBlock<> > fmIndex ;
+    fmIndex.Init(BWT, n, firstISA, param, abList, strlen(abList)) ;
+
+    // The search results of every k-mer with the index's table only
+    const int k = 7 ;
+    const size_t kmerCnt = 1ull << (2 * k) ;
+    char kmer[k + 1] ;
+    std::vector<size_t> expectSp(kmerCnt), expectEp(kmerCnt), expectL(kmerCnt) ;
+    kmer[k] = '\0' ;
+    for (i = 0 ; i < kmerCnt ; ++i)
+    {
+      int j ;
+      for (j = 0 ; j < k ; ++j)
+        kmer[j] = abList[(i >> (2 * j)) & 3] ;
+      expectL[i] = fmIndex.BackwardSearch(kmer, k, expectSp[i], expectEp[i]) ;
+    }
+    
+    int pass ;
+    for (pass = 0 ; pass < 2 ; ++pass)
+    {
+      if (pass == 0)
+        fmIndex.InitExtendedPrecomputedRange(k, 2) ;
+      else // from the cache file
+      {
+        FILE *fp = fopen("tmp.out", "w") ;
+        fmIndex.SaveExtendedPrecomputedRange(fp) ;
+        fclose(fp) ;
+        fp = fopen("tmp.out", "r") ;
+        printf("Cache loaded: %d\n", fmIndex.LoadExtendedPrecomputedRange(fp, k) ? 1 : 0) ;
+        fclose(fp) ;
+      }
+      
+      mismatchCnt = 0 ;
+      size_t foundCnt = 0 ;
+      for (i = 0 ; i < kmerCnt ; ++i)
+      {
+        int j ;
+        size_t sp = 0, ep = 0 ;
+        for (j = 0 ; j < k ; ++j)
+          kmer[j] = abList[(i >> (2 * j)) & 3] ;
+        size_t l = fmIndex.BackwardSearch(kmer, k, sp, ep) ;
+        if (l != expectL[i] || (l == (size_t)k && (sp != expectSp[i] || ep != expectEp[i])))
+          ++mismatchCnt ;
+        if (l == (size_t)k)
+          ++foundCnt ;
+      }
+      printf("%s table: found %lu of %lu %d-mers, mismatch count: %u\n", pass == 0 ? "Extended" : "Cached", 
+          foundCnt, kmerCnt, k, mismatchCnt) ;
+    }
+
+    // The cache from another index of the same length is rejected
+    {
+      GenerateRepetitiveText(n, abList, strs, s) ;
+      struct _FMBuilderParam otherParam ;
+      otherParam.saBlockSize = n / 8 ;
+      otherParam.saDcv = 256 ;
+      otherParam.precomputeWidth = 4 ;
+      otherParam.printLog = false ;
+      FixedSizeElemArray otherBWT ;
+      FMBuilder::Build(s, n, 4, otherBWT, firstISA, otherParam) ;
+      FMIndex< Sequence_RunBlock<> > otherFmIndex ;
+      otherFmIndex.Init(otherBWT, n, firstISA, otherParam, abList, strlen(abList)) ;
+      FILE *fp = fopen("tmp.out", "r") ;
+      printf("Cache of another index loaded: %d\n", otherFmIndex.LoadExtendedPrecomputedRange(fp, k) ? 1 : 0) ;
+      fclose(fp) ;
+    }
+    free(strs) ;
+  }
+  else if (!strcmp(argv[1], "lcp")) // expand the ranges by the semiLcp bits for --lcp-restart
+  {
+    // The second length fills the last word of the semiLcp bits
+    const size_t lengths[] = {50000, 51200} ;
+    const size_t maxLcp = 12 ;
+    char abList[] = "ACGT" ;
+    size_t li ;
+    srand(1) ;
+    for (li = 0 ; li < 2 ; ++li)
+    {
+      const size_t n = lengths[li] ;
+      char *strs = (char *)malloc(n + 1) ;
+      FixedSizeElemArray s ;
+      GenerateRepetitiveText(n, abList, strs, s) ;
+    
+      size_t *sa = (size_t *)malloc(sizeof(size_t) * n) ;
+      for (i = 0 ; i < n ; ++i)
+        sa[i] = i ;
+      struct _CompareSuffix cmp ;
+      cmp.s = strs ;
+      std::sort(sa, sa + n, cmp) ;
+      // lcpAtLeast[i]: whether row i shares maxLcp characters with row i-1 
+      std::vector<bool> lcpAtLeast(n, false) ;
+      for (i = 1 ; i < n ; ++i)
+      {
+        size_t l ;
+        for (l = 0 ; l < maxLcp && sa[i - 1] + l < n && sa[i] + l < n ; ++l)
+          if (strs[sa[i - 1] + l] != strs[sa[i] + l])
+            break ;
+        lcpAtLeast[i] = (l == maxLcp) ;
+      }
+
+      struct _FMBuilderParam param ;
+      param.saBlockSize = n / 8 ;
+      param.saDcv = 256 ;
+      param.precomputeWidth = 6 ;
+      param.maxLcp = maxLcp ;
+      param.printLog = false ;
+      FixedSizeElemArray BWT ;
+      size_t firstISA = 0 ;
+      FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+      FMIndex< Sequence_RunBlock<> > fmIndex ;
+      fmIndex.Init(BWT, n, firstISA, param, abList, strlen(abList)) ;
+
+      // Every single row, including the first and the last row
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        size_t sp = i, ep = i ;
+        size_t expectSp = i, expectEp = i ;
+        while (expectSp > 0 && lcpAtLeast[expectSp])
+          --expectSp ;
+        while (expectEp + 1 < n && lcpAtLeast[expectEp + 1])
+          ++expectEp ;
+        fmIndex.ExpandRangeByLcp(sp, ep) ;
+        if (sp != expectSp || ep != expectEp)
+          ++mismatchCnt ;
+      }
+      printf("Single row expansion mismatch count: %u\n", mismatchCnt) ;
+
+      // The restart of the search: the expanded range of a pattern is the range of its 
+      //   length-maxLcp prefix, from which the search continues to the left.
+      mismatchCnt = 0 ;
+      size_t expandedCnt = 0 ;
+      for (i = 0 ; i < 10000 ; ++i)
+      {
+        size_t m = maxLcp + 1 + rand() % 30 ;
+        size_t start = rand() % (n - m) ;
+        size_t sp = 0, ep = 0 ;
+        size_t prefixSp = 0, prefixEp = 0 ;
+        if (fmIndex.BackwardSearch(strs + start, m, sp, ep) != m)
+          ++mismatchCnt ;
+        size_t oldSize = ep - sp + 1 ;
+        fmIndex.ExpandRangeByLcp(sp, ep) ;
+        if (ep - sp + 1 > oldSize)
+          ++expandedCnt ;
+        if (fmIndex.BackwardSearch(strs + start, maxLcp, prefixSp, prefixEp) != maxLcp 
+            || sp != prefixSp || ep != prefixEp)
+          ++mismatchCnt ;
+      
+        // Continue from the prefix to the maxLcp characters before it
+        if (start >= maxLcp)
+        {
+          size_t restartSp = sp, restartEp = ep ;
+          size_t freshSp = 0, freshEp = 0 ;
+          size_t l = fmIndex.BackwardSearchFrom(strs + start - maxLcp, 2 * maxLcp, maxLcp, restartSp, restartEp) ;
+          if (fmIndex.BackwardSearch(strs + start - maxLcp, 2 * maxLcp, freshSp, freshEp) != l 
+              || restartSp != freshSp || restartEp != freshEp)
+            ++mismatchCnt ;
+        }
+      }
+      printf("Expanded %lu of 10000 pattern ranges, mismatch count: %u\n", expandedCnt, mismatchCnt) ;
+
+      free(sa) ;
+      free(strs) ;
+    }
+  }
+  else if (!strcmp(argv[1], "sketch"))
+  {
+    const size_t n = 200000 ;
+    const char abList[] = "ACGT" ;
+    char *a = (char *)malloc(n + 1) ;
+    char *disjoint = (char *)malloc(n + 1) ;
+    char *half = (char *)malloc(n + 1) ; // the first half from a
+    char *mutated = (char *)malloc(n + 1) ; // 1% substitutions from a
+    srand(1) ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      a[i] = abList[rand() % 4] ;
+      disjoint[i] = abList[rand() % 4] ;
+      half[i] = (i < n / 2) ? a[i] : abList[rand() % 4] ;
+      mutated[i] = a[i] ;
+      if (rand() % 100 == 0)
+        mutated[i] = abList[(strchr(abList, a[i]) - abList + 1 + rand() % 3) % 4] ;
+    }
+    a[n] = disjoint[n] = half[n] = mutated[n] = '\0' ;
+
+    GenomeSketch sa, sd, sh, sm ;
+    sa.Init(a) ;
+    sd.Init(disjoint) ;
+    sh.Init(half) ;
+    sm.Init(mutated) ;
+    
+    // Expected: identical 1/1, disjoint 0/0, half overlap 1/3 for Jaccard and 1/2 for containment.
+    //   1% substitutions keep about 0.99^21 of the k-mers, and the identity is 0.99.
+    const double tolerance = 0.05 ;
+    mismatchCnt = 0 ;
+    if (fabs(sa.Jaccard(sa) - 1) > 1e-9 || fabs(sa.Containment(sa) - 1) > 1e-9 
+        || fabs(sa.Identity(sa) - 1) > 1e-9)
+      ++mismatchCnt ;
+    if (sa.Jaccard(sd) > tolerance || sa.Containment(sd) > tolerance)
+      ++mismatchCnt ;
+    if (fabs(sa.Jaccard(sh) - 1.0 / 3) > tolerance || fabs(sh.Containment(sa) - 0.5) > tolerance)
+      ++mismatchCnt ;
+    if (fabs(sm.Containment(sa) - pow(0.99, 21)) > tolerance || fabs(sm.Identity(sa) - 0.99) > 0.005
+        || fabs(sm.ContainmentIdentity(sa) - 0.99) > 0.005)
+      ++mismatchCnt ;
+    printf("Sketch estimate mismatch count: %u\n", mismatchCnt) ;
+    printf("Jaccard: %lf %lf %lf %lf\n", sa.Jaccard(sa), sa.Jaccard(sd), sa.Jaccard(sh), sa.Jaccard(sm)) ; 
+    printf("Containment: %lf %lf %lf %lf\n", sa.Containment(sa), sa.Containment(sd), 
+        sh.Containment(sa), sm.Containment(sa)) ;
+    
+    // The union of a and disjoint contains both, and contains half of "half".
+    GenomeSketch su ;
+    su.Merge(sa) ;
+    su.Merge(sd) ;
+    mismatchCnt = 0 ;
+    if (fabs(sa.Containment(su) - 1) > tolerance || fabs(sd.Containment(su) - 1) > tolerance
+        || fabs(sh.Containment(su) - 0.5) > tolerance)
+      ++mismatchCnt ;
+    printf("Union sketch containment mismatch count: %u\n", mismatchCnt) ;
+
+    free(a) ;
+    free(disjoint) ;
+    free(half) ;
+    free(mutated) ;
+  }
+  else if (!strcmp(argv[1], "bwtseq")) // the sequences for the BWT
+  {
+    const size_t n = 100000 ;
+    char abList[] = "ACGT" ;
+    char *strs = (char *)malloc(n + 1) ;
+    FixedSizeElemArray s ;
+    srand(1) ;
+    GenerateRepetitiveText(n, abList, strs, s) ;
+    
+    // The BWT has the runs from the repeats
+    struct _FMBuilderParam param ;
+    param.saBlockSize = n / 4 ;
+    param.saDcv = 256 ;
+    param.printLog = false ;
+    FixedSizeElemArray S ;
+    size_t firstISA = 0 ;
+    FMBuilder::Build(s, n, 4, S, firstISA, param) ;
+    param.Free() ;
+    
+    size_t *occ = (size_t *)malloc(sizeof(size_t) * 4 * n) ;
+    size_t count[4] = {0, 0, 0, 0} ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      ++count[S.Read(i)] ;
+      memcpy(occ + 4 * i, count, sizeof(count)) ;
+    }
+    
+    {
+      printf("Occurrence table:\n") ;
+      Sequence_OccTable t ;
+      t.Init(S, n, abList) ;
+      printf("mismatch count: %lu\n", CountSequenceMismatch(t, S, n, abList, occ)) ;
+      printf("Space usage (bytes): %lu\n", t.GetSpace()) ;
+
+      FILE *fp = fopen("tmp.out", "w") ;
+      t.Save(fp) ;
+      fclose(fp) ;
+      Sequence_OccTable loaded ;
+      fp = fopen("tmp.out", "r") ;
+      loaded.Load(fp) ;
+      fclose(fp) ;
+      printf("load/save mismatch count: %lu\n", CountSequenceMismatch(loaded, S, n, abList, occ)) ;
+
+      Sequence_OccTable parallel ;
+      parallel.SetThreadCnt(4) ;
+      parallel.Init(S, n, abList) ;
+      printf("parallel construction mismatch count: %lu\n", CountSequenceMismatch(parallel, S, n, abList, occ)) ;
+      printf("AccessAndRank mismatch count: %lu\n", CountAccessAndRankMismatch(t, S, n, abList, occ)) ;
+      printf("RankPair mismatch count: %lu\n", CountRankPairMismatch(t, S, n, abList, occ)) ;
+    }
+    
+    {
+      printf("\nWavelet tree:\n") ;
+      Sequence_WaveletTree<> t ;
+      t.Init(S, n, abList) ;
+      printf("mismatch count: %lu\n", CountSequenceMismatch(t, S, n, abList, occ)) ;
+      printf("AccessAndRank mismatch count: %lu\n", CountAccessAndRankMismatch(t, S, n, abList, occ)) ;
+      printf("RankPair mismatch count: %lu\n", CountRankPairMismatch(t, S, n, abList, occ)) ;
+    }
+    
+    {
+      printf("\nWavelet matrix:\n") ;
+      Sequence_WaveletMatrix<> t ;
+      t.Init(S, n, abList) ;
+      FILE *fp = fopen("tmp.out", "w") ;
+      t.Save(fp) ;
+      fclose(fp) ;
+      fp = fopen("tmp.out", "r") ;
+      t.Load(fp) ;
+      fclose(fp) ;
+      printf("mismatch count: %lu\n", CountSequenceMismatch(t, S, n, abList, occ)) ;
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        WORD code = S.Read(i) ;
+        if (t.Select(abList[code], occ[4 * i + code]) != i)
+          ++mismatchCnt ;
+      }
+      printf("Select mismatch count: %u\n", mismatchCnt) ;
+      printf("AccessAndRank mismatch count: %lu\n", CountAccessAndRankMismatch(t, S, n, abList, occ)) ;
+      printf("RankPair mismatch count: %lu\n", CountRankPairMismatch(t, S, n, abList, occ)) ;
+    }
+    
+    {
+      printf("\nRun block:\n") ;
+      Sequence_RunBlock<> t ;
+      t.Init(S, n, abList) ;
+      printf("mismatch count: %lu\n", CountSequenceMismatch(t, S, n, abList, occ)) ;
+      printf("AccessAndRank mismatch count: %lu\n", CountAccessAndRankMismatch(t, S, n, abList, occ)) ;
+      printf("RankPair mismatch count: %lu\n", CountRankPairMismatch(t, S, n, abList, occ)) ;
+    }
+
+    {
+      printf("\nRun block with wavelet matrix:\n") ;
+      Sequence_RunBlock< Sequence_WaveletMatrix<> > t ;
+      t.Init(S, n, abList) ;
+      FILE *fp = fopen("tmp.out", "w") ;
+      t.Save(fp) ;
+      fclose(fp) ;
+      fp = fopen("tmp.out", "r") ;
+      t.Load(fp) ;
+      fclose(fp) ;
+      printf("mismatch count: %lu\n", CountSequenceMismatch(t, S, n, abList, occ)) ;
+      printf("AccessAndRank mismatch count: %lu\n", CountAccessAndRankMismatch(t, S, n, abList, occ)) ;
+      printf("RankPair mismatch count: %lu\n", CountRankPairMismatch(t, S, n, abList, occ)) ;
+
+      // Same answers as the run blocks with the wavelet tree
+      Sequence_RunBlock< Sequence_WaveletTree<> > wt ;
+      wt.Init(S, n, abList) ;
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        size_t rank, wtRank ;
+        size_t ri, rj, wtRi, wtRj ;
+        size_t j = i + (i * 7919) % 1000 ;
+        if (j >= n)
+          j = n - 1 ;
+        ALPHABET c = abList[i % 4] ;
+        if (t.Access(i) != wt.Access(i) || t.Rank(c, i) != wt.Rank(c, i) 
+            || t.AccessAndRank(i, rank) != wt.AccessAndRank(i, wtRank) || rank != wtRank)
+          ++mismatchCnt ;
+        t.RankPair(c, i, j, ri, rj) ;
+        wt.RankPair(c, i, j, wtRi, wtRj) ;
+        if (ri != wtRi || rj != wtRj)
+          ++mismatchCnt ;
+      }
+      printf("mismatch count against the wavelet tree: %u\n", mismatchCnt) ;
+    }
+
+    free(occ) ;
+    free(strs) ;
+  }
+  else if (!strcmp(argv[1], "shard")) // classify with the shards by genus and with the whole index
+  {
+    const size_t len = 20000 ;
+    const int readLen = 100 ;
+    const char abList[] = "ACGT" ;
+    std::vector<std::string> genomes(4) ;
+    size_t j ;
+    srand(1) ;
+    for (i = 0 ; i < 4 ; ++i)
+    {
+      genomes[i].resize(len) ;
+      for (j = 0 ; j < len ; ++j)
+        genomes[i][j] = abList[rand() % 4] ;
+    }
+    // seq0 and seq2 share a segment, so its reads hit both shards
+    genomes[2].replace(len / 2, 1000, genomes[0], len / 2, 1000) ;
+    WriteTestTaxonomy() ;
+    WriteTestGenomes("tmp_ref.fa", genomes, 0, 4, "w") ;
+    BuildTestIndex("tmp_ref.fa", "tmp_whole", 1, 0, FM_SAMPLE_STRATEGY_ROW) ;
+    BuildTestIndex("tmp_ref.fa", "tmp_shard.shard0", 2, 0, FM_SAMPLE_STRATEGY_ROW) ;
+    BuildTestIndex("tmp_ref.fa", "tmp_shard.shard1", 2, 1, FM_SAMPLE_STRATEGY_ROW) ;
+    FILE *fp = fopen("tmp_shard.0.cfr", "w") ;
+    fprintf(fp, "tmp_shard.shard0\ntmp_shard.shard1\n") ;
+    fclose(fp) ;
+
+    struct _classifierParam param ;
+    Classifier whole ;
+    Classifier sharded ;
+    whole.Init((char *)"tmp_whole", param) ;
+    sharded.Init((char *)"tmp_shard", param) ;
+    Quantifier wholeQuantifier ;
+    Quantifier shardedQuantifier ;
+    wholeQuantifier.Init((char *)"tmp_whole") ;
+    shardedQuantifier.Init((char *)"tmp_shard") ;
+
+    // Every fifth read is from the shared segment, and every other read has a substitution
+    const int readCnt = 1000 ;
+    char read[readLen + 1] ;
+    int bothShardCnt = 0 ;
+    mismatchCnt = 0 ;
+    for (i = 0 ; i < (size_t)readCnt ; ++i)
+    {
+      size_t g = rand() % 4 ;
+      size_t start = rand() % (len - readLen) ;
+      if (i % 5 == 0)
+      {
+        g = 0 ;
+        start = len / 2 + rand() % (1000 - readLen) ;
+      }
+      memcpy(read, genomes[g].c_str() + start, readLen) ;
+      read[readLen] = '\0' ;
+      if (i % 2)
+        read[readLen / 2] = abList[(strchr(abList, read[readLen / 2]) - abList + 1) % 4] ;
+
+      struct _classifierResult wholeResult ;
+      struct _classifierResult shardedResult ;
+      whole.Query(read, NULL, wholeResult) ;
+      sharded.Query(read, NULL, shardedResult) ;
+      mismatchCnt += CountClassifierResultMismatch(wholeResult, shardedResult) ;
+      // A shard can stop a hit earlier than the whole index, e.g. the read crossing the end of 
+      //   the shared segment, so its extra shorter hit can only raise the secondary score.
+      if (shardedResult.secondaryScore < wholeResult.secondaryScore)
+        ++mismatchCnt ;
+      if (shardedResult.taxIds.size() == 1 && shardedResult.taxIds[0] == 1) // LCA of the two genera
+        ++bothShardCnt ;
+      wholeQuantifier.AddReadAssignment(wholeResult) ;
+      shardedQuantifier.AddReadAssignment(shardedResult) ;
+    }
+    printf("Reads hitting both shards: %d\n", bothShardCnt) ;
+    printf("Classification mismatch count: %u\n", mismatchCnt) ;
+
+    wholeQuantifier.Quantification() ;
+    shardedQuantifier.Quantification() ;
+    fp = fopen("tmp_whole.report", "w") ;
+    wholeQuantifier.Output(fp, QUANTIFIER_OUTPUT_FORMAT_CENTRIFUGER) ;
+    fclose(fp) ;
+    fp = fopen("tmp_shard.report", "w") ;
+    shardedQuantifier.Output(fp, QUANTIFIER_OUTPUT_FORMAT_CENTRIFUGER) ;
+    fclose(fp) ;
+    printf("Quantification mismatch count: %u\n", 
+        (unsigned int)CountFileMismatch("tmp_whole.report", "tmp_shard.report")) ;
+
+    RemoveTestIndex("tmp_whole") ;
+    RemoveTestIndex("tmp_shard.shard0") ;
+    RemoveTestIndex("tmp_shard.shard1") ;
+    RemoveTestTaxonomy() ;
+    remove("tmp_shard.0.cfr") ;
+    remove("tmp_ref.fa") ;
+    remove("tmp_whole.report") ;
+    remove("tmp_shard.report") ;
+  }
+  else if (!strcmp(argv[1], "append")) // append genomes to an index and build the index from scratch
+  {
+    const size_t len = 20000 ;
+    const char abList[] = "ACGT" ;
+    std::vector<std::string> genomes(4) ;
+    size_t j ;
+    int strategy ;
+    srand(1) ;
+    for (i = 0 ; i < 4 ; ++i)
+    {
+      genomes[i].resize(len) ;
+      for (j = 0 ; j < len ; ++j)
+        genomes[i][j] = abList[rand() % 4] ;
+    }
+    WriteTestTaxonomy() ;
+    WriteTestGenomes("tmp_old.fa", genomes, 0, 2, "w") ;
+    WriteTestGenomes("tmp_new.fa", genomes, 2, 4, "w") ;
+    // The appended genomes are placed before the indexed ones
+    WriteTestGenomes("tmp_all.fa", genomes, 2, 4, "w") ;
+    WriteTestGenomes("tmp_all.fa", genomes, 0, 2, "a") ;
+
+    for (strategy = FM_SAMPLE_STRATEGY_ROW ; strategy <= FM_SAMPLE_STRATEGY_TEXT ; ++strategy)
+    {
+      printf("%s sampling:\n", strategy == FM_SAMPLE_STRATEGY_ROW ? "Row" : "Text position") ;
+      BuildTestIndex("tmp_old.fa", "tmp_old", 1, 0, strategy) ;
+      BuildTestIndex("tmp_all.fa", "tmp_fresh", 1, 0, strategy) ;
+      {
+        ReadFiles refGenomeFile ;
+        refGenomeFile.AddReadFile((char *)"tmp_new.fa", false) ;
+        Builder builder ;
+        struct _FMBuilderParam param ;
+        builder.Append("tmp_old", refGenomeFile, (char *)"tmp_nodes.dmp", (char *)"tmp_names.dmp", 
+            (char *)"tmp_seqid.map", false, 0, param, "ACGT") ;
+        builder.Save("tmp_append") ;
+      }
+
+      FMIndex<BWTSequence, Alphabet_DNA> appended ;
+      FMIndex<BWTSequence, Alphabet_DNA> fresh ;
+      FILE *fp = fopen("tmp_append.1.cfr", "r") ;
+      appended.Load(fp) ;
+      fclose(fp) ;
+      fp = fopen("tmp_fresh.1.cfr", "r") ;
+      fresh.Load(fp) ;
+      fclose(fp) ;
+      
+      const size_t n = fresh.GetSize() ;
+      mismatchCnt = 0 ;
+      if (appended.GetSize() != n || appended.GetFirstISA() != fresh.GetFirstISA())
+        ++mismatchCnt ;
+      for (i = 0 ; i < n && !mismatchCnt ; ++i)
+        if (appended.GetBWTSequence().Access(i) != fresh.GetBWTSequence().Access(i))
+          ++mismatchCnt ;
+      printf("BWT mismatch count: %u\n", mismatchCnt) ;
+      
+      // The sequence id of every row comes from the sampled SA and the genome boundaries
+      mismatchCnt = 0 ;
+      for (i = 0 ; i < n ; ++i)
+      {
+        size_t l = 0 ;
+        size_t freshL = 0 ;
+        if (appended.BackwardToSampledSA(i, l) != fresh.BackwardToSampledSA(i, freshL))
+          ++mismatchCnt ;
+      }
+      printf("Locate mismatch count: %u\n", mismatchCnt) ;
+      
+      mismatchCnt = 0 ;
+      if (appended._auxData.precomputeSize != fresh._auxData.precomputeSize)
+        ++mismatchCnt ;
+      for (i = 0 ; i < fresh._auxData.precomputeSize && !mismatchCnt ; ++i)
+      {
+        const std::pair<size_t, size_t> &a = appended._auxData.precomputedRange[i] ;
+        const std::pair<size_t, size_t> &b = fresh._auxData.precomputedRange[i] ;
+        if (a.second != b.second || (b.second > 0 && a.first != b.first))
+          ++mismatchCnt ;
+      }
+      printf("Precomputed range mismatch count: %u\n", mismatchCnt) ;
+      RemoveTestIndex("tmp_old") ;
+      RemoveTestIndex("tmp_fresh") ;
+      RemoveTestIndex("tmp_append") ;
+    }
+    RemoveTestTaxonomy() ;
+    remove("tmp_old.fa") ;
+    remove("tmp_new.fa") ;
+    remove("tmp_all.fa") ;
+  }
 
   PrintLog("Done") ;
   return 0 ;